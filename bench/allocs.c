@@ -0,0 +1,652 @@
+/*
+ * ZM allocations per API operation.
+ *
+ * Usage: allocs.bin [-v] [name ...]
+ *
+ * Count the allocator calls of each operation (on a warm vm) and compare
+ * them with a budget: print the results as JSON and exit with 1 if an
+ * operation allocate more than its budget. With -v also print the
+ * operations within the budget on stderr.
+ *
+ * malloc, calloc, realloc and free are wrapped at link time (see the
+ * --wrap flags in Makefile) so the calls that don't pass through
+ * zm_malloc are counted too (raw_per_op). Compile with
+ * -DZM_ENABLE_MEMSTATS for the bytes of zm_malloc.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zm.h>
+
+
+/* operations of a measure (see measure) */
+#define NOP 1000
+
+
+static const char *sep = "";
+static int verbose;
+static int over;
+
+static zm_Event *tick;
+static zm_Event *never;
+
+
+
+/* ---- allocator wrappers (-Wl,--wrap=malloc ...) ---- */
+
+typedef struct {
+	unsigned long allocs;   /* malloc and calloc */
+	unsigned long reallocs;
+	unsigned long frees;
+} LibcStats;
+
+static LibcStats libc;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+
+void *__wrap_malloc(size_t size)
+{
+	libc.allocs++;
+	return __real_malloc(size);
+}
+
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+	libc.allocs++;
+	return __real_calloc(n, size);
+}
+
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+	libc.reallocs++;
+	return __real_realloc(ptr, size);
+}
+
+
+void __wrap_free(void *ptr)
+{
+	if (ptr)
+		libc.frees++;
+
+	__real_free(ptr);
+}
+
+
+
+/* ---- utility ---- */
+
+static void run(zm_VM *vm)
+{
+	while (zm_go(vm, 1000, NULL))
+		;
+}
+
+
+static void closeAll(zm_VM *vm)
+{
+	zm_closeVM(vm);
+	run(vm);
+}
+
+
+/* per operation difference between the 2n and the n measure */
+static double perOp(unsigned long v0, unsigned long v1, unsigned long v2,
+                    size_t n)
+{
+	return ((double)(v2 - v1) - (double)(v1 - v0)) / n;
+}
+
+
+/*
+ * Measure an operation twice (n and 2n times): the difference is the cost
+ * of n operations without the fixed cost of the measure (setup tasks,
+ * subtasks and groups).
+ */
+static void measure(const char *name, void (*op)(zm_VM *vm, size_t n),
+                    zm_VM *vm, size_t n, double budget)
+{
+	zm_MemStats m0, m1, m2;
+	LibcStats l0, l1, l2;
+	double allocs, reallocs, raw, bytes;
+	int ok;
+
+	zm_getMemStats(&m0);
+	l0 = libc;
+	op(vm, n);
+	zm_getMemStats(&m1);
+	l1 = libc;
+	op(vm, 2 * n);
+	zm_getMemStats(&m2);
+	l2 = libc;
+
+	allocs = perOp(l0.allocs, l1.allocs, l2.allocs, n);
+	reallocs = perOp(l0.reallocs, l1.reallocs, l2.reallocs, n);
+	raw = allocs + reallocs -
+	      perOp(m0.allocs, m1.allocs, m2.allocs, n) -
+	      perOp(m0.reallocs, m1.reallocs, m2.reallocs, n);
+	bytes = ((double)(m2.bytes - m1.bytes) -
+	         (double)(m1.bytes - m0.bytes)) / n;
+	ok = (allocs + reallocs <= budget);
+
+	printf("%s    {\"name\": \"%s\", \"ops\": %zu, \"allocs_per_op\": %.3f, "
+	       "\"budget\": %g, \"reallocs_per_op\": %.3f, "
+	       "\"raw_per_op\": %.3f, \"bytes_per_op\": %.1f, \"ok\": %s}",
+	       sep, name, n, allocs, budget, reallocs, raw, bytes,
+	       (ok) ? "true" : "false");
+
+	sep = ",\n";
+
+	if (!ok) {
+		fprintf(stderr, "allocs: %s: %.3f allocs/op (budget %g)\n", name,
+		        allocs + reallocs, budget);
+		over++;
+	} else if (verbose) {
+		fprintf(stderr, "allocs: %s: %.3f allocs/op ok\n", name,
+		        allocs + reallocs);
+	}
+}
+
+
+
+/* ---- machines ---- */
+
+ZMTASKDEF( empty )
+{
+	ZMSTART
+
+	zmstate 1:
+		zmyield zmTERM;
+
+	ZMEND
+}
+
+
+ZMTASKDEF( waiter )
+{
+	ZMSTART
+
+	zmstate 1:
+		zmyield zmEVENT(tick) | 1;
+
+	ZMEND
+}
+
+
+ZMTASKDEF( idle )
+{
+	ZMSTART
+
+	zmstate 1:
+		zmyield zmEVENT(never) | 1;
+
+	ZMEND
+}
+
+
+ZMTASKDEF( sleeper )
+{
+	ZMSTART
+
+	zmstate 1:
+		zmyield zmSUSPEND | 1;
+
+	ZMEND
+}
+
+
+ZMTASKDEF( echo )
+{
+	ZMSTART
+
+	zmstate 1:
+		zmyield zmCALLER | 1;
+
+	ZMEND
+}
+
+
+typedef struct {
+	zm_State *sub;
+	size_t n;
+} Caller;
+
+
+/* n zmSUB of the same subtask */
+ZMTASKDEF( caller )
+{
+	Caller *self = zmdata;
+
+	ZMSTART
+
+	zmstate 1:
+		self->sub = zmNewSubTask(echo, NULL);
+
+	zmstate 2:
+		if (!self->n)
+			zmyield zmTERM;
+
+		self->n--;
+		zmyield zmSUB(self->sub, NULL) | 2;
+
+	zmstate ZM_TERM:
+		if (self->sub)
+			zm_freeSubTask(vm, self->sub);
+
+	ZMEND
+}
+
+
+/* n zmSUB of a new subtasklet */
+ZMTASKDEF( spawner )
+{
+	size_t *n = zmdata;
+
+	ZMSTART
+
+	zmstate 1:
+		if (!*n)
+			zmyield zmTERM;
+
+		(*n)--;
+		zmyield zmSUB(zmNewSubTasklet(empty, NULL), NULL) | 1;
+
+	ZMEND
+}
+
+
+ZMTASKDEF( thrower )
+{
+	ZMSTART
+
+	zmstate 1:
+		zmraise zmABORT(1, "allocs", NULL);
+
+	ZMEND
+}
+
+
+/* n zmABORT raised by a subtasklet and catched */
+ZMTASKDEF( catcher )
+{
+	size_t *n = zmdata;
+
+	ZMSTART
+
+	zmstate 1:
+		if (!*n)
+			zmyield zmTERM;
+
+		(*n)--;
+		zmyield zmSUB(zmNewSubTasklet(thrower, NULL), NULL) | 1 |
+		        zmCATCH(2);
+
+	zmstate 2:
+		zmCatch();
+		zmyield 1;
+
+	ZMEND
+}
+
+
+ZMTASKDEF( bouncer )
+{
+	ZMSTART
+
+	zmstate 1:
+		zmraise zmCONTINUE(1, "allocs", NULL) | 1;
+
+	ZMEND
+}
+
+
+/* n zmCONTINUE raised by the same subtask, catched and unraised */
+ZMTASKDEF( unraiser )
+{
+	Caller *self = zmdata;
+
+	ZMSTART
+
+	zmstate 1:
+		self->sub = zmNewSubTask(bouncer, NULL);
+		zmyield zmSUB(self->sub, NULL) | 3 | zmCATCH(2);
+
+	zmstate 2:
+		zmCatch();
+
+		if (!self->n)
+			zmyield zmTERM;
+
+		self->n--;
+		zmyield zmUNRAISE(self->sub, NULL) | 3 | zmCATCH(2);
+
+	zmstate 3:
+		zmyield zmTERM;
+
+	zmstate ZM_TERM:
+		if (self->sub)
+			zm_freeSubTask(vm, self->sub);
+
+	ZMEND
+}
+
+
+typedef struct {
+	zm_Group *g;
+	size_t n;
+} Joiner;
+
+
+/* n zmJOIN of a group of one tasklet */
+ZMTASKDEF( joiner )
+{
+	Joiner *self = zmdata;
+
+	ZMSTART
+
+	zmstate 1: {
+		zm_State *s;
+
+		if (!self->n)
+			zmyield zmTERM;
+
+		self->n--;
+		s = zm_newTasklet(vm, empty, NULL);
+		zm_groupAdd(vm, self->g, s);
+		zm_resume(vm, s, NULL);
+		zmyield zmJOIN(self->g) | 1;
+	}
+
+	ZMEND
+}
+
+
+
+/* ---- operations ---- */
+
+/* zm_newTasklet + zm_resume + run to the end */
+static void opTasklet(zm_VM *vm, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		zm_resume(vm, zm_newTasklet(vm, empty, NULL), NULL);
+
+	run(vm);
+}
+
+
+/* zm_newTask + zm_resume + run to the end + zm_freeTask */
+static void opTask(zm_VM *vm, size_t n)
+{
+	zm_State **tasks = malloc(sizeof(zm_State*) * n);
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		tasks[i] = zm_newTask(vm, empty, NULL);
+		zm_resume(vm, tasks[i], NULL);
+	}
+
+	run(vm);
+
+	for (i = 0; i < n; i++)
+		zm_freeTask(vm, tasks[i]);
+
+	free(tasks);
+}
+
+
+/* zm_newTasklets (bulk) + zm_resume + run to the end */
+static void opTasklets(zm_VM *vm, size_t n)
+{
+	zm_State **tasks = malloc(sizeof(zm_State*) * n);
+	size_t i;
+
+	zm_newTasklets(vm, empty, NULL, n, tasks);
+
+	for (i = 0; i < n; i++)
+		zm_resume(vm, tasks[i], NULL);
+
+	run(vm);
+
+	free(tasks);
+}
+
+
+/* zm_resume + zmSUSPEND of an existing task */
+static void opResume(zm_VM *vm, size_t n)
+{
+	static zm_State *s;
+	size_t i;
+
+	if (!s) {
+		s = zm_newTasklet(vm, sleeper, NULL);
+		zm_resume(vm, s, NULL);
+		run(vm);
+	}
+
+	for (i = 0; i < n; i++) {
+		zm_resume(vm, s, NULL);
+		run(vm);
+	}
+}
+
+
+/* zmEVENT + zm_trigger of a waiting task */
+static void opEvent(zm_VM *vm, size_t n)
+{
+	static zm_State *s;
+	size_t i;
+
+	if (!s) {
+		s = zm_newTasklet(vm, waiter, NULL);
+		zm_resume(vm, s, NULL);
+		run(vm);
+	}
+
+	for (i = 0; i < n; i++) {
+		zm_trigger(vm, tick, NULL);
+		run(vm);
+	}
+}
+
+
+/* zm_newEvent + zm_freeEvent */
+static void opNewEvent(zm_VM *vm, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		zm_freeEvent(vm, zm_newEvent(NULL));
+}
+
+
+/* zmSUB + zmCALLER of an existing subtask */
+static void opSub(zm_VM *vm, size_t n)
+{
+	Caller self;
+
+	self.sub = NULL;
+	self.n = n;
+
+	zm_resume(vm, zm_newTasklet(vm, caller, &self), NULL);
+	run(vm);
+}
+
+
+/* zmNewSubTasklet + zmSUB + run to the end */
+static void opSubTasklet(zm_VM *vm, size_t n)
+{
+	size_t left = n;
+
+	zm_resume(vm, zm_newTasklet(vm, spawner, &left), NULL);
+	run(vm);
+}
+
+
+/* zmABORT raised by a subtasklet and catched */
+static void opRaise(zm_VM *vm, size_t n)
+{
+	size_t left = n;
+
+	zm_resume(vm, zm_newTasklet(vm, catcher, &left), NULL);
+	run(vm);
+}
+
+
+/* zmCONTINUE raised by an existing subtask, catched and unraised */
+static void opUnraise(zm_VM *vm, size_t n)
+{
+	Caller self;
+
+	self.sub = NULL;
+	self.n = n;
+
+	zm_resume(vm, zm_newTasklet(vm, unraiser, &self), NULL);
+	run(vm);
+}
+
+
+/* zm_abort of a task waiting an event */
+static void opAbort(zm_VM *vm, size_t n)
+{
+	zm_State **tasks = malloc(sizeof(zm_State*) * n);
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		tasks[i] = zm_newTasklet(vm, idle, NULL);
+		zm_resume(vm, tasks[i], NULL);
+	}
+
+	run(vm);
+
+	for (i = 0; i < n; i++)
+		zm_abort(vm, tasks[i]);
+
+	run(vm);
+
+	free(tasks);
+}
+
+
+/* zm_groupAdd + zmJOIN */
+static void opJoin(zm_VM *vm, size_t n)
+{
+	Joiner self;
+
+	self.g = zm_newGroup(NULL);
+	self.n = n;
+
+	zm_resume(vm, zm_newTasklet(vm, joiner, &self), NULL);
+	run(vm);
+
+	zm_freeGroup(vm, self.g);
+}
+
+
+
+/* ---- main ---- */
+
+typedef struct {
+	const char *name;
+	void (*op)(zm_VM *vm, size_t n);
+	double budget;     /* max malloc, calloc and realloc per operation */
+	int reserve;       /* reserve exceptions before the warm-up */
+} Case;
+
+
+/* a chunk of states when all the states of the previous ones are free */
+#define CHUNK (2.0 / ZM_ARENA_CHUNK)
+
+
+/*
+ * Budgets (allocator calls per operation): the states come from the arena
+ * (an arena chunk is free when all its states are free, so a population
+ * that drop to zero pay a chunk every ZM_ARENA_CHUNK tasks) and the
+ * exceptions from the vm pool (a catched exception is allocation free).
+ * An event wait (zmEVENT, zmJOIN) and the wait of an aborted task allocate
+ * the event binder, zm_groupAdd the state extension (its member node). A
+ * subtask allocate its parent stack (2) and its close allocate the implode
+ * queues (zm_queueNew and zm_queueAdd).
+ */
+static Case cases[] = {
+	{"tasklet", opTasklet, CHUNK, 0},
+	{"task", opTask, CHUNK, 0},
+	{"tasklets", opTasklets, 0, 0},
+	{"resume", opResume, 0, 0},
+	{"event_trigger", opEvent, 1, 0},
+	{"new_event", opNewEvent, 1, 0},
+	{"sub_call", opSub, 0, 0},
+	{"sub_tasklet", opSubTasklet, 10, 0},
+	{"raise_catch", opRaise, 9, 1},
+	{"unraise", opUnraise, 0, 1},
+	{"abort", opAbort, 1 + CHUNK, 0},
+	{"group_join", opJoin, 2, 0},
+	{NULL, NULL, 0, 0}
+};
+
+
+static int selected(int argc, char **argv, int first, const char *name)
+{
+	int i;
+
+	if (first >= argc)
+		return 1;
+
+	for (i = first; i < argc; i++)
+		if (strcmp(argv[i], name) == 0)
+			return 1;
+
+	return 0;
+}
+
+
+int main(int argc, char **argv)
+{
+	int first = 1;
+	Case *c;
+
+	if ((argc > 1) && (strcmp(argv[1], "-v") == 0)) {
+		verbose = 1;
+		first = 2;
+	}
+
+	tick = zm_newEvent(NULL);
+	never = zm_newEvent(NULL);
+
+	printf("{\n  \"zm\": \"%s\",\n  \"results\": [\n", ZM_VERSION);
+
+	for (c = cases; c->name; c++) {
+		zm_VM *vm;
+
+		if (!selected(argc, argv, first, c->name))
+			continue;
+
+		vm = zm_newVM("allocs");
+
+		if (c->reserve)
+			zm_reserveExceptions(vm, 1, 3);
+
+		/* warm-up: fill the arena and the pools */
+		c->op(vm, 2 * NOP);
+
+		measure(c->name, c->op, vm, NOP, c->budget);
+
+		closeAll(vm);
+		zm_freeVM(vm);
+	}
+
+	printf("\n  ]\n}\n");
+
+	zm_freeEvent(NULL, tick);
+	zm_freeEvent(NULL, never);
+
+	return (over) ? 1 : 0;
+}
@@ -0,0 +1,703 @@
+/*
+ * ZM core runtime benchmarks.
+ *
+ * Usage: bench.bin [-s scale] [name ...]
+ *
+ * Run all benchmarks (or only the named ones) and print the results as
+ * JSON on stdout. `scale` multiply the number of operations (default 1).
+ */
+
+#ifndef _POSIX_C_SOURCE
+	#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+	#include <unistd.h>
+#endif
+
+#include <zm.h>
+
+
+static double scale = 1;
+static const char *sep = "";
+
+static zm_Event *never;   /* an event that is never triggered */
+static zm_Event *tick;
+static long counter;
+static int fanout;
+
+
+/* ---- utility ---- */
+
+static uint64_t now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+
+static size_t scaled(size_t n)
+{
+	size_t s = (size_t)(n * scale);
+
+	return (s) ? s : 1;
+}
+
+
+static void run(zm_VM *vm)
+{
+	while (zm_go(vm, 1000, NULL))
+		;
+}
+
+
+static void closeAll(zm_VM *vm)
+{
+	zm_closeVM(vm);
+	run(vm);
+}
+
+
+/* one JSON result: ops operations in ns nanoseconds */
+static void result(const char *name, const char *param, long value,
+                   size_t ops, uint64_t ns)
+{
+	printf("%s    {\"name\": \"%s\", ", sep, name);
+
+	if (param)
+		printf("\"%s\": %ld, ", param, value);
+
+	printf("\"ops\": %zu, \"ns\": %lu, \"ns_per_op\": %.2f, "
+	       "\"ops_per_s\": %.0f}", ops, (unsigned long)ns,
+	       (double)ns / ops, (ns) ? ops * 1e9 / ns : 0.0);
+
+	sep = ",\n";
+	fflush(stdout);
+}
+
+
+
+/* ---- machines ---- */
+
+ZMTASKDEF( empty )
+{
+	ZMSTART
+
+	zmstate 1:
+		zmyield zmTERM;
+
+	ZMEND
+}
+
+
+ZMTASKDEF( spin )
+{
+	ZMSTART
+
+	zmstate 1:
+		counter++;
+		zmyield 1;
+
+	ZMEND
+}
+
+
+ZMTASKDEF( echo )
+{
+	ZMSTART
+
+	zmstate 1:
+		zmyield zmCALLER | 1;
+
+	ZMEND
+}
+
+
+typedef struct {
+	zm_State *sub;
+	size_t n;
+} Caller;
+
+
+ZMTASKDEF( caller )
+{
+	Caller *self = zmdata;
+
+	ZMSTART
+
+	zmstate 1:
+		self->sub = zmNewSubTask(echo, NULL);
+
+	zmstate 2:
+		if (!self->n)
+			zmyield zmTERM;
+
+		self->n--;
+		zmyield zmSUB(self->sub, NULL) | 2;
+
+	zmstate ZM_TERM:
+		if (self->sub)
+			zm_freeSubTask(vm, self->sub);
+
+	ZMEND
+}
+
+
+ZMTASKDEF( waiter )
+{
+	ZMSTART
+
+	zmstate 1:
+		zmyield zmEVENT(tick) | 1;
+
+	ZMEND
+}
+
+
+ZMTASKDEF( thrower )
+{
+	ZMSTART
+
+	zmstate 1:
+		zmraise zmABORT(1, "bench", NULL);
+
+	ZMEND
+}
+
+
+ZMTASKDEF( catcher )
+{
+	size_t *n = zmdata;
+
+	ZMSTART
+
+	zmstate 1:
+		if (!*n)
+			zmyield zmTERM;
+
+		(*n)--;
+		zmyield zmSUB(zmNewSubTasklet(thrower, NULL), NULL) | 1 |
+		        zmCATCH(2);
+
+	zmstate 2:
+		zmCatch();
+		zmyield 1;
+
+	ZMEND
+}
+
+
+ZMTASKDEF( idle )
+{
+	ZMSTART
+
+	zmstate 1:
+		zmyield zmEVENT(never) | 1;
+
+	ZMEND
+}
+
+
+/* node of a tree: `fanout` idle children and a chain child (data=depth) */
+ZMTASKDEF( node )
+{
+	ZMSTART
+
+	zmstate 1: {
+		size_t depth = (size_t)zmdata;
+		int i;
+
+		for (i = 0; i < fanout; i++)
+			zmNewSubTasklet(idle, NULL);
+
+		if (depth)
+			zmyield zmSUB(zmNewSubTasklet(node,
+			                              (void*)(depth - 1)),
+			              NULL) | 2;
+
+		zmyield zmEVENT(never) | 2;
+	}
+
+	zmstate 2:
+		zmyield zmTERM;
+
+	ZMEND
+}
+
+
+/* as node, but every level return to its caller once built (the tree is
+   left suspended for a zmCLOSE) */
+ZMTASKDEF( branch )
+{
+	ZMSTART
+
+	zmstate 1: {
+		size_t depth = (size_t)zmdata;
+		int i;
+
+		for (i = 0; i < fanout; i++)
+			zmNewSubTasklet(idle, NULL);
+
+		if (depth)
+			zmyield zmSUB(zmNewSubTasklet(branch,
+			                              (void*)(depth - 1)),
+			              NULL) | 2;
+	}
+
+	zmstate 2:
+		zmyield zmCALLER | 2;
+
+	ZMEND
+}
+
+
+typedef struct {
+	zm_State *sub;
+	size_t depth;
+} Closer;
+
+
+/* build a branch tree then close it with zmCLOSE on `tick` */
+ZMTASKDEF( closer )
+{
+	Closer *self = zmdata;
+
+	ZMSTART
+
+	zmstate 1:
+		self->sub = zmNewSubTasklet(branch, (void*)self->depth);
+		zmyield zmSUB(self->sub, NULL) | 2;
+
+	zmstate 2:
+		zmyield zmEVENT(tick) | 3;
+
+	zmstate 3:
+		zmyield zmCLOSE(self->sub) | 4;
+
+	zmstate 4:
+		zmyield zmTERM;
+
+	ZMEND
+}
+
+
+
+/* ---- benchmarks ---- */
+
+/* zm_newTask + run to the end + zm_freeTask */
+static void benchSpawnTask()
+{
+	const size_t batch = 1000;
+	size_t n = scaled(200) * batch, i, j;
+	zm_State **tasks = malloc(sizeof(zm_State*) * batch);
+	zm_VM *vm = zm_newVM("bench");
+	uint64_t t = now();
+
+	for (i = 0; i < n; i += batch) {
+		for (j = 0; j < batch; j++) {
+			tasks[j] = zm_newTask(vm, empty, NULL);
+			zm_resume(vm, tasks[j], NULL);
+		}
+
+		run(vm);
+
+		for (j = 0; j < batch; j++)
+			zm_freeTask(vm, tasks[j]);
+	}
+
+	result("spawn_free_task", NULL, 0, n, now() - t);
+
+	zm_freeVM(vm);
+	free(tasks);
+}
+
+
+/* zm_newTasklet (free at the end) */
+static void benchSpawnTasklet()
+{
+	const size_t batch = 1000;
+	size_t n = scaled(200) * batch, i, j;
+	zm_VM *vm = zm_newVM("bench");
+	uint64_t t = now();
+
+	for (i = 0; i < n; i += batch) {
+		for (j = 0; j < batch; j++)
+			zm_resume(vm, zm_newTasklet(vm, empty, NULL), NULL);
+
+		run(vm);
+	}
+
+	result("spawn_free_tasklet", NULL, 0, n, now() - t);
+
+	zm_freeVM(vm);
+}
+
+
+/* zm_newTasklets (bulk) */
+static void benchSpawnBulk()
+{
+	const size_t batch = 1000;
+	size_t n = scaled(200) * batch, i, j;
+	zm_State **tasks = malloc(sizeof(zm_State*) * batch);
+	zm_VM *vm = zm_newVM("bench");
+	uint64_t t = now();
+
+	for (i = 0; i < n; i += batch) {
+		zm_newTasklets(vm, empty, NULL, batch, tasks);
+
+		for (j = 0; j < batch; j++)
+			zm_resume(vm, tasks[j], NULL);
+
+		run(vm);
+	}
+
+	result("spawn_free_bulk", NULL, 0, n, now() - t);
+
+	zm_freeVM(vm);
+	free(tasks);
+}
+
+
+/* steps with ntask ready tasks */
+static void benchStep(size_t ntask)
+{
+	size_t n = scaled(5000000), i;
+	zm_VM *vm = zm_newVM("bench");
+	uint64_t t;
+
+	for (i = 0; i < ntask; i++)
+		zm_resume(vm, zm_newTasklet(vm, spin, NULL), NULL);
+
+	counter = 0;
+	t = now();
+
+	while ((size_t)counter < n)
+		zm_go(vm, 1000, NULL);
+
+	t = now() - t;
+
+	result("step", "tasks", (long)ntask, (size_t)counter, t);
+
+	closeAll(vm);
+	zm_freeVM(vm);
+}
+
+
+/* zmSUB + zmCALLER (maxnest: see zm_setInlineSub) */
+static void benchSubRoundTrip(unsigned int maxnest)
+{
+	Caller self;
+	zm_VM *vm = zm_newVM("bench");
+	uint64_t t;
+
+	self.sub = NULL;
+	self.n = scaled(2000000);
+
+	zm_setInlineSub(vm, maxnest);
+	zm_resume(vm, zm_newTasklet(vm, caller, &self), NULL);
+
+	t = now();
+	run(vm);
+	t = now() - t;
+
+	result("sub_roundtrip", "inline", (long)maxnest, scaled(2000000), t);
+
+	zm_freeVM(vm);
+}
+
+
+/* zm_trigger to nwaiter tasks (each resumed task wait again) */
+static void benchTrigger(size_t nwaiter)
+{
+	size_t round = scaled(2000000) / nwaiter + 1, i;
+	zm_VM *vm = zm_newVM("bench");
+	uint64_t t;
+
+	tick = zm_newEvent(NULL);
+
+	for (i = 0; i < nwaiter; i++)
+		zm_resume(vm, zm_newTasklet(vm, waiter, NULL), NULL);
+
+	run(vm);
+
+	t = now();
+
+	for (i = 0; i < round; i++) {
+		zm_trigger(vm, tick, NULL);
+		run(vm);
+	}
+
+	t = now() - t;
+
+	result("trigger_fanout", "waiters", (long)nwaiter, round * nwaiter, t);
+
+	closeAll(vm);
+	zm_freeEvent(vm, tick);
+	zm_freeVM(vm);
+}
+
+
+/* zmABORT raised by a subtask and catched by its caller */
+static void benchAbort()
+{
+	size_t n = scaled(500000);
+	size_t left = n;
+	zm_VM *vm = zm_newVM("bench");
+	uint64_t t;
+
+	zm_reserveExceptions(vm, 1, 3);
+	zm_resume(vm, zm_newTasklet(vm, catcher, &left), NULL);
+
+	t = now();
+	run(vm);
+	t = now() - t;
+
+	result("abort_catch", NULL, 0, n, t);
+
+	zm_freeVM(vm);
+}
+
+
+/* close trees of (depth + 1) * (fanout + 1) tasks with zm_abort */
+static void benchClose(const char *shape, size_t depth, int width)
+{
+	size_t ntree = scaled(100000) / ((depth + 1) * (width + 1)) + 1;
+	size_t ntask = ntree * (depth + 1) * (width + 1), i;
+	zm_State **roots = malloc(sizeof(zm_State*) * ntree);
+	zm_VM *vm = zm_newVM("bench");
+	uint64_t t;
+	char name[64];
+
+	fanout = width;
+
+	for (i = 0; i < ntree; i++) {
+		roots[i] = zm_newTasklet(vm, node, (void*)depth);
+		zm_resume(vm, roots[i], NULL);
+	}
+
+	run(vm);
+
+	t = now();
+
+	for (i = 0; i < ntree; i++)
+		zm_abort(vm, roots[i]);
+
+	run(vm);
+
+	t = now() - t;
+
+	snprintf(name, sizeof(name), "close_%s", shape);
+	result(name, "tree_size", (long)((depth + 1) * (width + 1)), ntask, t);
+
+	zm_freeVM(vm);
+	free(roots);
+}
+
+
+/* close the same trees with zmCLOSE from their parent task */
+static void benchCloseSub(const char *shape, size_t depth, int width)
+{
+	size_t ntree = scaled(100000) / ((depth + 1) * (width + 1)) + 1;
+	size_t ntask = ntree * (depth + 1) * (width + 1), i;
+	Closer *closers = malloc(sizeof(Closer) * ntree);
+	zm_VM *vm = zm_newVM("bench");
+	uint64_t t;
+	char name[64];
+
+	fanout = width;
+	tick = zm_newEvent(NULL);
+
+	for (i = 0; i < ntree; i++) {
+		closers[i].sub = NULL;
+		closers[i].depth = depth;
+		zm_resume(vm, zm_newTasklet(vm, closer, &closers[i]), NULL);
+	}
+
+	run(vm);
+
+	t = now();
+
+	zm_trigger(vm, tick, NULL);
+	run(vm);
+
+	t = now() - t;
+
+	snprintf(name, sizeof(name), "close_sub_%s", shape);
+	result(name, "tree_size", (long)((depth + 1) * (width + 1)), ntask, t);
+
+	zm_freeEvent(vm, tick);
+	zm_freeVM(vm);
+	free(closers);
+}
+
+
+/* resident memory in bytes (0 if not available) */
+static size_t rss()
+{
+	#ifdef __linux__
+	FILE *f = fopen("/proc/self/statm", "r");
+	unsigned long size, resident = 0;
+
+	if (!f)
+		return 0;
+
+	if (fscanf(f, "%lu %lu", &size, &resident) != 2)
+		resident = 0;
+
+	fclose(f);
+
+	return (size_t)resident * (size_t)sysconf(_SC_PAGESIZE);
+	#else
+	return 0;
+	#endif
+}
+
+
+/* memory of ntask tasks waiting an event (the resident memory is only
+   meaningful on a fresh heap: run it first) */
+static void benchMemory()
+{
+	size_t n = scaled(1000000), i;
+	zm_VM *vm = zm_newVM("bench");
+	size_t before = rss(), after;
+	#ifdef ZM_ENABLE_MEMSTATS
+	zm_MemStats m0, m1;
+
+	zm_getMemStats(&m0);
+	#endif
+
+	for (i = 0; i < n; i++)
+		zm_resume(vm, zm_newTasklet(vm, idle, NULL), NULL);
+
+	run(vm);
+
+	after = rss();
+
+	printf("%s    {\"name\": \"memory_idle_task\", \"tasks\": %zu, "
+	       "\"state_size\": %zu, \"zm_bytes_per_task\": ", sep, n,
+	       sizeof(zm_State));
+
+	#ifdef ZM_ENABLE_MEMSTATS
+	zm_getMemStats(&m1);
+	printf("%.1f, ", (double)(m1.bytes - m0.bytes) / n);
+	#else
+	printf("null, ");
+	#endif
+
+	printf("\"rss_bytes_per_task\": ");
+
+	if ((before) && (after > before))
+		printf("%.1f}", (double)(after - before) / n);
+	else
+		printf("null}");
+
+	sep = ",\n";
+
+	closeAll(vm);
+	zm_freeVM(vm);
+}
+
+
+
+/* ---- main ---- */
+
+typedef struct {
+	const char *name;
+	void (*fn)();
+} Bench;
+
+
+static void benchStepAll()
+{
+	benchStep(1);
+	benchStep(100);
+	benchStep(10000);
+}
+
+
+static void benchSubAll()
+{
+	benchSubRoundTrip(0);
+	benchSubRoundTrip(1000);
+}
+
+
+static void benchTriggerAll()
+{
+	benchTrigger(10);
+	benchTrigger(1000);
+	benchTrigger(100000);
+}
+
+
+static void benchCloseAll()
+{
+	benchClose("chain", 99, 0);
+	benchClose("wide", 0, 99);
+	benchClose("comb", 9, 9);
+	benchClose("flat", 0, 0);
+	benchCloseSub("comb", 9, 9);
+}
+
+
+static Bench benchs[] = {
+	{"memory", benchMemory},   /* first: on a fresh heap */
+	{"spawn", benchSpawnTask},
+	{"spawn", benchSpawnTasklet},
+	{"spawn", benchSpawnBulk},
+	{"step", benchStepAll},
+	{"sub", benchSubAll},
+	{"trigger", benchTriggerAll},
+	{"abort", benchAbort},
+	{"close", benchCloseAll},
+	{NULL, NULL}
+};
+
+
+static int selected(int argc, char **argv, int first, const char *name)
+{
+	int i;
+
+	if (first >= argc)
+		return 1;
+
+	for (i = first; i < argc; i++)
+		if (strcmp(argv[i], name) == 0)
+			return 1;
+
+	return 0;
+}
+
+
+int main(int argc, char **argv)
+{
+	int first = 1;
+	Bench *b;
+
+	if ((argc > 2) && (strcmp(argv[1], "-s") == 0)) {
+		scale = atof(argv[2]);
+		first = 3;
+	}
+
+	never = zm_newEvent(NULL);
+
+	printf("{\n  \"zm\": \"%s\",\n  \"scale\": %g,\n  \"benchmarks\": [\n",
+	       ZM_VERSION, scale);
+
+	for (b = benchs; b->name; b++)
+		if (selected(argc, argv, first, b->name))
+			b->fn();
+
+	printf("\n  ]\n}\n");
+
+	zm_freeEvent(NULL, never);
+	return 0;
+}
@@ -0,0 +1,1306 @@
+/*
+ * ZM compared with ucontext coroutines and pthreads.
+ *
+ * Usage: compare.bin [-s scale] [-u max] [-p max] [name ...]
+ *
+ * Run the same workloads (pingpong, fanout, generator, prodcons) with ZM
+ * tasks, with ucontext coroutines (a minimal FIFO scheduler) and with
+ * pthreads (mutex and condition variables) and print the results as JSON.
+ * The `scale` workload spawn 1000 to 1000000 idle units and report the
+ * spawn cost, the wake cost and the resident memory per unit: ucontext
+ * and pthreads are skipped over `-u` (default 100000) and `-p` (default
+ * 10000) units.
+ */
+
+#ifndef _XOPEN_SOURCE
+	#define _XOPEN_SOURCE 700
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <limits.h>
+#include <unistd.h>
+#include <ucontext.h>
+#include <pthread.h>
+
+#include <zm.h>
+
+
+/* stack of a ucontext coroutine and of a thread */
+#define STACK_SIZE (32 * 1024)
+
+/* fanout children */
+#define FANOUT 1000
+
+/* producer/consumer: tasks of each side and queue size */
+#define NPROD 4
+#define NCONS 4
+#define QSIZE 64
+
+
+static double scale = 1;
+static const char *sep = "";
+static size_t maxuc = 100000;
+static size_t maxth = 10000;
+
+
+/* ---- utility ---- */
+
+static uint64_t now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+
+static size_t scaled(size_t n)
+{
+	size_t s = (size_t)(n * scale);
+
+	return (s) ? s : 1;
+}
+
+
+/* resident memory in bytes (0 if not available) */
+static size_t rss()
+{
+	#ifdef __linux__
+	FILE *f = fopen("/proc/self/statm", "r");
+	unsigned long size, resident = 0;
+
+	if (!f)
+		return 0;
+
+	if (fscanf(f, "%lu %lu", &size, &resident) != 2)
+		resident = 0;
+
+	fclose(f);
+
+	return (size_t)resident * (size_t)sysconf(_SC_PAGESIZE);
+	#else
+	return 0;
+	#endif
+}
+
+
+static void fail(const char *msg)
+{
+	fprintf(stderr, "compare: %s\n", msg);
+	exit(1);
+}
+
+
+/* one JSON result: ops operations in ns nanoseconds */
+static void result(const char *name, const char *impl, size_t ops,
+                   uint64_t ns)
+{
+	printf("%s    {\"name\": \"%s\", \"impl\": \"%s\", \"ops\": %zu, "
+	       "\"ns\": %lu, \"ns_per_op\": %.2f, \"ops_per_s\": %.0f}",
+	       sep, name, impl, ops, (unsigned long)ns, (double)ns / ops,
+	       (ns) ? ops * 1e9 / ns : 0.0);
+
+	sep = ",\n";
+	fflush(stdout);
+}
+
+
+/* scale result: spawn and wake time and memory of n units */
+static void resultScale(const char *impl, size_t n, uint64_t spawn,
+                        uint64_t wake, size_t before, size_t after)
+{
+	printf("%s    {\"name\": \"scale\", \"impl\": \"%s\", \"units\": %zu, ",
+	       sep, impl, n);
+
+	if (!spawn) {
+		printf("\"skipped\": true}");
+	} else {
+		printf("\"spawn_ns_per_unit\": %.2f, \"wake_ns_per_unit\": %.2f, "
+		       "\"rss_bytes_per_unit\": ", (double)spawn / n,
+		       (double)wake / n);
+
+		if ((before) && (after >= before))
+			printf("%.1f}", (double)(after - before) / n);
+		else
+			printf("null}");
+	}
+
+	sep = ",\n";
+	fflush(stdout);
+}
+
+
+
+/* ---- ucontext coroutines ---- */
+
+typedef struct Coro {
+	ucontext_t ctx;
+	void (*fn)(void *arg);
+	void *arg;
+	char *stack;
+	struct Coro *next;   /* ready queue or wait list */
+	int done;
+} Coro;
+
+typedef struct {
+	Coro *head;
+	Coro *tail;
+} CoroList;
+
+
+static ucontext_t sched;
+static Coro *current;
+static CoroList ready;
+static char *freestacks;   /* stacks of finished coroutines (linked) */
+
+
+static void coPush(CoroList *l, Coro *c)
+{
+	c->next = NULL;
+
+	if (l->tail)
+		l->tail->next = c;
+	else
+		l->head = c;
+
+	l->tail = c;
+}
+
+
+static Coro* coPop(CoroList *l)
+{
+	Coro *c = l->head;
+
+	if (c) {
+		l->head = c->next;
+
+		if (!l->head)
+			l->tail = NULL;
+	}
+
+	return c;
+}
+
+
+static void coEntry()
+{
+	current->fn(current->arg);
+	current->done = 1;
+}
+
+
+static Coro* coSpawn(void (*fn)(void *arg), void *arg)
+{
+	Coro *c = malloc(sizeof(Coro));
+
+	if (!c)
+		fail("out of memory");
+
+	if (freestacks) {
+		c->stack = freestacks;
+		freestacks = *(char**)freestacks;
+	} else if (!(c->stack = malloc(STACK_SIZE))) {
+		fail("out of memory");
+	}
+
+	c->fn = fn;
+	c->arg = arg;
+	c->done = 0;
+
+	getcontext(&c->ctx);
+	c->ctx.uc_stack.ss_sp = c->stack;
+	c->ctx.uc_stack.ss_size = STACK_SIZE;
+	c->ctx.uc_link = &sched;
+	makecontext(&c->ctx, coEntry, 0);
+
+	coPush(&ready, c);
+	return c;
+}
+
+
+/* suspend the current coroutine (back to the scheduler) */
+static void coSuspend()
+{
+	swapcontext(&current->ctx, &sched);
+}
+
+
+/* put the current coroutine in l and suspend it */
+static void coWait(CoroList *l)
+{
+	coPush(l, current);
+	coSuspend();
+}
+
+
+/* move all the coroutines of l in the ready queue */
+static void coWakeAll(CoroList *l)
+{
+	Coro *c;
+
+	while ((c = coPop(l)))
+		coPush(&ready, c);
+}
+
+
+/* run until the ready queue is empty */
+static void coRun()
+{
+	Coro *c;
+
+	while ((c = coPop(&ready))) {
+		current = c;
+		swapcontext(&sched, &c->ctx);
+
+		if (c->done) {
+			*(char**)c->stack = freestacks;
+			freestacks = c->stack;
+			free(c);
+		}
+	}
+
+	current = NULL;
+}
+
+
+static void coFreeStacks()
+{
+	while (freestacks) {
+		char *s = freestacks;
+		freestacks = *(char**)s;
+		free(s);
+	}
+}
+
+
+
+/* ---- pthreads ---- */
+
+static pthread_t thSpawn(void *(*fn)(void *arg), void *arg)
+{
+	pthread_attr_t attr;
+	pthread_t t;
+	size_t size = STACK_SIZE;
+	int err;
+
+	#ifdef PTHREAD_STACK_MIN
+	if (size < PTHREAD_STACK_MIN)
+		size = PTHREAD_STACK_MIN;
+	#endif
+
+	pthread_attr_init(&attr);
+	pthread_attr_setstacksize(&attr, size);
+	err = pthread_create(&t, &attr, fn, arg);
+	pthread_attr_destroy(&attr);
+
+	if (err)
+		fail("pthread_create failed");
+
+	return t;
+}
+
+
+
+/* ---- pingpong: two units alternate n times ---- */
+
+static size_t pingleft;
+
+/* zm: each task resume the other (data) and suspend itself */
+static zm_State *zping, *zpong;
+
+ZMTASKDEF( zmPingPong )
+{
+	zm_State **peer = zmdata;
+
+	ZMSTART
+
+	zmstate 1:
+		if (!pingleft)
+			zmyield zmTERM;
+
+		pingleft--;
+		zm_resume(vm, *peer, NULL);
+		zmyield zmSUSPEND | 1;
+
+	ZMEND
+}
+
+
+static void benchPingPongZM(size_t n)
+{
+	zm_VM *vm = zm_newVM("compare");
+	uint64_t t;
+
+	pingleft = n;
+	zping = zm_newTasklet(vm, zmPingPong, &zpong);
+	zpong = zm_newTasklet(vm, zmPingPong, &zping);
+
+	t = now();
+	zm_resume(vm, zping, NULL);
+
+	while (zm_go(vm, 1000, NULL))
+		;
+
+	result("pingpong", "zm", n, now() - t);
+
+	/* close the suspended one */
+	zm_closeVM(vm);
+
+	while (zm_go(vm, 1000, NULL))
+		;
+
+	zm_freeVM(vm);
+}
+
+
+/* ucontext: direct switch between the two coroutines */
+static ucontext_t ucping, ucpong;
+
+static void ucPong()
+{
+	for (;;) {
+		if (!pingleft)
+			return;
+
+		pingleft--;
+		swapcontext(&ucpong, &ucping);
+	}
+}
+
+
+static void benchPingPongUC(size_t n)
+{
+	char *stack = malloc(STACK_SIZE);
+	uint64_t t;
+
+	pingleft = n;
+
+	getcontext(&ucpong);
+	ucpong.uc_stack.ss_sp = stack;
+	ucpong.uc_stack.ss_size = STACK_SIZE;
+	ucpong.uc_link = &ucping;
+	makecontext(&ucpong, ucPong, 0);
+
+	t = now();
+
+	while (pingleft) {
+		pingleft--;
+		swapcontext(&ucping, &ucpong);
+	}
+
+	result("pingpong", "ucontext", n, now() - t);
+
+	free(stack);
+}
+
+
+/* pthreads: a turn variable and a condition variable */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t turncond = PTHREAD_COND_INITIALIZER;
+static int turn;
+
+static void* thPong(void *arg)
+{
+	(void)arg;
+
+	pthread_mutex_lock(&lock);
+
+	for (;;) {
+		while ((turn != 1) && (pingleft))
+			pthread_cond_wait(&turncond, &lock);
+
+		if (!pingleft)
+			break;
+
+		pingleft--;
+		turn = 0;
+		pthread_cond_signal(&turncond);
+	}
+
+	pthread_mutex_unlock(&lock);
+	return NULL;
+}
+
+
+static void benchPingPongTH(size_t n)
+{
+	pthread_t t1;
+	uint64_t t;
+
+	pingleft = n;
+	turn = 0;
+	t1 = thSpawn(thPong, NULL);
+
+	t = now();
+	pthread_mutex_lock(&lock);
+
+	for (;;) {
+		while ((turn != 0) && (pingleft))
+			pthread_cond_wait(&turncond, &lock);
+
+		if (!pingleft)
+			break;
+
+		pingleft--;
+		turn = 1;
+		pthread_cond_signal(&turncond);
+	}
+
+	pthread_cond_signal(&turncond);
+	pthread_mutex_unlock(&lock);
+	pthread_join(t1, NULL);
+
+	result("pingpong", "pthread", n, now() - t);
+}
+
+
+static void benchPingPong()
+{
+	size_t n = scaled(2000000);
+
+	benchPingPongZM(n);
+	benchPingPongUC(n);
+	benchPingPongTH(n / 20 + 1);
+}
+
+
+
+/* ---- fanout: spawn FANOUT children and join them (n rounds) ---- */
+
+static volatile unsigned long sink;
+static size_t rounds;
+
+static void work(size_t i)
+{
+	sink += i;
+}
+
+
+ZMTASKDEF( zmChild )
+{
+	ZMSTART
+
+	zmstate 1:
+		work((size_t)zmdata);
+		zmyield zmTERM;
+
+	ZMEND
+}
+
+
+ZMTASKDEF( zmParent )
+{
+	zm_Group *g = zmdata;
+
+	ZMSTART
+
+	zmstate 1: {
+		size_t i;
+
+		if (!rounds)
+			zmyield zmTERM;
+
+		rounds--;
+
+		for (i = 0; i < FANOUT; i++) {
+			zm_State *c = zm_newTasklet(vm, zmChild, (void*)i);
+
+			zm_groupAdd(vm, g, c);
+			zm_resume(vm, c, NULL);
+		}
+
+		zmyield zmJOIN(g) | 1;
+	}
+
+	ZMEND
+}
+
+
+static void benchFanoutZM(size_t n)
+{
+	zm_VM *vm = zm_newVM("compare");
+	zm_Group *g = zm_newGroup(NULL);
+	uint64_t t;
+
+	rounds = n;
+	zm_resume(vm, zm_newTasklet(vm, zmParent, g), NULL);
+
+	t = now();
+
+	while (zm_go(vm, 1000, NULL))
+		;
+
+	result("fanout", "zm", n * FANOUT, now() - t);
+
+	zm_freeGroup(vm, g);
+	zm_freeVM(vm);
+}
+
+
+static size_t pending;
+static Coro *ucparent;
+
+static void ucChild(void *arg)
+{
+	work((size_t)arg);
+
+	if (!--pending)
+		coPush(&ready, ucparent);
+}
+
+
+static void ucParent(void *arg)
+{
+	size_t i;
+
+	(void)arg;
+
+	while (rounds) {
+		rounds--;
+		pending = FANOUT;
+
+		for (i = 0; i < FANOUT; i++)
+			coSpawn(ucChild, (void*)i);
+
+		coSuspend();
+	}
+}
+
+
+static void benchFanoutUC(size_t n)
+{
+	uint64_t t;
+
+	rounds = n;
+	ucparent = coSpawn(ucParent, NULL);
+
+	t = now();
+	coRun();
+
+	result("fanout", "ucontext", n * FANOUT, now() - t);
+}
+
+
+static void* thChild(void *arg)
+{
+	work((size_t)arg);
+	return NULL;
+}
+
+
+static void benchFanoutTH(size_t n)
+{
+	pthread_t *th = malloc(sizeof(pthread_t) * FANOUT);
+	uint64_t t = now();
+	size_t r, i;
+
+	for (r = 0; r < n; r++) {
+		for (i = 0; i < FANOUT; i++)
+			th[i] = thSpawn(thChild, (void*)i);
+
+		for (i = 0; i < FANOUT; i++)
+			pthread_join(th[i], NULL);
+	}
+
+	result("fanout", "pthread", n * FANOUT, now() - t);
+
+	free(th);
+}
+
+
+static void benchFanout()
+{
+	size_t n = scaled(1000);
+
+	benchFanoutZM(n);
+	benchFanoutUC(n);
+	benchFanoutTH(n / 10 + 1);
+}
+
+
+
+/* ---- generator: a consumer iterate n values of a generator ---- */
+
+static size_t genvalue;
+static unsigned long gensum;
+
+/* zm: the generator is a subtask that return each value to its caller */
+ZMTASKDEF( zmGenerator )
+{
+	size_t *i = zmdata;
+
+	ZMSTART
+
+	zmstate 1:
+		genvalue = (*i)++;
+		zmyield zmCALLER | 1;
+
+	ZMEND
+}
+
+
+typedef struct {
+	zm_State *gen;
+	size_t i;
+	size_t n;
+} Iterator;
+
+
+ZMTASKDEF( zmIterate )
+{
+	Iterator *self = zmdata;
+
+	ZMSTART
+
+	zmstate 1:
+		self->gen = zmNewSubTask(zmGenerator, &self->i);
+
+	zmstate 2:
+		if (!self->n)
+			zmyield zmTERM;
+
+		self->n--;
+		zmyield zmSUB(self->gen, NULL) | 3;
+
+	zmstate 3:
+		gensum += genvalue;
+		zmyield 2;
+
+	zmstate ZM_TERM:
+		if (self->gen)
+			zm_freeSubTask(vm, self->gen);
+
+	ZMEND
+}
+
+
+static void benchGeneratorZM(size_t n)
+{
+	zm_VM *vm = zm_newVM("compare");
+	Iterator self;
+	uint64_t t;
+
+	self.gen = NULL;
+	self.i = 0;
+	self.n = n;
+	gensum = 0;
+
+	zm_resume(vm, zm_newTasklet(vm, zmIterate, &self), NULL);
+
+	t = now();
+
+	while (zm_go(vm, 1000, NULL))
+		;
+
+	result("generator", "zm", n, now() - t);
+
+	zm_freeVM(vm);
+}
+
+
+/* ucontext: asymmetric switch (the generator switch back to its caller) */
+static ucontext_t ucgen, uccaller;
+
+static void ucGenerator()
+{
+	size_t i = 0;
+
+	for (;;) {
+		genvalue = i++;
+		swapcontext(&ucgen, &uccaller);
+	}
+}
+
+
+static void benchGeneratorUC(size_t n)
+{
+	char *stack = malloc(STACK_SIZE);
+	uint64_t t;
+	size_t i;
+
+	gensum = 0;
+
+	getcontext(&ucgen);
+	ucgen.uc_stack.ss_sp = stack;
+	ucgen.uc_stack.ss_size = STACK_SIZE;
+	ucgen.uc_link = NULL;
+	makecontext(&ucgen, ucGenerator, 0);
+
+	t = now();
+
+	for (i = 0; i < n; i++) {
+		swapcontext(&uccaller, &ucgen);
+		gensum += genvalue;
+	}
+
+	result("generator", "ucontext", n, now() - t);
+
+	free(stack);
+}
+
+
+/* pthreads: one-slot handoff */
+static int genfull, genstop;
+static pthread_cond_t gencond = PTHREAD_COND_INITIALIZER;
+
+static void* thGenerator(void *arg)
+{
+	size_t i = 0;
+
+	(void)arg;
+
+	pthread_mutex_lock(&lock);
+
+	for (;;) {
+		while ((genfull) && (!genstop))
+			pthread_cond_wait(&gencond, &lock);
+
+		if (genstop)
+			break;
+
+		genvalue = i++;
+		genfull = 1;
+		pthread_cond_signal(&gencond);
+	}
+
+	pthread_mutex_unlock(&lock);
+	return NULL;
+}
+
+
+static void benchGeneratorTH(size_t n)
+{
+	pthread_t th;
+	uint64_t t;
+	size_t i;
+
+	gensum = 0;
+	genfull = genstop = 0;
+	th = thSpawn(thGenerator, NULL);
+
+	t = now();
+	pthread_mutex_lock(&lock);
+
+	for (i = 0; i < n; i++) {
+		while (!genfull)
+			pthread_cond_wait(&gencond, &lock);
+
+		gensum += genvalue;
+		genfull = 0;
+		pthread_cond_signal(&gencond);
+	}
+
+	genstop = 1;
+	pthread_cond_signal(&gencond);
+	pthread_mutex_unlock(&lock);
+	pthread_join(th, NULL);
+
+	result("generator", "pthread", n, now() - t);
+}
+
+
+static void benchGenerator()
+{
+	size_t n = scaled(2000000);
+
+	benchGeneratorZM(n);
+	benchGeneratorUC(n);
+	benchGeneratorTH(n / 20 + 1);
+}
+
+
+
+/* ---- prodcons: NPROD producers and NCONS consumers, bounded queue ---- */
+
+/* producers fill the queue until it's full, consumers empty it */
+static struct {
+	size_t items[QSIZE];
+	size_t head;
+	size_t used;
+	size_t produced;   /* items left to produce */
+	size_t consumed;   /* items left to consume */
+} queue;
+
+
+static void queueInit(size_t n)
+{
+	queue.head = queue.used = 0;
+	queue.produced = queue.consumed = n;
+}
+
+
+/* push until the queue is full (return the number of pushed items) */
+static size_t queueFill()
+{
+	size_t n = 0;
+
+	while ((queue.used < QSIZE) && (queue.produced)) {
+		queue.items[(queue.head + queue.used++) % QSIZE] =
+			queue.produced--;
+		n++;
+	}
+
+	return n;
+}
+
+
+/* pop until the queue is empty (return the number of popped items) */
+static size_t queueDrain()
+{
+	size_t n = 0;
+
+	while (queue.used) {
+		work(queue.items[queue.head]);
+		queue.head = (queue.head + 1) % QSIZE;
+		queue.used--;
+		queue.consumed--;
+		n++;
+	}
+
+	return n;
+}
+
+
+static zm_Event *notfull, *notempty;
+
+ZMTASKDEF( zmProducer )
+{
+	ZMSTART
+
+	zmstate 1:
+		if (queueFill())
+			zm_trigger(vm, notempty, NULL);
+
+		if (!queue.produced)
+			zmyield zmTERM;
+
+		zmyield zmEVENT(notfull) | 1;
+
+	ZMEND
+}
+
+
+ZMTASKDEF( zmConsumer )
+{
+	ZMSTART
+
+	zmstate 1:
+		if (queueDrain())
+			zm_trigger(vm, notfull, NULL);
+
+		if (!queue.consumed) {
+			/* wake the other consumers */
+			zm_trigger(vm, notempty, NULL);
+			zmyield zmTERM;
+		}
+
+		zmyield zmEVENT(notempty) | 1;
+
+	ZMEND
+}
+
+
+static void benchProdConsZM(size_t n)
+{
+	zm_VM *vm = zm_newVM("compare");
+	uint64_t t;
+	int i;
+
+	queueInit(n);
+	notfull = zm_newEvent(NULL);
+	notempty = zm_newEvent(NULL);
+
+	t = now();
+
+	for (i = 0; i < NCONS; i++)
+		zm_resume(vm, zm_newTasklet(vm, zmConsumer, NULL), NULL);
+
+	for (i = 0; i < NPROD; i++)
+		zm_resume(vm, zm_newTasklet(vm, zmProducer, NULL), NULL);
+
+	while (zm_go(vm, 1000, NULL))
+		;
+
+	result("prodcons", "zm", n, now() - t);
+
+	zm_freeEvent(vm, notfull);
+	zm_freeEvent(vm, notempty);
+	zm_freeVM(vm);
+}
+
+
+static CoroList ucnotfull, ucnotempty;
+
+static void ucProducer(void *arg)
+{
+	(void)arg;
+
+	for (;;) {
+		if (queueFill())
+			coWakeAll(&ucnotempty);
+
+		if (!queue.produced)
+			return;
+
+		coWait(&ucnotfull);
+	}
+}
+
+
+static void ucConsumer(void *arg)
+{
+	(void)arg;
+
+	for (;;) {
+		if (queueDrain())
+			coWakeAll(&ucnotfull);
+
+		if (!queue.consumed) {
+			coWakeAll(&ucnotempty);
+			return;
+		}
+
+		coWait(&ucnotempty);
+	}
+}
+
+
+static void benchProdConsUC(size_t n)
+{
+	uint64_t t;
+	int i;
+
+	queueInit(n);
+
+	t = now();
+
+	for (i = 0; i < NCONS; i++)
+		coSpawn(ucConsumer, NULL);
+
+	for (i = 0; i < NPROD; i++)
+		coSpawn(ucProducer, NULL);
+
+	coRun();
+
+	result("prodcons", "ucontext", n, now() - t);
+}
+
+
+static pthread_cond_t thnotfull = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t thnotempty = PTHREAD_COND_INITIALIZER;
+
+static void* thProducer(void *arg)
+{
+	(void)arg;
+
+	pthread_mutex_lock(&lock);
+
+	for (;;) {
+		if (queueFill())
+			pthread_cond_broadcast(&thnotempty);
+
+		if (!queue.produced)
+			break;
+
+		pthread_cond_wait(&thnotfull, &lock);
+	}
+
+	pthread_mutex_unlock(&lock);
+	return NULL;
+}
+
+
+static void* thConsumer(void *arg)
+{
+	(void)arg;
+
+	pthread_mutex_lock(&lock);
+
+	for (;;) {
+		if (queueDrain())
+			pthread_cond_broadcast(&thnotfull);
+
+		if (!queue.consumed) {
+			pthread_cond_broadcast(&thnotempty);
+			break;
+		}
+
+		pthread_cond_wait(&thnotempty, &lock);
+	}
+
+	pthread_mutex_unlock(&lock);
+	return NULL;
+}
+
+
+static void benchProdConsTH(size_t n)
+{
+	pthread_t th[NPROD + NCONS];
+	uint64_t t;
+	int i;
+
+	queueInit(n);
+
+	t = now();
+
+	for (i = 0; i < NCONS; i++)
+		th[i] = thSpawn(thConsumer, NULL);
+
+	for (i = 0; i < NPROD; i++)
+		th[NCONS + i] = thSpawn(thProducer, NULL);
+
+	for (i = 0; i < NPROD + NCONS; i++)
+		pthread_join(th[i], NULL);
+
+	result("prodcons", "pthread", n, now() - t);
+}
+
+
+static void benchProdCons()
+{
+	size_t n = scaled(5000000);
+
+	benchProdConsZM(n);
+	benchProdConsUC(n);
+	benchProdConsTH(n / 5 + 1);
+}
+
+
+
+/* ---- scale: n idle units waiting a go signal ---- */
+
+static zm_Event *go;
+
+ZMTASKDEF( zmIdle )
+{
+	ZMSTART
+
+	zmstate 1:
+		zmyield zmEVENT(go) | 2;
+
+	zmstate 2:
+		zmyield zmTERM;
+
+	ZMEND
+}
+
+
+static void scaleZM(size_t n)
+{
+	zm_VM *vm = zm_newVM("compare");
+	size_t before = rss(), after, i;
+	uint64_t spawn, wake;
+
+	go = zm_newEvent(NULL);
+
+	spawn = now();
+
+	for (i = 0; i < n; i++)
+		zm_resume(vm, zm_newTasklet(vm, zmIdle, NULL), NULL);
+
+	while (zm_go(vm, 1000, NULL))
+		;
+
+	spawn = now() - spawn;
+	after = rss();
+
+	wake = now();
+	zm_trigger(vm, go, NULL);
+
+	while (zm_go(vm, 1000, NULL))
+		;
+
+	wake = now() - wake;
+
+	resultScale("zm", n, spawn, wake, before, after);
+
+	zm_freeEvent(vm, go);
+	zm_freeVM(vm);
+}
+
+
+static CoroList ucgo;
+
+static void ucIdle(void *arg)
+{
+	(void)arg;
+	coWait(&ucgo);
+}
+
+
+static void scaleUC(size_t n)
+{
+	size_t before = rss(), after, i;
+	uint64_t spawn, wake;
+
+	spawn = now();
+
+	for (i = 0; i < n; i++)
+		coSpawn(ucIdle, NULL);
+
+	coRun();
+
+	spawn = now() - spawn;
+	after = rss();
+
+	wake = now();
+	coWakeAll(&ucgo);
+	coRun();
+	wake = now() - wake;
+
+	/* the stacks are reused: free them to measure the next run */
+	coFreeStacks();
+
+	resultScale("ucontext", n, spawn, wake, before, after);
+}
+
+
+static int thgo;
+static size_t thwaiting;
+static pthread_cond_t gocond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t idlecond = PTHREAD_COND_INITIALIZER;
+
+static void* thIdle(void *arg)
+{
+	(void)arg;
+
+	pthread_mutex_lock(&lock);
+
+	if (++thwaiting == (size_t)arg)
+		pthread_cond_signal(&idlecond);
+
+	while (!thgo)
+		pthread_cond_wait(&gocond, &lock);
+
+	pthread_mutex_unlock(&lock);
+	return NULL;
+}
+
+
+static void scaleTH(size_t n)
+{
+	pthread_t *th = malloc(sizeof(pthread_t) * n);
+	size_t before = rss(), after, i;
+	uint64_t spawn, wake;
+
+	thgo = 0;
+	thwaiting = 0;
+
+	spawn = now();
+
+	for (i = 0; i < n; i++)
+		th[i] = thSpawn(thIdle, (void*)n);
+
+	/* wait until all the threads are blocked */
+	pthread_mutex_lock(&lock);
+
+	while (thwaiting < n)
+		pthread_cond_wait(&idlecond, &lock);
+
+	pthread_mutex_unlock(&lock);
+
+	spawn = now() - spawn;
+	after = rss();
+
+	wake = now();
+	pthread_mutex_lock(&lock);
+	thgo = 1;
+	pthread_cond_broadcast(&gocond);
+	pthread_mutex_unlock(&lock);
+
+	for (i = 0; i < n; i++)
+		pthread_join(th[i], NULL);
+
+	wake = now() - wake;
+
+	resultScale("pthread", n, spawn, wake, before, after);
+
+	free(th);
+}
+
+
+static void benchScale()
+{
+	size_t n;
+
+	for (n = 1000; n <= 1000000; n *= 10) {
+		scaleZM(n);
+
+		if (n <= maxuc)
+			scaleUC(n);
+		else
+			resultScale("ucontext", n, 0, 0, 0, 0);
+
+		if (n <= maxth)
+			scaleTH(n);
+		else
+			resultScale("pthread", n, 0, 0, 0, 0);
+	}
+}
+
+
+
+/* ---- main ---- */
+
+typedef struct {
+	const char *name;
+	void (*fn)();
+} Bench;
+
+
+static Bench benchs[] = {
+	{"pingpong", benchPingPong},
+	{"fanout", benchFanout},
+	{"generator", benchGenerator},
+	{"prodcons", benchProdCons},
+	{"scale", benchScale},
+	{NULL, NULL}
+};
+
+
+static int selected(int argc, char **argv, int first, const char *name)
+{
+	int i;
+
+	if (first >= argc)
+		return 1;
+
+	for (i = first; i < argc; i++)
+		if (strcmp(argv[i], name) == 0)
+			return 1;
+
+	return 0;
+}
+
+
+int main(int argc, char **argv)
+{
+	int first = 1;
+	Bench *b;
+
+	while ((first + 1 < argc) && (argv[first][0] == '-')) {
+		if (strcmp(argv[first], "-s") == 0)
+			scale = atof(argv[first + 1]);
+		else if (strcmp(argv[first], "-u") == 0)
+			maxuc = (size_t)atol(argv[first + 1]);
+		else if (strcmp(argv[first], "-p") == 0)
+			maxth = (size_t)atol(argv[first + 1]);
+
+		first += 2;
+	}
+
+	printf("{\n  \"zm\": \"%s\",\n  \"scale\": %g,\n  \"stack_size\": %d,\n"
+	       "  \"benchmarks\": [\n", ZM_VERSION, scale, STACK_SIZE);
+
+	for (b = benchs; b->name; b++)
+		if (selected(argc, argv, first, b->name))
+			b->fn();
+
+	printf("\n  ]\n}\n");
+
+	return 0;
+}
@@ -0,0 +1,281 @@
+/*
+ * ZM footprint and churn soak.
+ *
+ * Usage: soak.bin [-n tasks] [-t seconds] [-c churn] [-e events]
+ *
+ * Hold `tasks` ptasks (default 1000000) waiting on `events` events
+ * (default 1000). Every second `churn` percent of the tasks (default 5) are
+ * closed and replaced and every event is triggered once. Print as JSON the
+ * footprint of an idle task and, for each second, the RSS, the zm
+ * allocations per operation and the resume to step latency percentiles.
+ *
+ * Compile with -DZM_ENABLE_MEMSTATS -DZM_ENABLE_LATENCY (see Makefile).
+ */
+
+#ifndef _POSIX_C_SOURCE
+	#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+	#include <unistd.h>
+#endif
+
+#include <zm.h>
+
+
+/* slices per second (churn and triggers are spread in the second) */
+#define NSLICE 10
+
+typedef struct {
+	size_t id;
+	unsigned long hits;
+	char payload[16];
+} Session;
+
+
+static zm_Event **events;
+static size_t nevent = 1000;
+static unsigned long steps;
+
+
+ZMTASKDEF( session )
+{
+	Session *self = zmdata;
+
+	ZMSTART
+
+	zmstate 1:
+		zmyield zmEVENT(events[self->id % nevent]) | 2;
+
+	zmstate 2:
+		self->hits++;
+		steps++;
+		zmyield 1;
+
+	zmstate ZM_TERM:
+		free(self);
+
+	ZMEND
+}
+
+
+static uint64_t now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+
+static void sleepUntil(uint64_t t)
+{
+	uint64_t n = now();
+	struct timespec ts;
+
+	if (n >= t)
+		return;
+
+	ts.tv_sec = (time_t)((t - n) / 1000000000);
+	ts.tv_nsec = (long)((t - n) % 1000000000);
+	nanosleep(&ts, NULL);
+}
+
+
+/* resident memory in bytes (0 if not available) */
+static size_t rss()
+{
+	#ifdef __linux__
+	FILE *f = fopen("/proc/self/statm", "r");
+	unsigned long size, resident = 0;
+
+	if (!f)
+		return 0;
+
+	if (fscanf(f, "%lu %lu", &size, &resident) != 2)
+		resident = 0;
+
+	fclose(f);
+
+	return (size_t)resident * (size_t)sysconf(_SC_PAGESIZE);
+	#else
+	return 0;
+	#endif
+}
+
+
+static void run(zm_VM *vm)
+{
+	while (zm_go(vm, 1000, NULL))
+		;
+}
+
+
+static zm_State* spawn(zm_VM *vm, size_t id)
+{
+	Session *self = malloc(sizeof(Session));
+	zm_State *s;
+
+	self->id = id;
+	self->hits = 0;
+
+	s = zm_newTasklet(vm, session, self);
+	zm_resume(vm, s, NULL);
+
+	return s;
+}
+
+
+static double perOp(uint64_t n, uint64_t ops)
+{
+	return (ops) ? (double)n / ops : 0;
+}
+
+
+int main(int argc, char **argv)
+{
+	size_t ntask = 1000000, nsec = 10, i, j, cursor = 0;
+	double churn = 5;
+	zm_State **tasks;
+	zm_VM *vm;
+	zm_MemStats m0, m1;
+	size_t rss0, rss1;
+	uint64_t t;
+
+	for (i = 1; i + 1 < (size_t)argc; i += 2) {
+		if (strcmp(argv[i], "-n") == 0)
+			ntask = (size_t)atol(argv[i + 1]);
+		else if (strcmp(argv[i], "-t") == 0)
+			nsec = (size_t)atol(argv[i + 1]);
+		else if (strcmp(argv[i], "-c") == 0)
+			churn = atof(argv[i + 1]);
+		else if (strcmp(argv[i], "-e") == 0)
+			nevent = (size_t)atol(argv[i + 1]);
+	}
+
+	if ((!ntask) || (!nevent)) {
+		fprintf(stderr, "soak: tasks and events must be > 0\n");
+		return 1;
+	}
+
+	vm = zm_newVM("soak");
+	tasks = malloc(sizeof(zm_State*) * ntask);
+	events = malloc(sizeof(zm_Event*) * nevent);
+
+	for (i = 0; i < nevent; i++)
+		events[i] = zm_newEvent(NULL);
+
+	/* footprint: all tasks waiting an event */
+	rss0 = rss();
+	zm_getMemStats(&m0);
+
+	for (i = 0; i < ntask; i++)
+		tasks[i] = spawn(vm, i);
+
+	run(vm);
+
+	rss1 = rss();
+	zm_getMemStats(&m1);
+
+	printf("{\n  \"zm\": \"%s\",\n  \"tasks\": %zu,\n  \"events\": %zu,\n"
+	       "  \"churn_pct_per_s\": %g,\n", ZM_VERSION, ntask, nevent,
+	       churn);
+	printf("  \"sizes\": {\"state\": %zu, \"event_binder\": %zu, "
+	       "\"user_data\": %zu},\n", sizeof(zm_State),
+	       sizeof(zm_EventBinder), sizeof(Session));
+	printf("  \"idle\": {\"zm_bytes_per_task\": %.1f, "
+	       "\"zm_allocs_per_task\": %.3f, \"rss_bytes_per_task\": %.1f},\n",
+	       perOp((uint64_t)(m1.bytes - m0.bytes), ntask),
+	       perOp(m1.allocs - m0.allocs, ntask),
+	       (rss1 > rss0) ? (double)(rss1 - rss0) / ntask : 0.0);
+	printf("  \"samples\": [\n");
+	fflush(stdout);
+
+	zm_resetLatency(vm);
+	t = now();
+
+	for (i = 0; i < nsec; i++) {
+		size_t nchurn = (size_t)(ntask * churn / 100 / NSLICE);
+		uint64_t churned = 0, s0 = steps;
+		uint64_t callocs = 0, salloc = 0;
+		const zm_Histogram *h;
+		size_t k;
+
+		if (nchurn > ntask)
+			nchurn = ntask;
+
+		for (j = 0; j < NSLICE; j++) {
+			/* churn: close the oldest tasks and spawn new ones */
+			zm_getMemStats(&m0);
+
+			for (k = 0; k < nchurn; k++)
+				zm_abort(vm, tasks[(cursor + k) % ntask]);
+
+			run(vm);
+
+			for (k = 0; k < nchurn; k++) {
+				size_t n = (cursor + k) % ntask;
+				tasks[n] = spawn(vm, n);
+			}
+
+			run(vm);
+
+			zm_getMemStats(&m1);
+			callocs += m1.allocs - m0.allocs;
+
+			cursor = (cursor + nchurn) % ntask;
+			churned += nchurn;
+
+			/* a slice of the events */
+			zm_getMemStats(&m0);
+
+			for (k = j * nevent / NSLICE;
+			     k < (j + 1) * nevent / NSLICE; k++)
+				zm_trigger(vm, events[k], NULL);
+
+			run(vm);
+
+			zm_getMemStats(&m1);
+			salloc += m1.allocs - m0.allocs;
+
+			sleepUntil(t + (i * NSLICE + j + 1) *
+			           (1000000000 / NSLICE));
+		}
+
+		h = zm_getLatency(vm, NULL);
+
+		printf("%s    {\"t\": %zu, \"rss\": %zu, \"churned\": %lu, "
+		       "\"steps\": %lu, \"allocs_per_churn\": %.3f, "
+		       "\"allocs_per_step\": %.3f, \"latency_ns\": {"
+		       "\"p50\": %lu, \"p99\": %lu, \"p999\": %lu, "
+		       "\"max\": %lu}}", (i) ? ",\n" : "", i + 1, rss(),
+		       (unsigned long)churned, steps - s0,
+		       perOp(callocs, churned), perOp(salloc, steps - s0),
+		       (unsigned long)zm_histogramPercentile(h, 50),
+		       (unsigned long)zm_histogramPercentile(h, 99),
+		       (unsigned long)zm_histogramPercentile(h, 99.9),
+		       (unsigned long)h->max);
+		fflush(stdout);
+
+		zm_resetLatency(vm);
+	}
+
+	printf("\n  ]\n}\n");
+
+	zm_closeVM(vm);
+	run(vm);
+
+	for (i = 0; i < nevent; i++)
+		zm_freeEvent(vm, events[i]);
+
+	zm_freeVM(vm);
+	free(events);
+	free(tasks);
+	return 0;
+}
@@ -0,0 +1,102 @@
+/* compile with -DZM_ENABLE_AIO (and -lpthread) */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <zm.h>
+
+#define NCOPY 4
+
+typedef struct {
+	int id;
+	int fd;
+	int64_t offset;
+	char buf[32];
+} Copy;
+
+
+ZMTASKDEF( copier )
+{
+	Copy *self = zmdata;
+
+	ZMSTART
+
+	zmstate 1:
+		snprintf(self->buf, sizeof(self->buf), "block %d", self->id);
+		printf("copier %d: write `%s`\n", self->id, self->buf);
+		zmyield zmWRITE(self->fd, self->buf, strlen(self->buf) + 1,
+		                self->offset) | 2;
+
+	zmstate 2: {
+		long r = zm_aioResult(zmarg);
+
+		if (r < 0) {
+			printf("copier %d: write error %s\n", self->id, strerror(-r));
+			zmyield zmTERM;
+		}
+
+		printf("copier %d: %ld bytes written\n", self->id, r);
+		memset(self->buf, 0, sizeof(self->buf));
+		zmyield zmREAD(self->fd, self->buf, sizeof(self->buf),
+		               self->offset) | 3;
+	}
+
+	zmstate 3:
+		printf("copier %d: %ld bytes read `%s`\n", self->id,
+		       zm_aioResult(zmarg), self->buf);
+		zmyield zmTERM;
+
+	ZMEND
+}
+
+
+static void run(zm_VM *vm)
+{
+	while (zm_go(vm, 100, NULL) | zm_poll(vm, 0) | zm_aioInflight(vm))
+		zm_poll(vm, 10);
+}
+
+
+static void test(int backend)
+{
+	zm_VM *vm = zm_newVM("aio VM");
+	char path[] = "/tmp/zmaioXXXXXX";
+	Copy copy[NCOPY];
+	int fd = mkstemp(path);
+	int i;
+
+	if (fd < 0) {
+		perror("mkstemp");
+		exit(1);
+	}
+
+	unlink(path);
+
+	/* ZM_AIO_AUTO (default) use io_uring when avaible */
+	backend = zm_aioInit(vm, backend);
+	printf("\n* backend: %s\n", (backend == ZM_AIO_URING) ? "io_uring" :
+	                                                       "threads");
+
+	for (i = 0; i < NCOPY; i++) {
+		copy[i].id = i;
+		copy[i].fd = fd;
+		copy[i].offset = i * sizeof(copy[i].buf);
+		zm_resume(vm, zm_newTasklet(vm, copier, &copy[i]), NULL);
+	}
+
+	run(vm);
+
+	close(fd);
+	zm_freeVM(vm);
+}
+
+
+int main()
+{
+	test(ZM_AIO_AUTO);
+	test(ZM_AIO_THREADS);
+	return 0;
+}
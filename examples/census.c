@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <zm.h>
+
+/* live task census (compile with -DZM_ENABLE_CENSUS): the counters are
+   updated at each status change so zm_census can be polled at any time */
+
+#define NCONN 1000
+#define NJOB 10
+
+zm_Event *data;
+
+
+ZMTASKDEF( conn )
+{
+	ZMSTART
+
+	zmstate 1:
+		zmyield zmEVENT(data) | 2;
+
+	zmstate 2:
+		zmyield zmTERM;
+
+	ZMEND
+}
+
+
+ZMTASKDEF( query )
+{
+	ZMSTART
+
+	zmstate 1:
+		zmyield zmEVENT(data) | 2;
+
+	zmstate 2:
+		zmyield zmTERM;
+
+	ZMEND
+}
+
+
+ZMTASKDEF( job )
+{
+	ZMSTART
+
+	zmstate 1:
+		zmyield zmSUB(zmNewSubTasklet(query, NULL), NULL) | 2 |
+		        zmCATCH(3);
+
+	zmstate 2:
+		zmyield zmTERM;
+
+	zmstate 3:
+		zmCatch();
+		zmyield zmTERM;
+
+	ZMEND
+}
+
+
+static void census(zm_VM *vm, const char *when)
+{
+	zm_CensusRow rows[4];
+	zm_Census c;
+	size_t i;
+
+	c.rows = rows;
+	c.maxrow = 4;
+	zm_census(vm, &c);
+
+	printf("%s: %zu tasks (running %zu, suspended %zu, waiting %zu, "
+	       "eventlocked %zu, catch %zu) depth 0: %zu, depth 1: %zu\n",
+	       when, c.tasks, c.status[ZM_CENSUS_RUNNING],
+	       c.status[ZM_CENSUS_SUSPENDED], c.status[ZM_CENSUS_WAITING],
+	       c.status[ZM_CENSUS_EVENTLOCKED], c.status[ZM_CENSUS_CATCH],
+	       c.depth[0], c.depth[1]);
+
+	for (i = 0; (i < c.nrow) && (i < c.maxrow); i++)
+		printf("    %-6s %zu\n", rows[i].machine->name, rows[i].tasks);
+}
+
+
+int main(int argc, char **argv)
+{
+	zm_VM *vm = zm_newVM("census VM");
+	int i;
+
+	data = zm_newEvent(NULL);
+
+	/* created but never resumed (suspended) */
+	zm_newTasklet(vm, conn, NULL);
+
+	for (i = 0; i < NCONN; i++)
+		zm_resume(vm, zm_newTasklet(vm, conn, NULL), NULL);
+
+	for (i = 0; i < NJOB; i++)
+		zm_resume(vm, zm_newTasklet(vm, job, NULL), NULL);
+
+	census(vm, "resumed");
+
+	while (zm_go(vm, 100, NULL))
+		;
+
+	census(vm, "waiting");
+
+	zm_trigger(vm, data, NULL);
+
+	while (zm_go(vm, 100, NULL))
+		;
+
+	census(vm, "done");
+
+	if (argc > 1)
+		zm_printCensus(NULL, vm);
+
+	zm_closeVM(vm);
+
+	while (zm_go(vm, 100, NULL))
+		;
+
+	census(vm, "closed");
+
+	zm_freeEvent(vm, data);
+	zm_freeVM(vm);
+	return 0;
+}
@@ -0,0 +1,125 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <zm.h>
+
+/* yield to a subtask with a deadline (zmSUB_DEADLINE) */
+
+/* a fake clock to run the example without wait */
+uint64_t fakenow = 0;
+
+uint64_t fakeClock(zm_VM *vm)
+{
+	return fakenow;
+}
+
+
+zm_Event *reply;
+
+
+ZMTASKDEF( request )
+{
+	const char *name = zmdata;
+
+	ZMSTART
+
+	zmstate 1:
+		printf("[%3d ms] %s: wait reply\n", (int)fakenow, name);
+		zmyield zmEVENT(reply) | 2;
+
+	zmstate 2:
+		printf("[%3d ms] %s: got reply\n", (int)fakenow, name);
+		zmresult = zmarg;
+		zmyield zmTERM;
+
+	zmstate ZM_TERM:
+		printf("[%3d ms] %s: -term-\n", (int)fakenow, name);
+	ZMEND
+}
+
+
+ZMTASKDEF( counter )
+{
+	static int n = 0;
+
+	ZMSTART
+
+	zmstate 1:
+		printf("[%3d ms] counter: %d\n", (int)fakenow, ++n);
+		zmyield 1 | zmCALLER;
+
+	ZMEND
+}
+
+
+ZMTASKDEF( handler )
+{
+	static zm_State *c;
+	static int i;
+
+	ZMSTART
+
+	zmstate 1: {
+		zm_State *s = zmNewSubTasklet(request, "fast request");
+		zmyield zmSUB_DEADLINE(s, NULL, 100) | 2 | zmCATCH(4);
+	}
+
+	zmstate 2: {
+		zm_State *s = zmNewSubTasklet(request, "slow request");
+		printf("[%3d ms] handler: result `%s`\n", (int)fakenow,
+		       (const char*)zmarg);
+		zmyield zmSUB_DEADLINE(s, NULL, 100) | 3 | zmCATCH(4);
+	}
+
+	zmstate 3:
+		printf("[%3d ms] handler: not reached\n", (int)fakenow);
+		zmyield zmTERM;
+
+	zmstate 4: {
+		zm_Exception *e = zmCatch();
+
+		if ((e) && (e->data == ZM_TIMEOUT))
+			printf("[%3d ms] handler: catch timeout (%s)\n",
+			       (int)fakenow, e->msg);
+
+		c = zmNewSubTasklet(counter, NULL);
+		i = 0;
+	}
+
+	zmstate 5:
+		/* zmCALLER resume in the zmNEXT point (as in zmSUB) */
+		if (i++ < 3)
+			zmyield zmSUB_DEADLINE(c, NULL, 100) | zmNEXT(5) | 6;
+
+		zmyield zmTERM;
+
+	zmstate 6:
+		printf("[%3d ms] handler: not reached\n", (int)fakenow);
+		zmyield zmTERM;
+
+	ZMEND
+}
+
+
+int main()
+{
+	zm_VM *vm = zm_newVM("deadline VM");
+
+	zm_setClock(vm, fakeClock);
+
+	reply = zm_newEvent(NULL);
+
+	zm_resume(vm, zm_newTasklet(vm, handler, NULL), NULL);
+	zm_go(vm, 100, NULL);
+
+	fakenow = 50;
+	zm_trigger(vm, reply, "hello");
+	zm_go(vm, 100, NULL);
+
+	fakenow = 200;
+	zm_go(vm, 100, NULL);
+
+	zm_freeEvent(vm, reply);
+	zm_freeVM(vm);
+
+	return 0;
+}
@@ -0,0 +1,79 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <zm.h>
+
+/* deferred constructor: ZM_INIT run at the first step of the task */
+
+#define NTASK 1000
+
+int ninit;
+int nterm;
+int nstep;
+
+
+ZMTASKDEF( request )
+{
+	ZMSTART
+
+	zmstate ZM_INIT:
+		/* expensive construction */
+		zmdata = malloc(1024);
+		ninit++;
+		zmyield zmDONE;
+
+	zmstate 1:
+		nstep++;
+		zmyield zmSUSPEND | 1;
+
+	zmstate ZM_TERM:
+		free(zmdata);
+		nterm++;
+
+	ZMEND
+}
+
+
+static void run(zm_VM *vm)
+{
+	int i;
+
+	ninit = nterm = nstep = 0;
+
+	/* dispatcher: spawn many requests but only half are served */
+	for (i = 0; i < NTASK; i++) {
+		zm_State *s = zm_newTasklet(vm, request, NULL);
+
+		if (i % 2)
+			zm_resume(vm, s, NULL);
+	}
+
+	printf("\tafter spawn: ZM_INIT = %d\n", ninit);
+
+	while (zm_go(vm, 100, NULL))
+		;
+
+	zm_closeVM(vm);
+
+	while (zm_go(vm, 100, NULL))
+		;
+
+	printf("\tstep = %d, ZM_INIT = %d, ZM_TERM = %d\n", nstep, ninit,
+	                                                        nterm);
+}
+
+
+int main()
+{
+	zm_VM *vm = zm_newVM("deferinit VM");
+
+	printf("constructor at creation:\n");
+	run(vm);
+
+	zm_setDeferInit(vm, true);
+
+	printf("deferred constructor:\n");
+	run(vm);
+
+	zm_freeVM(vm);
+	return 0;
+}
@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <zm.h>
+
+/* destroy vm: release no-term tasks in bulk */
+
+#define NJOB 10000
+
+zm_Event *wakeup;
+zm_Group *jobs;
+int nterm;
+
+
+/* waits the event (nothing to release in ZM_TERM) */
+ZMTASKDEF( step )
+{
+	ZMSTART
+
+	zmstate 1:
+		zmyield zmEVENT(wakeup) | 2;
+
+	zmstate 2:
+		zmyield zmTERM;
+
+	zmstate ZM_TERM:
+		nterm++;
+
+	ZMEND
+}
+
+
+ZMTASKDEF( job )
+{
+	ZMSTART
+
+	zmstate 1:
+		zmyield zmSUB(zmNewSubTasklet(step, NULL), NULL) | 2;
+
+	zmstate 2:
+		zmyield zmTERM;
+
+	zmstate ZM_TERM:
+		nterm++;
+
+	ZMEND
+}
+
+
+/* has an external resource: closed with ZM_TERM */
+ZMTASKDEF( logger )
+{
+	ZMSTART
+
+	zmstate 1:
+		zmyield 1;
+
+	zmstate ZM_TERM:
+		printf("\tlogger: flush\n");
+		nterm++;
+
+	ZMEND
+}
+
+
+static zm_VM* run()
+{
+	zm_VM *vm = zm_newVM("destroy VM");
+	int i;
+
+	for (i = 0; i < NJOB; i++) {
+		zm_State *s = zm_newTasklet(vm, job, NULL);
+
+		zm_groupAdd(vm, jobs, s);
+		zm_resume(vm, s, NULL);
+	}
+
+	zm_resume(vm, zm_newTasklet(vm, logger, NULL), NULL);
+
+	while (wakeup->count < NJOB)
+		zm_go(vm, 1, NULL);
+
+	nterm = 0;
+
+	printf("%d jobs (group alive = %zu, event binders = %d)\n",
+	       NJOB, zm_groupAlive(jobs), wakeup->count);
+
+	return vm;
+}
+
+
+int main()
+{
+	zm_VM *vm;
+
+	wakeup = zm_newEvent(NULL);
+	jobs = zm_newGroup(NULL);
+
+	printf("close:\n");
+	vm = run();
+
+	zm_closeVM(vm);
+	while (zm_go(vm, 100, NULL))
+		;
+
+	zm_freeVM(vm);
+
+	printf("\tZM_TERM = %d (group alive = %zu, event binders = %d)\n",
+	       nterm, zm_groupAlive(jobs), wakeup->count);
+
+	zm_setNoTerm(job, true);
+	zm_setNoTerm(step, true);
+
+	printf("destroy:\n");
+	vm = run();
+
+	zm_destroyVM(vm);
+
+	printf("\tZM_TERM = %d (group alive = %zu, event binders = %d)\n",
+	       nterm, zm_groupAlive(jobs), wakeup->count);
+
+	zm_freeGroup(NULL, jobs);
+	zm_freeEvent(NULL, wakeup);
+	return 0;
+}
@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <zm.h>
+
+/* exception pool: validation errors as control flow without malloc */
+
+#define NRECORD 12
+
+int records[NRECORD] = {3, 7, -1, 12, 0, 5, 99, -4, 8, 1, 100, 2};
+
+
+/* raise an abort for a value out of range */
+ZMTASKDEF( field )
+{
+	int *v = zmdata;
+
+	ZMSTART
+
+	zmstate 1:
+		if (*v < 0)
+			zmraise zmABORT(1, "negative", v);
+
+		if (*v > 50)
+			zmraise zmABORT(2, "too big", v);
+
+		zmyield zmTERM;
+
+	ZMEND
+}
+
+
+ZMTASKDEF( record )
+{
+	ZMSTART
+
+	zmstate 1:
+		zmyield zmSUB(zmNewSubTasklet(field, zmdata), NULL) | 2;
+
+	zmstate 2:
+		zmyield zmTERM;
+
+	ZMEND
+}
+
+
+ZMTASKDEF( pipeline )
+{
+	static int i;
+	static int valid;
+
+	ZMSTART
+
+	zmstate 1:
+		i = 0;
+		valid = 0;
+
+	zmstate 2:
+		if (i == NRECORD) {
+			printf("valid records: %d/%d\n", valid, NRECORD);
+			zmyield zmTERM;
+		}
+
+		zmyield zmSUB(zmNewSubTasklet(record, &records[i++]), NULL) |
+		        3 | zmCATCH(4);
+
+	zmstate 3:
+		valid++;
+		zmyield 2;
+
+	zmstate 4: {
+		zm_Exception *e = zmCatch();
+
+		if (e)
+			printf("\trecord %d: rejected (%d, %s)\n",
+			       *(int*)e->data, e->code, e->msg);
+
+		zmyield 2;
+	}
+
+	ZMEND
+}
+
+
+int main()
+{
+	zm_VM *vm = zm_newVM("errpool VM");
+
+	/* one exception in flight with a trace of 3 tasks (field, record,
+	   pipeline): no malloc for exceptions and traces */
+	zm_reserveExceptions(vm, 1, 3);
+
+	zm_resume(vm, zm_newTasklet(vm, pipeline, NULL), NULL);
+
+	while (zm_go(vm, 100, NULL))
+		;
+
+	zm_freeVM(vm);
+	return 0;
+}
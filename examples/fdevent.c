@@ -0,0 +1,178 @@
+/* compile with -DZM_ENABLE_EPOLL */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <zm.h>
+
+typedef struct {
+	const char *name;
+	int fd;
+	zm_Event *event;
+	int nread;
+} Reader;
+
+
+ZMTASKDEF( reader )
+{
+	Reader *self = zmdata;
+
+	ZMSTART
+
+	zmstate 1:
+		printf("%s: wait data on fd %d\n", self->name, self->fd);
+		zmyield zmWAITFD(self->event) | 2 | zmUNBIND(3);
+
+	zmstate 2: {
+		zm_FdEvent *fe = zmarg;
+		char buf[64];
+		ssize_t n;
+
+		if (fe->revents & EPOLLHUP) {
+			printf("%s: hang up\n", self->name);
+			zmyield zmTERM;
+		}
+
+		n = read(self->fd, buf, sizeof(buf) - 1);
+
+		if (n <= 0) {
+			printf("%s: end of stream\n", self->name);
+			zmyield zmTERM;
+		}
+
+		buf[n] = '\0';
+		self->nread++;
+		printf("%s: read `%s`\n", self->name, buf);
+		zmyield 1;
+	}
+
+	zmstate 3:
+		printf("%s: unbind\n", self->name);
+		zmyield zmTERM;
+
+	zmstate ZM_TERM:
+		printf("%s: -end- (%d read)\n", self->name, self->nread);
+
+	ZMEND
+}
+
+
+/* persistent bind: the fd is re-armed at each zmSUBSCRIBE */
+ZMTASKDEF( subscriber )
+{
+	Reader *self = zmdata;
+
+	ZMSTART
+
+	zmstate 1:
+		zmyield zmSUBSCRIBE(self->event) | 2 | zmUNBIND(3);
+
+	zmstate 2: {
+		char buf[64];
+		ssize_t n = read(self->fd, buf, sizeof(buf) - 1);
+
+		if (n <= 0) {
+			printf("%s: end of stream\n", self->name);
+			zmUNSUBSCRIBE();
+			zmyield zmTERM;
+		}
+
+		buf[n] = '\0';
+		self->nread++;
+		printf("%s: read `%s`\n", self->name, buf);
+		zmyield 1;
+	}
+
+	zmstate 3:
+		printf("%s: unbind\n", self->name);
+		zmyield zmTERM;
+
+	zmstate ZM_TERM:
+		printf("%s: -end- (%d read)\n", self->name, self->nread);
+
+	ZMEND
+}
+
+
+static void run(zm_VM *vm)
+{
+	while (zm_go(vm, 100, NULL) | zm_poll(vm, 0))
+		;
+}
+
+
+int main()
+{
+	zm_VM *vm = zm_newVM("fd VM");
+	int p[2], sp[2], q[2];
+	Reader rp = {"pipe", 0, NULL, 0};
+	Reader rs = {"socket", 0, NULL, 0};
+	Reader rq = {"subscriber", 0, NULL, 0};
+	zm_State *s1, *s2;
+
+	if ((pipe(p) < 0) || (socketpair(AF_UNIX, SOCK_STREAM, 0, sp) < 0) ||
+	    (pipe(q) < 0)) {
+		perror("pipe/socketpair");
+		return 1;
+	}
+
+	rp.fd = p[0];
+	rp.event = zm_newFdEvent(vm, p[0], EPOLLIN);
+
+	rs.fd = sp[0];
+	rs.event = zm_newFdEvent(vm, sp[0], EPOLLIN);
+
+	rq.fd = q[0];
+	rq.event = zm_newFdEvent(vm, q[0], EPOLLIN);
+
+	s1 = zm_newTasklet(vm, reader, &rp);
+	s2 = zm_newTasklet(vm, reader, &rs);
+	zm_resume(vm, s1, NULL);
+	zm_resume(vm, s2, NULL);
+	zm_resume(vm, zm_newTasklet(vm, subscriber, &rq), NULL);
+
+	run(vm);
+
+	printf("\n* write on pipe\n");
+	write(p[1], "hello", 5);
+	run(vm);
+
+	printf("\n* write on socket\n");
+	write(sp[1], "world", 5);
+	run(vm);
+
+	printf("\n* write on both\n");
+	write(p[1], "foo", 3);
+	write(sp[1], "bar", 3);
+	run(vm);
+
+	printf("\n* write to subscriber (twice)\n");
+	write(q[1], "one", 3);
+	run(vm);
+	write(q[1], "two", 3);
+	run(vm);
+
+	printf("\n* close pipe writers\n");
+	close(p[1]);
+	close(q[1]);
+	run(vm);
+
+	printf("\n* unbind socket reader\n");
+	zm_unbind(vm, rs.event, s2, NULL);
+	run(vm);
+
+	zm_freeFdEvent(vm, rp.event);
+	zm_freeFdEvent(vm, rs.event);
+	zm_freeFdEvent(vm, rq.event);
+	close(p[0]);
+	close(q[0]);
+	close(sp[0]);
+	close(sp[1]);
+
+	zm_freeVM(vm);
+
+	return 0;
+}
@@ -0,0 +1,88 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <zm.h>
+
+/* future: share one expensive result among many tasks */
+
+zm_Future *config;
+
+
+ZMTASKDEF( loader )
+{
+	static int n = 3;
+
+	ZMSTART
+
+	zmstate 1:
+		if (n-- > 0) {
+			printf("\tloader: loading...\n");
+			zmyield 1;
+		}
+
+		printf("\tloader: complete (%zu waiting)\n",
+		       zm_complete(vm, config, "config-v1"));
+		zmyield zmTERM;
+
+	ZMEND
+}
+
+
+ZMTASKDEF( owner )
+{
+	ZMSTART
+
+	zmstate 1:
+		printf("* owner: start loader\n");
+		zmyield zmSUB(zmNewSubTasklet(loader, NULL), NULL) | 2;
+
+	zmstate 2:
+		printf("* owner: loader returned\n");
+		zmyield zmTERM;
+
+	ZMEND
+}
+
+
+ZMTASKDEF( reader )
+{
+	const char *name = zmdata;
+
+	ZMSTART
+
+	zmstate 1:
+		printf("* %s: await (complete = %d)\n", name,
+		       zm_isComplete(config));
+		zmyield zmAWAIT(config) | 2;
+
+	zmstate 2:
+		printf("* %s: got %s\n", name, (char*)zmarg);
+		zmyield zmTERM;
+
+	ZMEND
+}
+
+
+int main()
+{
+	zm_VM *vm = zm_newVM("future VM");
+
+	config = zm_newFuture(NULL);
+
+	zm_resume(vm, zm_newTasklet(vm, reader, "reader1"), NULL);
+	zm_resume(vm, zm_newTasklet(vm, reader, "reader2"), NULL);
+	zm_resume(vm, zm_newTasklet(vm, owner, NULL), NULL);
+	zm_resume(vm, zm_newTasklet(vm, reader, "reader3"), NULL);
+
+	while (zm_go(vm, 100, NULL))
+		;
+
+	printf("\nlate reader (future just completed):\n");
+	zm_resume(vm, zm_newTasklet(vm, reader, "reader4"), NULL);
+
+	while (zm_go(vm, 100, NULL))
+		;
+
+	zm_freeFuture(vm, config);
+	zm_freeVM(vm);
+	return 0;
+}
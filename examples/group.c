@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <zm.h>
+
+/* task group: spawn, count, join and cancel ptasks together */
+
+zm_Event *never;
+
+int nsteps[] = {1, 3, 2, -1, -1};
+
+
+static void spawn(zm_VM *vm, zm_Group *g, zm_Machine *m, int *data)
+{
+	zm_State *s = zm_newTasklet(vm, m, data);
+
+	zm_groupAdd(vm, g, s);
+	zm_resume(vm, s, NULL);
+}
+
+
+ZMTASKDEF( worker )
+{
+	int *n = zmdata;
+
+	ZMSTART
+
+	zmstate 1:
+		if (*n < 0) {
+			printf("\tworker %d: wait forever\n", (int)(n - nsteps));
+			zmyield zmEVENT(never) | 1;
+		}
+
+		if ((*n)-- > 0) {
+			zmyield 1;
+		}
+
+		zmyield zmTERM;
+
+	zmstate ZM_TERM:
+		printf("\tworker %d: -term-\n", (int)(n - nsteps));
+	ZMEND
+}
+
+
+ZMTASKDEF( supervisor )
+{
+	zm_Group *g = zmdata;
+
+	ZMSTART
+
+	zmstate 1: {
+		int i;
+
+		for (i = 0; i < 3; i++)
+			spawn(vm, g, worker, &nsteps[i]);
+
+		printf("* supervisor: wait %zu workers\n", zm_groupAlive(g));
+		zmyield zmJOIN(g) | 2;
+	}
+
+	zmstate 2: {
+		int i;
+
+		printf("* supervisor: all done (alive = %zu)\n\n",
+		       zm_groupAlive(g));
+
+		for (i = 3; i < 5; i++)
+			spawn(vm, g, worker, &nsteps[i]);
+
+		zmyield 3;
+	}
+
+	zmstate 3:
+		printf("* supervisor: cancel %zu workers\n", zm_groupCancel(vm, g));
+		zmyield zmJOIN(g) | 4;
+
+	zmstate 4:
+		printf("* supervisor: all closed (alive = %zu)\n",
+		       zm_groupAlive(g));
+		zmyield zmTERM;
+
+	ZMEND
+}
+
+
+int main()
+{
+	zm_VM *vm = zm_newVM("group VM");
+	zm_Group *g = zm_newGroup(NULL);
+
+	never = zm_newEvent(NULL);
+
+	zm_resume(vm, zm_newTasklet(vm, supervisor, g), NULL);
+
+	while (zm_go(vm, 100, NULL))
+		;
+
+	zm_freeGroup(vm, g);
+	zm_freeEvent(vm, never);
+	zm_freeVM(vm);
+	return 0;
+}
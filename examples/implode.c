@@ -0,0 +1,131 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <zm.h>
+
+/* incremental implosion: close a big task tree in slices */
+
+#define NGROUP 10
+#define NLEAF 1000
+
+int ticks;
+int closing;
+int nclosed;
+int firstterm; /* ticker steps before the first ZM_TERM */
+int ordered;
+
+
+ZMTASKDEF( ticker )
+{
+	ZMSTART
+
+	zmstate 1:
+		ticks++;
+		zmyield 1;
+
+	ZMEND
+}
+
+
+ZMTASKDEF( leaf )
+{
+	ZMSTART
+
+	zmstate 1:
+		zmyield zmTERM;
+
+	zmstate ZM_TERM:
+		if (nclosed++ == 0)
+			firstterm = ticks;
+
+	ZMEND
+}
+
+
+ZMTASKDEF( group )
+{
+	ZMSTART
+
+	zmstate 1: {
+		int i;
+
+		for (i = 0; i < NLEAF; i++)
+			zmNewSubTasklet(leaf, NULL);
+
+		zmyield 2 | zmCALLER;
+	}
+
+	zmstate 2:
+		zmyield zmTERM;
+
+	zmstate ZM_TERM:
+		/* a group is closed after all the leaves */
+		if (nclosed++ < NGROUP * NLEAF)
+			ordered = false;
+
+	ZMEND
+}
+
+
+ZMTASKDEF( root )
+{
+	static int g;
+
+	ZMSTART
+
+	zmstate 1:
+		g = 0;
+
+	zmstate 2:
+		if (g++ < NGROUP)
+			zmyield zmSUB(zmNewSubTasklet(group, NULL), NULL) | 2;
+
+		ticks = 0;
+		closing = true;
+		zmyield zmTERM;
+
+	zmstate ZM_TERM:
+		if (nclosed++ != NGROUP * (NLEAF + 1))
+			ordered = false;
+
+		closing = false;
+
+	ZMEND
+}
+
+
+static void run(zm_VM *vm, size_t slice)
+{
+	zm_setImplodeSlice(vm, slice);
+
+	nclosed = 0;
+	ordered = true;
+	closing = false;
+
+	zm_resume(vm, zm_newTasklet(vm, ticker, NULL), NULL);
+	zm_resume(vm, zm_newTasklet(vm, root, NULL), NULL);
+
+	do {
+		zm_go(vm, 1, NULL);
+	} while ((closing) || (nclosed == 0));
+
+	printf("slice %4zu: closed %d tasks (%s), ticker steps before "
+	       "the first ZM_TERM: %d\n", slice, nclosed,
+	       (ordered) ? "ordered" : "NOT ordered", firstterm);
+
+	zm_closeVM(vm);
+
+	while (zm_go(vm, 100, NULL))
+		;
+}
+
+
+int main()
+{
+	zm_VM *vm = zm_newVM("implode VM");
+
+	run(vm, 0);
+	run(vm, 256);
+
+	zm_freeVM(vm);
+	return 0;
+}
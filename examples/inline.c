@@ -0,0 +1,100 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <zm.h>
+
+/* inline subtask: run a call/return chain in the same zm_go cycle */
+
+int ticks;
+int done;
+
+
+ZMTASKDEF( ticker )
+{
+	ZMSTART
+
+	zmstate 1:
+		ticks++;
+		zmyield 1;
+
+	ZMEND
+}
+
+
+/* sum 1..n with a recursive call chain of n subtasks */
+ZMTASKDEF( sum )
+{
+	int *n = zmdata;
+
+	ZMSTART
+
+	zmstate 1:
+		if (*n == 0) {
+			zmresult = NULL;
+			zmyield zmTERM;
+		}
+
+		zmyield zmSUB(zmNewSubTasklet(sum, n - 1), NULL) | 2;
+
+	zmstate 2:
+		zmresult = (void*)((intptr_t)zmarg + *n);
+		zmyield zmTERM;
+
+	ZMEND
+}
+
+
+ZMTASKDEF( client )
+{
+	static int n[] = {0, 1, 2, 3, 4, 5, 6, 7, 8};
+
+	ZMSTART
+
+	zmstate 1:
+		ticks = 0;
+		zmyield zmSUB(zmNewSubTasklet(sum, &n[8]), NULL) | 2;
+
+	zmstate 2:
+		printf("sum(8) = %d after %d ticker steps\n",
+		       (int)(intptr_t)zmarg, ticks);
+		done = true;
+		zmyield zmTERM;
+
+	ZMEND
+}
+
+
+static void run(zm_VM *vm)
+{
+	int i;
+
+	for (i = 0; i < 4; i++)
+		zm_resume(vm, zm_newTasklet(vm, ticker, NULL), NULL);
+
+	zm_resume(vm, zm_newTasklet(vm, client, NULL), NULL);
+
+	done = false;
+
+	while (!done)
+		zm_go(vm, 1, NULL);
+
+	/* close tickers */
+	zm_closeVM(vm);
+	zm_go(vm, 1000, NULL);
+}
+
+
+int main()
+{
+	zm_VM *vm = zm_newVM("inline VM");
+
+	printf("round-robin:\n\t");
+	run(vm);
+
+	zm_setInlineSub(vm, 32);
+
+	printf("inline:\n\t");
+	run(vm);
+
+	zm_freeVM(vm);
+	return 0;
+}
@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zm.h>
+
+/* resume to step latency histograms (compile with -DZM_ENABLE_LATENCY)
+   run with -v to print the percentiles */
+
+#define NWORKER 50
+#define NREQUEST 20
+
+zm_Event *request;
+volatile unsigned long sink;
+
+
+/* busy worker: a long step after each request */
+ZMTASKDEF( worker )
+{
+	ZMSTART
+
+	zmstate 1:
+		zmyield zmEVENT(request) | 2;
+
+	zmstate 2: {
+		unsigned long i;
+
+		for (i = 0; i < 100000; i++)
+			sink += i;
+
+		zmyield 1;
+	}
+
+	ZMEND
+}
+
+
+/* short task: wait behind the workers */
+ZMTASKDEF( ping )
+{
+	ZMSTART
+
+	zmstate 1:
+		zmyield zmEVENT(request) | 2;
+
+	zmstate 2:
+		zmyield 1;
+
+	ZMEND
+}
+
+
+static void report(zm_VM *vm, zm_Machine *machine, int verbose)
+{
+	const zm_Histogram *h = zm_getLatency(vm, machine);
+	uint64_t p50 = zm_histogramPercentile(h, 50);
+	uint64_t p99 = zm_histogramPercentile(h, 99);
+
+	printf("%s: %lu samples, p50 <= p99 <= max: %s\n",
+	       (machine) ? machine->name : "vm", (unsigned long)h->count,
+	       ((p50 <= p99) && (p99 <= h->max)) ? "yes" : "no");
+
+	if (verbose)
+		printf("\tmin = %lu ns, p50 = %lu ns, p99 = %lu ns, "
+		       "max = %lu ns\n", (unsigned long)h->min,
+		       (unsigned long)p50, (unsigned long)p99,
+		       (unsigned long)h->max);
+}
+
+
+int main(int argc, char **argv)
+{
+	zm_VM *vm = zm_newVM("latency VM");
+	int verbose = ((argc > 1) && (strcmp(argv[1], "-v") == 0));
+	int i;
+
+	request = zm_newEvent(NULL);
+
+	for (i = 0; i < NWORKER; i++)
+		zm_resume(vm, zm_newTasklet(vm, worker, NULL), NULL);
+
+	zm_resume(vm, zm_newTasklet(vm, ping, NULL), NULL);
+
+	while (zm_go(vm, 100, NULL))
+		;
+
+	/* discard the start up samples */
+	zm_resetLatency(vm);
+
+	for (i = 0; i < NREQUEST; i++) {
+		zm_trigger(vm, request, NULL);
+
+		while (zm_go(vm, 100, NULL))
+			;
+	}
+
+	report(vm, worker, verbose);
+	report(vm, ping, verbose);
+	report(vm, NULL, verbose);
+
+	zm_closeVM(vm);
+
+	while (zm_go(vm, 100, NULL))
+		;
+
+	zm_freeEvent(vm, request);
+	zm_freeVM(vm);
+	return 0;
+}
@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zm.h>
+
+/* per-zmstate profile (compile with -DZM_ENABLE_PROFILE) run with -v to
+   print the top 5 zmstates report */
+
+#define NDOC 20
+
+volatile unsigned long sink;
+
+
+static void work(unsigned long n)
+{
+	unsigned long i;
+
+	for (i = 0; i < n; i++)
+		sink += i;
+}
+
+
+ZMTASKDEF( parser )
+{
+	ZMSTART
+
+	zmstate 1:
+		/* read */
+		work(1000);
+		zmyield 2;
+
+	zmstate 2:
+		/* tokenize: the hot zmstate */
+		work(200000);
+		zmyield 3;
+
+	zmstate 3:
+		/* emit */
+		work(1000);
+		zmyield zmTERM;
+
+	ZMEND
+}
+
+
+ZMTASKDEF( logger )
+{
+	ZMSTART
+
+	zmstate 1:
+		work(100);
+		zmyield zmTERM;
+
+	ZMEND
+}
+
+
+static void hottest(zm_VM *vm, zm_Machine **machines, size_t n)
+{
+	const char *name = "";
+	uint64_t max = 0;
+	int hot = 0;
+	size_t i;
+	int k;
+
+	for (i = 0; i < n; i++) {
+		const zm_StateProfile *p = zm_getProfile(vm, machines[i]);
+
+		for (k = 0; (p) && (k < ZM_PROFILE_NSTATE); k++) {
+			if (!p[k].count)
+				continue;
+
+			printf("%s zmstate %d: %lu steps\n", machines[i]->name, k,
+			       (unsigned long)p[k].count);
+
+			if (p[k].time > max) {
+				max = p[k].time;
+				name = machines[i]->name;
+				hot = k;
+			}
+		}
+	}
+
+	printf("hottest: %s zmstate %d\n", name, hot);
+}
+
+
+int main(int argc, char **argv)
+{
+	zm_VM *vm = zm_newVM("profile VM");
+	zm_Machine *machines[] = {parser, logger};
+	int i;
+
+	for (i = 0; i < NDOC; i++) {
+		zm_resume(vm, zm_newTasklet(vm, parser, NULL), NULL);
+		zm_resume(vm, zm_newTasklet(vm, logger, NULL), NULL);
+	}
+
+	while (zm_go(vm, 100, NULL))
+		;
+
+	hottest(vm, machines, 2);
+
+	if ((argc > 1) && (strcmp(argv[1], "-v") == 0))
+		zm_printProfile(NULL, vm, 5);
+
+	zm_freeVM(vm);
+	return 0;
+}
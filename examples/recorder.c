@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zm.h>
+
+/* flight recorder: the last ZM_RECORDER_SIZE scheduler transitions
+   (compile with -DZM_ENABLE_RECORDER). The ring is printed on demand and
+   on a ZM fatal error: run with `fatal` to see it */
+
+zm_Event *ready;
+zm_State *server;
+int crash;
+
+
+ZMTASKDEF( parse )
+{
+	ZMSTART
+
+	zmstate 1:
+		zmraise zmABORT(400, "bad request", NULL);
+
+	ZMEND
+}
+
+
+ZMTASKDEF( request )
+{
+	ZMSTART
+
+	zmstate 1:
+		zmyield zmEVENT(ready) | 2;
+
+	zmstate 2:
+		zmyield zmSUB(zmNewSubTasklet(parse, NULL), NULL) | 3 |
+		        zmCATCH(4);
+
+	zmstate 3:
+		zmyield zmTERM;
+
+	zmstate 4:
+		zmCatch();
+
+		if (crash) {
+			/* bug: resume a running task (ZM fatal error) */
+			zm_resume(vm, server, NULL);
+		}
+
+		zmyield zmTERM;
+
+	ZMEND
+}
+
+
+int main(int argc, char **argv)
+{
+	zm_VM *vm = zm_newVM("recorder VM");
+
+	crash = ((argc > 1) && (strcmp(argv[1], "fatal") == 0));
+
+	ready = zm_newEvent(NULL);
+
+	server = zm_newTasklet(vm, request, NULL);
+	zm_resume(vm, server, NULL);
+
+	while (zm_go(vm, 100, NULL))
+		;
+
+	zm_trigger(vm, ready, NULL);
+
+	while (zm_go(vm, 100, NULL))
+		;
+
+	zm_printRecorder(NULL, vm);
+
+	zm_freeEvent(vm, ready);
+	zm_freeVM(vm);
+	return 0;
+}
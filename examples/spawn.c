@@ -0,0 +1,61 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <zm.h>
+
+/* bulk task creation: spawn many ptasks of one machine at once */
+
+#define NTASK 10000
+
+int ids[NTASK];
+void *datas[NTASK];
+zm_State *tasks[NTASK];
+
+int ninit;
+long sum;
+
+
+ZMTASKDEF( counter )
+{
+	ZMSTART
+
+	zmstate ZM_INIT:
+		ninit++;
+		zmyield zmDONE;
+
+	zmstate 1:
+		sum += *(int*)zmdata;
+		zmyield zmTERM;
+
+	ZMEND
+}
+
+
+int main()
+{
+	zm_VM *vm = zm_newVM("spawn VM");
+	int contiguous = true;
+	int i;
+
+	for (i = 0; i < NTASK; i++) {
+		ids[i] = i + 1;
+		datas[i] = &ids[i];
+	}
+
+	zm_newTasklets(vm, counter, datas, NTASK, tasks);
+
+	for (i = 0; i < NTASK; i++) {
+		if ((i) && (tasks[i] != tasks[i - 1] + 1))
+			contiguous = false;
+
+		zm_resume(vm, tasks[i], NULL);
+	}
+
+	while (zm_go(vm, 100, NULL))
+		;
+
+	printf("%d tasks (%s), %d constructors, sum = %ld\n", NTASK,
+	       (contiguous) ? "contiguous" : "not contiguous", ninit, sum);
+
+	zm_freeVM(vm);
+	return 0;
+}
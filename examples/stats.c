@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <zm.h>
+
+/* per-worker statistics (compile with -DZM_ENABLE_STATS) */
+
+#define NJOB 100
+
+
+ZMTASKDEF( job )
+{
+	ZMSTART
+
+	zmstate 1:
+		zmyield 2;
+
+	zmstate 2:
+		zmyield zmSUSPEND | 3;
+
+	zmstate 3:
+		zmyield zmTERM;
+
+	ZMEND
+}
+
+
+ZMTASKDEF( dispatcher )
+{
+	ZMSTART
+
+	zmstate 1: {
+		int i;
+
+		for (i = 0; i < NJOB; i++)
+			zm_resume(vm, zm_newTasklet(vm, job, NULL), NULL);
+
+		zmyield zmSUSPEND | 2;
+	}
+
+	zmstate 2:
+		zmyield zmTERM;
+
+	ZMEND
+}
+
+
+static void report(zm_VM *vm, zm_Machine *machine)
+{
+	const zm_WorkerStats *st = zm_getWorkerStats(vm, machine);
+
+	if (!st) {
+		printf("%s: no stats\n", machine->name);
+		return;
+	}
+
+	printf("%s:\n", machine->name);
+	printf("\tsteps = %lu (continue = %lu, suspend = %lu, term = %lu, "
+	       "end = %lu)\n", (unsigned long)st->steps,
+	       (unsigned long)st->yields[ZM_STATS_CMD(ZM_TASK_CONTINUE)],
+	       (unsigned long)st->yields[ZM_STATS_CMD(ZM_TASK_SUSPEND)],
+	       (unsigned long)st->yields[ZM_STATS_CMD(ZM_TASK_TERM)],
+	       (unsigned long)st->yields[ZM_STATS_CMD(ZM_TASK_END)]);
+	printf("\tcreated = %lu, freed = %lu, live = %lu, peak = %lu\n",
+	       (unsigned long)st->created, (unsigned long)st->freed,
+	       (unsigned long)st->live, (unsigned long)st->peak);
+}
+
+
+int main()
+{
+	zm_VM *vm = zm_newVM("stats VM");
+	zm_State *d = zm_newTasklet(vm, dispatcher, NULL);
+
+	zm_resume(vm, d, NULL);
+
+	/* all jobs suspended */
+	while (zm_go(vm, 100, NULL))
+		;
+
+	printf("-- all jobs suspended --\n");
+	report(vm, dispatcher);
+	report(vm, job);
+
+	zm_closeVM(vm);
+
+	while (zm_go(vm, 100, NULL))
+		;
+
+	printf("-- vm closed --\n");
+	report(vm, dispatcher);
+	report(vm, job);
+
+	zm_freeVM(vm);
+	return 0;
+}
@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <zm.h>
+
+/* fan-out/join: zmSUBALL, zmSUBANY */
+
+typedef struct {
+	const char *name;
+	int nstep;
+	int fail;
+} Job;
+
+
+zm_Event *never;
+
+
+ZMTASKDEF( worker )
+{
+	Job *job = zmdata;
+
+	ZMSTART
+
+	zmstate 1:
+		if (job->nstep < 0) {
+			printf("\t%s: wait an event that never come\n",
+			       job->name);
+			zmyield zmEVENT(never) | 2;
+		}
+
+		if (job->nstep-- > 0) {
+			printf("\t%s: step\n", job->name);
+			zmyield 1;
+		}
+
+		if (job->fail) {
+			printf("\t%s: raise\n", job->name);
+			zmraise zmABORT(job->fail, "job failed", job);
+		}
+
+		printf("\t%s: done\n", job->name);
+		zmyield zmTERM;
+
+	zmstate 2:
+		zmyield zmTERM;
+
+	zmstate ZM_TERM:
+		printf("\t%s: -term-\n", job->name);
+	ZMEND
+}
+
+
+static void spawn(zm_VM *vm, zm_State **subs, Job *jobs, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		subs[i] = zmNewSubTasklet(worker, &jobs[i]);
+}
+
+
+ZMTASKDEF( boss )
+{
+	static Job all[] = {{"a1", 1, 0}, {"a2", 3, 0}, {"a3", 2, 0}};
+	static Job any[] = {{"b1", -1, 0}, {"b2", 1, 0}, {"b3", 4, 0}};
+	static Job err[] = {{"c1", 4, 0}, {"c2", 1, 42}};
+	zm_State *subs[3];
+
+	ZMSTART
+
+	zmstate 1:
+		printf("* boss: zmSUBALL\n");
+		spawn(vm, subs, all, 3);
+		zmyield zmSUBALL(subs, 3) | 2;
+
+	zmstate 2:
+		printf("* boss: all returned\n\n");
+		printf("* boss: zmSUBANY\n");
+		spawn(vm, subs, any, 3);
+		zmyield zmSUBANY(subs, 3) | 3;
+
+	zmstate 3: {
+		Job *winner = zmarg;
+		printf("* boss: first returned is %s\n\n", winner->name);
+		printf("* boss: zmSUBALL with a failure\n");
+		spawn(vm, subs, err, 2);
+		zmyield zmSUBALL(subs, 2) | 4 | zmCATCH(5);
+	}
+
+	zmstate 4:
+		printf("* boss: not reached\n");
+		zmyield zmTERM;
+
+	zmstate 5: {
+		zm_Exception *e = zmCatch();
+		if (e)
+			printf("* boss: catch \"%s\" (ecode = %d) from %s\n",
+			       e->msg, e->code, ((Job*)e->data)->name);
+		zmyield zmTERM;
+	}
+
+	zmstate ZM_TERM:
+		printf("* boss: -term-\n");
+
+	ZMEND
+}
+
+
+int main()
+{
+	zm_VM *vm = zm_newVM("fan-out VM");
+
+	never = zm_newEvent(NULL);
+
+	zm_resume(vm, zm_newTasklet(vm, boss, NULL), NULL);
+
+	while (zm_go(vm, 100, NULL))
+		;
+
+	zm_freeEvent(vm, never);
+	zm_closeVM(vm);
+	zm_go(vm, 100, NULL);
+	zm_freeVM(vm);
+	return 0;
+}
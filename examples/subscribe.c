@@ -0,0 +1,89 @@
+#include <stdlib.h>
+#include <zm.h>
+
+zm_Event *event;
+
+
+ZMTASKDEF( server )
+{
+	int *served = zmdata;
+
+	ZMSTART
+
+	zmstate 1:
+		printf("server: subscribe\n");
+		zmyield zmSUBSCRIBE(event) | 2 | zmUNBIND(3);
+
+	zmstate 2:
+		(*served)++;
+		printf("server: serve <%s> (event->count = %d)\n",
+		       (const char*)zmarg, event->count);
+
+		if (*served == 2) {
+			/* triggers arrived now are coalesced */
+			zm_trigger(vm, event, "while running 1");
+			zm_trigger(vm, event, "while running 2");
+		}
+
+		if (*served == 4) {
+			printf("server: unsubscribe\n");
+			zmUNSUBSCRIBE();
+			zmyield 4;
+		}
+
+		zmyield zmSUBSCRIBE(event) | 2 | zmUNBIND(3);
+
+	zmstate 3:
+		printf("server: unbinded <%s>\n", (const char*)zmarg);
+		zmyield zmSUBSCRIBE(event) | 2 | zmUNBIND(3);
+
+	zmstate 4:
+		printf("server: no more subscribed (event->count = %d)\n",
+		       event->count);
+		zmyield zmSUBSCRIBE(event) | 2 | zmUNBIND(3);
+
+	zmstate ZM_TERM:
+		printf("server: -end- (%d served)\n", *served);
+
+	ZMEND
+}
+
+
+int main()
+{
+	zm_VM *vm = zm_newVM("subscribe VM");
+	int served = 0;
+	zm_State *s;
+
+	event = zm_newEvent(NULL);
+
+	s = zm_newTasklet(vm, server, &served);
+	zm_resume(vm, s, NULL);
+	while (zm_go(vm, 100, NULL));
+
+	printf("\n* trigger\n");
+	zm_trigger(vm, event, "first");
+	while (zm_go(vm, 100, NULL));
+
+	printf("\n* trigger\n");
+	zm_trigger(vm, event, "second");
+	while (zm_go(vm, 100, NULL));
+
+	printf("\n* unbind waiting subscriber\n");
+	zm_unbind(vm, event, s, "by unbind");
+	while (zm_go(vm, 100, NULL));
+
+	printf("\n* trigger\n");
+	zm_trigger(vm, event, "third");
+	while (zm_go(vm, 100, NULL));
+
+	printf("\n* close\n");
+	zm_closeVM(vm);
+	zm_go(vm, 1000, NULL);
+	zm_freeVM(vm);
+
+	printf("event->count = %d\n", event->count);
+	zm_freeEvent(vm, event);
+
+	return 0;
+}
@@ -0,0 +1,74 @@
+#include <stdlib.h>
+#include <zm.h>
+
+zm_Event *event;
+
+/* a fake clock to run the example without wait */
+uint64_t fakenow = 0;
+
+uint64_t fakeClock(zm_VM *vm)
+{
+	return fakenow;
+}
+
+
+ZMTASKDEF( waiter )
+{
+	unsigned int *ms = zmdata;
+
+	ZMSTART
+
+	zmstate 1:
+		printf("[%3d ms] waiter %u: wait event (timeout %u ms)\n",
+		       (int)fakenow, *ms, *ms);
+		zmyield zmEVENT_TIMEOUT(event, *ms) | 2 | zmUNBIND(3);
+
+	zmstate 2:
+		printf("[%3d ms] waiter %u: event <%s>\n", (int)fakenow, *ms,
+		       (const char*)zmarg);
+		zmyield zmTERM;
+
+	zmstate 3:
+		if (zmarg == ZM_TIMEOUT)
+			printf("[%3d ms] waiter %u: timeout\n", (int)fakenow, *ms);
+		else
+			printf("[%3d ms] waiter %u: unbind\n", (int)fakenow, *ms);
+		zmyield zmTERM;
+
+	ZMEND
+}
+
+
+int main()
+{
+	zm_VM *vm = zm_newVM("timeout VM");
+	unsigned int ms[3] = {30, 100, 1000};
+	int i;
+
+	zm_setClock(vm, fakeClock);
+
+	event = zm_newEvent(NULL);
+
+	for (i = 0; i < 3; i++)
+		zm_resume(vm, zm_newTasklet(vm, waiter, &ms[i]), NULL);
+
+	while (fakenow <= 300) {
+		zm_go(vm, 100, NULL);
+
+		if (fakenow == 50)
+			printf("[%3d ms] next timeout in %d ms\n", (int)fakenow,
+			       zm_nextTimeout(vm));
+
+		if (fakenow == 200)
+			zm_trigger(vm, event, "hello");
+
+		fakenow += 10;
+	}
+
+	zm_closeVM(vm);
+	zm_go(vm, 1000, NULL);
+	zm_freeVM(vm);
+	zm_freeEvent(vm, event);
+
+	return 0;
+}
@@ -0,0 +1,100 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <zm.h>
+
+/* scheduler trace in Chrome trace-event JSON (compile with
+   -DZM_ENABLE_TRACE) run with a file name to write the trace and open it
+   in chrome://tracing or ui.perfetto.dev */
+
+#define NCLIENT 3
+
+zm_Event *tick;
+
+
+ZMTASKDEF( lookup )
+{
+	ZMSTART
+
+	zmstate 1:
+		zmyield 2;
+
+	zmstate 2:
+		zmyield zmTERM;
+
+	ZMEND
+}
+
+
+ZMTASKDEF( client )
+{
+	ZMSTART
+
+	zmstate 1:
+		zmyield zmEVENT(tick) | 2;
+
+	zmstate 2:
+		zmyield zmSUB(zmNewSubTasklet(lookup, NULL), NULL) | 3;
+
+	zmstate 3:
+		zmyield zmTERM;
+
+	ZMEND
+}
+
+
+static void summary(zm_VM *vm)
+{
+	size_t kind[5] = {0, 0, 0, 0, 0};
+	size_t i;
+
+	for (i = 0; i < vm->tracer.used; i++)
+		kind[vm->tracer.records[i].kind]++;
+
+	printf("steps = %zu, calls = %zu, returns = %zu, triggers = %zu, "
+	       "lost = %zu\n", kind[ZM_TRACE_STEP], kind[ZM_TRACE_CALL],
+	       kind[ZM_TRACE_RETURN], kind[ZM_TRACE_TRIGGER],
+	       vm->tracer.lost);
+}
+
+
+int main(int argc, char **argv)
+{
+	zm_VM *vm = zm_newVM("trace VM");
+	int i;
+
+	tick = zm_newEvent(NULL);
+
+	zm_startTrace(vm, 1024);
+
+	for (i = 0; i < NCLIENT; i++)
+		zm_resume(vm, zm_newTasklet(vm, client, NULL), NULL);
+
+	while (zm_go(vm, 100, NULL))
+		;
+
+	zm_trigger(vm, tick, NULL);
+
+	while (zm_go(vm, 100, NULL))
+		;
+
+	zm_stopTrace(vm);
+
+	summary(vm);
+
+	if (argc > 1) {
+		FILE *f = fopen(argv[1], "w");
+
+		if (!f) {
+			perror(argv[1]);
+			return 1;
+		}
+
+		printf("%zu records written in %s\n", zm_writeTrace(vm, f),
+		       argv[1]);
+		fclose(f);
+	}
+
+	zm_freeEvent(vm, tick);
+	zm_freeVM(vm);
+	return 0;
+}
@@ -0,0 +1,69 @@
+#include <stdlib.h>
+#include <zm.h>
+
+#define NTASKS 5
+#define NEVENTS 3
+
+zm_Event *events[NEVENTS];
+
+
+ZMTASKDEF( consumer )
+{
+	int *id = zmdata;
+
+	ZMSTART
+
+	zmstate 1:
+		printf("consumer %d: wait event %d\n", *id, *id % NEVENTS);
+		zmyield zmEVENT(events[*id % NEVENTS]) | 2;
+
+	zmstate 2:
+		printf("consumer %d: got <%s>\n", *id, (const char*)zmarg);
+		zmyield 1;
+
+	ZMEND
+}
+
+
+int main()
+{
+	zm_VM *vm = zm_newVM("batch VM");
+	void *args[NEVENTS] = {"zero", "one", "two"};
+	int id[NTASKS];
+	size_t n;
+	int i;
+
+	for (i = 0; i < NEVENTS; i++)
+		events[i] = zm_newEvent(NULL);
+
+	for (i = 0; i < NTASKS; i++) {
+		id[i] = i;
+		zm_resume(vm, zm_newTasklet(vm, consumer, &id[i]), NULL);
+	}
+
+	while (zm_go(vm, 100, NULL));
+
+	printf("\n* trigger all the events in a batch\n");
+	n = zm_triggerBatch(vm, events, args, NEVENTS);
+	printf("%zu task resumed\n", n);
+	while (zm_go(vm, 100, NULL));
+
+	printf("\n* resume only one task waiting event 0\n");
+	n = zm_triggerN(vm, events[0], "first", 1);
+	printf("%zu task resumed\n", n);
+	while (zm_go(vm, 100, NULL));
+
+	printf("\n* resume the remaining\n");
+	n = zm_triggerN(vm, events[0], "second", 10);
+	printf("%zu task resumed\n", n);
+	while (zm_go(vm, 100, NULL));
+
+	zm_closeVM(vm);
+	zm_go(vm, 1000, NULL);
+	zm_freeVM(vm);
+
+	for (i = 0; i < NEVENTS; i++)
+		zm_freeEvent(vm, events[i]);
+
+	return 0;
+}
@@ -29,23 +29,79 @@
  * THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#ifdef ZM_ENABLE_AIO
+	/* syscall, MAP_POPULATE */
+	#ifndef _DEFAULT_SOURCE
+		#define _DEFAULT_SOURCE 1
+	#endif
+#endif
+
+#if defined(__unix__) || defined(__APPLE__) || \
+    defined(ZM_ENABLE_EPOLL) || defined(ZM_ENABLE_AIO)
+	/* clock_gettime (timer), epoll and async i/o */
+	#ifndef _POSIX_C_SOURCE
+		#define _POSIX_C_SOURCE 200809L
+	#endif
+#endif
+
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <time.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+	/* _POSIX_TIMERS */
+	#include <unistd.h>
+#endif
+
+#if defined(ZM_ENABLE_EPOLL) || defined(ZM_ENABLE_AIO)
+	#include <errno.h>
+	#include <unistd.h>
+	#include <fcntl.h>
+#endif
+
+#ifdef ZM_ENABLE_AIO
+	#include <poll.h>
+	#include <pthread.h>
+	#include <sys/uio.h>
+	#include <sys/eventfd.h>
+
+	#if defined(__linux__) && defined(__GNUC__) && !defined(ZM_AIO_NO_URING)
+		#define ZM_AIO_HAVE_URING 1
+		#include <sys/mman.h>
+		#include <sys/syscall.h>
+		#include <linux/io_uring.h>
+	#endif
+#endif
 
 #include <zm.h>
 
+#if defined(ZM_ENABLE_RECORDER) && \
+    (ZM_RECORDER_SIZE & (ZM_RECORDER_SIZE - 1))
+	#error "ZM_RECORDER_SIZE must be a power of 2"
+#endif
+
+#if defined(ZM_ENABLE_STATS_TIME) || defined(ZM_ENABLE_LATENCY) || \
+    defined(ZM_ENABLE_TRACE) || defined(ZM_ENABLE_PROFILE)
+	/* zm_nanotime */
+	#define ZM_NANOTIME 1
+#endif
+
 
 /*
  * SECTION BASIC_TOOL
  * SECTION MT
  * SECTION REPORT
  * SECTION CORE
+ * SECTION IO
  */
 
 
 size_t zmg_mcounter = 0;
 
+/* ZM_TIMEOUT */
+int zmg_timeout = 0;
+
 
 typedef struct {
 	short by;
@@ -67,6 +123,7 @@ typedef struct {
 
 	zm_State *chaintail;
 	zm_State *running;
+	zm_StateQueue *morerunning;
 
 	const char *refname;
 	const char *filename;
@@ -74,6 +131,67 @@ typedef struct {
 } zm_LockAndImplode;
 
 
+/* incremental implosion phases */
+#define ZM_IMPLODE_LOCK 0
+#define ZM_IMPLODE_STACK 1
+#define ZM_IMPLODE_CHAIN 2
+
+struct zm_Implosion_ {
+	zm_LockAndImplode li;
+	int phase;
+
+	zm_StateQueue **implodestack;
+	size_t level;
+	zm_State *last;
+
+	zm_State *root; /* flagged ZM_STATE_IMPLODING */
+	zm_StateQueue *parked; /* running states out of the worker lists */
+	zm_Implosion *next;
+};
+
+/* vm state arena chunk */
+struct zm_Arena_ {
+	zm_Arena *next;     /* vm chunks */
+	zm_Arena *prev;
+	zm_Arena *nextfree; /* vm chunks with free states */
+	zm_Arena *prevfree;
+	zm_State *freelist;
+	size_t size;
+	size_t live;        /* carved states not free */
+	zm_State states[];
+};
+
+/* persistent bind of a state (zmSUBSCRIBE) */
+typedef struct {
+	zm_EventBinder evb; /* in the event bindlist (first) */
+	int flag;           /* ZM_EVB_* */
+	void *arg;          /* coalesced trigger or unbind argument */
+} zm_Subscription;
+
+/* join (zmSUBALL, zmSUBANY, zmSUB_DEADLINE) */
+typedef struct {
+	int mode;
+	size_t pending;      /* members not yet returned */
+	void *winner;        /* data of first returned (ZM_JOIN_ANY) */
+	zm_Exception *exception;
+	zm_Timer *timer;     /* zmSUB_DEADLINE */
+} zm_Join;
+
+/* state fields used by few tasks (see zm_stateExt) */
+struct zm_StateExt_ {
+	zm_Subscription *subscription;
+	zm_Timer *timer; /* timeout of the event wait (zmEVENT_TIMEOUT) */
+	zm_Join *join;   /* waiting subtasks (zmSUBALL, zmSUBANY) */
+	zm_GroupLink group; /* zm_Group membership (ptask, group != NULL) */
+};
+
+/* field of the state extension (NULL when not allocated) */
+#define zm_ext(s, field) (((s)->ext) ? (s)->ext->field : NULL)
+
+/* no limit in lock and serialize loops */
+#define ZM_NOLIMIT ((size_t)-1)
+
+
 typedef enum {
 	/* unexpected error */
 	ZM_FATAL_U1,
@@ -124,8 +242,17 @@ static struct {
 #define ZM_ELOCK_OFF 2
 #define ZM_ELOCK_REUSE 3
 
+#ifdef ZM_ENABLE_CENSUS
+/* flag changes update the task census (see TASK CENSUS) */
+static void zm_censusFlag(zm_State *s, int flag);
+
+#define zm_enableFlag(s, FLAG)   zm_censusFlag((s), (s)->flag | (FLAG))
+#define zm_disableFlag(s, FLAG)   zm_censusFlag((s), \
+                                                (s)->flag & (0xFFFF ^ (FLAG)))
+#else
 #define zm_enableFlag(s, FLAG)   (s)->flag |= FLAG
 #define zm_disableFlag(s, FLAG)   (s)->flag &= (0xFFFF ^ FLAG)
+#endif
 
 #define zm_getCurrentState(vm) ((vm)->session.state)
 #define zm_getCurrentWorker(vm) ((vm)->session.worker)
@@ -189,6 +316,18 @@ static void zm_memfatal(const char *fmt, ...)
 
 
 
+#ifdef ZM_ENABLE_MEMSTATS
+/* process-wide (not atomic) */
+static zm_MemStats zmg_mem = {0, 0, 0, 0};
+
+
+void zm_getMemStats(zm_MemStats *out)
+{
+	*out = zmg_mem;
+}
+#endif
+
+
 void *zm_malloc(size_t size)
 {
 	void *ptr = malloc(size);
@@ -196,6 +335,11 @@ void *zm_malloc(size_t size)
 	if (!ptr)
 		zm_memfatal("zm_malloc: out of mem\n");
 
+	#ifdef ZM_ENABLE_MEMSTATS
+	zmg_mem.allocs++;
+	zmg_mem.bytes += (int64_t)size;
+	#endif
+
 	return ptr;
 }
 
@@ -206,11 +350,20 @@ void *zm_mrealloc(void *ptr, size_t size)
 	if (!ptr)
 		zm_memfatal("zm_mrealloc: out of mem\n");
 
+	#ifdef ZM_ENABLE_MEMSTATS
+	zmg_mem.reallocs++;
+	#endif
+
 	return ptr;
 }
 
 void zm_mfree(size_t size, void *ptr)
 {
+	#ifdef ZM_ENABLE_MEMSTATS
+	zmg_mem.frees++;
+	zmg_mem.bytes -= (int64_t)size;
+	#endif
+
 	free(ptr);
 }
 
@@ -640,6 +793,14 @@ static void zm_fatalDo(zm_fatal_t kind, const char *ecode,
 
 		zm_fatalTrigger();
 
+		#ifdef ZM_ENABLE_RECORDER
+		if (zmg_err.vm) {
+			zm_Print out;
+			zm_initPrint(&out, stderr, 0);
+			zm_printRecorder(&out, zmg_err.vm);
+		}
+		#endif
+
 		if (zm_fatalPrintDump(kind)) {
 			/* print again the message after the dump */
 			va_start(args, fmt);
@@ -712,6 +873,24 @@ static const char *zm_exceptionKind(int kind)
 }
 
 
+#if defined(ZM_ENABLE_TRACE) || defined(ZM_ENABLE_RECORDER)
+/* yield command name (cmd = zm_Yield.cmd) */
+static const char *zm_yieldCmdName(int cmd)
+{
+	static const char *names[] = {
+		"CONTINUE", "SUSPEND", "SUB", "END", "TERM", "CALLER",
+		"EVENT", "RAISE", "ABORT", "INIT", "EVENT_READY",
+		"FUTURE_READY"
+	};
+
+	if ((cmd < 0) || (cmd >= (int)(sizeof(names) / sizeof(names[0]))))
+		return "?";
+
+	return names[cmd];
+}
+#endif
+
+
 static const char *zm_implodeFlagName(int implodeby)
 {
 	switch (implodeby) {
@@ -903,8 +1082,17 @@ static void zm_printFlags(zm_Print* out, zm_State *s, int compact)
 		ZM_CPRINT("[cm]", "(c-mark) ");
 
 
-	if (s->flag & ZM_STATE_UNUSED)
-		ZM_CPRINT("[??]", "( unknow ??? ) ");
+	if (s->flag & ZM_STATE_CANCEL)
+		ZM_CPRINT("[cn]", "(cancel) ");
+
+	if (s->flag & ZM_STATE_IMPLODING)
+		ZM_CPRINT("[im]", "(imploding) ");
+
+	if (s->flag & ZM_STATE_NOTERM)
+		ZM_CPRINT("[nt]", "(no-term) ");
+
+	if (s->flag & ZM_STATE_NOINIT)
+		ZM_CPRINT("[ni]", "(no-init) ");
 
 }
 
@@ -1555,6 +1743,103 @@ void zm_printVM(zm_Print *out, zm_VM *vm)
 }
 
 
+#ifdef ZM_ENABLE_RECORDER
+static const char *zm_recordKind(int kind)
+{
+	switch (kind) {
+	ZM_STRCASE(ZM_RECORD_STEP);
+	ZM_STRCASE(ZM_RECORD_RESUME);
+	ZM_STRCASE(ZM_RECORD_TRIGGER);
+	ZM_STRCASE(ZM_RECORD_RAISE);
+	ZM_STRCASE(ZM_RECORD_CATCH);
+	ZM_STRCASE(ZM_RECORD_CLOSE);
+	ZM_STRCASE(ZM_RECORD_END);
+	}
+	return "unknow record kind";
+}
+
+
+/* print the flight recorder (oldest record first) */
+void zm_printRecorder(zm_Print *out, zm_VM *vm)
+{
+	uint64_t seq = vm->recorder.seq;
+	uint64_t i = (seq > ZM_RECORDER_SIZE) ? seq - ZM_RECORDER_SIZE : 0;
+
+	ZM_DEFAULT_STDOUT(out);
+
+	zm_print(out, "*** flight recorder (last %lu of %lu records):\n",
+	         (unsigned long)(seq - i), (unsigned long)seq);
+
+	for (; i < seq; i++) {
+		zm_Record *r = &(vm->recorder.ring[i &
+		                                   (ZM_RECORDER_SIZE - 1)]);
+		const char *name = (r->name) ? r->name : "";
+
+		zm_print(out, "  %8lu %-18s ", (unsigned long)i,
+		         zm_recordKind(r->kind));
+
+		switch (r->kind) {
+		case ZM_RECORD_STEP:
+			zm_print(out, "%s-%zx zmstate=%d yield=%s\n", name,
+			         r->ref, r->a, (r->b == 0xFF) ? "(running)" :
+			         zm_yieldCmdName(r->b));
+			break;
+
+		case ZM_RECORD_TRIGGER:
+			zm_print(out, "event-%zx resumed=%lu\n", r->ref,
+			         (unsigned long)r->arg);
+			break;
+
+		case ZM_RECORD_RAISE:
+			zm_print(out, "%s-%zx %s code=%d\n", name, r->ref,
+			         zm_exceptionKind(r->a), (int)r->arg);
+			break;
+
+		case ZM_RECORD_CATCH:
+			zm_print(out, "%s-%zx code=%d\n", name, r->ref,
+			         (int)r->arg);
+			break;
+
+		default:
+			zm_print(out, "%s-%zx\n", name, r->ref);
+		}
+	}
+
+	zm_print(out, "\n\n");
+}
+
+
+/*
+ * A record costs a store in the ring (single writer: the vm thread, no
+ * lock). Return the record sequence number.
+ */
+static uint64_t zm_record(zm_VM *vm, int kind, const void *ref,
+                          const char *name, uint32_t arg, int a, int b)
+{
+	uint64_t seq = vm->recorder.seq++;
+	zm_Record *r = &(vm->recorder.ring[seq & (ZM_RECORDER_SIZE - 1)]);
+
+	r->ref = ref;
+	r->name = name;
+	r->arg = arg;
+	r->kind = (uint8_t)kind;
+	r->a = (uint8_t)a;
+	r->b = (uint8_t)b;
+
+	return seq;
+}
+
+
+/* set the yield command of the step record seq (if not overwritten) */
+static void zm_recordStepEnd(zm_VM *vm, uint64_t seq, zm_Yield y)
+{
+	if (vm->recorder.seq - seq <= ZM_RECORDER_SIZE)
+		vm->recorder.ring[seq & (ZM_RECORDER_SIZE - 1)].b =
+		                                               (uint8_t)y.cmd;
+}
+#endif
+
+
 void zm_printException(zm_Print *out, zm_Exception *e, int trace)
 {
 	const char *msg = (e->msg) ? (e->msg) : ("");
@@ -1904,6 +2189,18 @@ static void zm_rewindWorkerStates(zm_VM *vm, zm_Worker* worker)
 }
 
 
+#ifdef ZM_NANOTIME
+static uint64_t zm_nanotime();
+#endif
+
+#ifdef ZM_ENABLE_TRACE
+static void zm_traceEdge(zm_VM *vm, int kind, zm_State *from, zm_State *to);
+#endif
+
+
+static void zm_linkState(zm_VM *vm, zm_Worker *worker, zm_State *s);
+
+
 /* resume - add to worker
  * (worker  has been temporary stored in next pointer)
  */
@@ -1939,12 +2236,21 @@ static void zm_resumeState(zm_VM *vm, zm_State *s)
 	#endif
 
 
-	s->flag |= ZM_STATE_RUN;
+	zm_enableFlag(s, ZM_STATE_RUN);
 
 	zm_disableFlag(s, ZM_STATE_WAITING);
 
+	#ifdef ZM_ENABLE_LATENCY
+	s->resumed = zm_nanotime();
+	#endif
+
 	ZM_D("resumeState: worker = %s\n", worker->machine->name);
 
+	#ifdef ZM_ENABLE_RECORDER
+	zm_record(vm, ZM_RECORD_RESUME, s, (worker) ? worker->machine->name :
+	                                              NULL, 0, 0, 0);
+	#endif
+
 	if (!worker) {
 		zm_fatalInit(vm, NULL);
 		zm_fatalDo(ZM_FATAL_U1, "RESST.NW",
@@ -1952,9 +2258,16 @@ static void zm_resumeState(zm_VM *vm, zm_State *s)
 		           "task as been free)");
 	}
 
+	zm_linkState(vm, worker, s);
+}
 
-	/**** Add state to worker ***  */
 
+/*
+ * Add state to worker before the cursor (it will be processed in the next
+ * lap): safe also inside a session.
+ */
+static void zm_linkState(zm_VM *vm, zm_Worker *worker, zm_State *s)
+{
 	if (worker->nstate == 0) {
 		zm_stateRewind(worker, s);
 
@@ -1999,13 +2312,9 @@ static void zm_resumeState(zm_VM *vm, zm_State *s)
 
 
 
-/* resume - add to worker
- * (worker  has been temporary stored in next pointer)
- */
-static void zm_resumeStateBy(zm_VM *vm, zm_State *s, void *argument,
-                                                     const char *ref,
-                                                const char *filename,
-                                                           int nline)
+/* check a resume requested by user code */
+static void zm_checkResumeBy(zm_VM *vm, zm_State *s, const char *ref,
+                             const char *filename, int nline)
 {
 	if (s->flag & ZM_STATE_RUN) {
 		if (s == zm_getCurrentState(vm)) {
@@ -2026,13 +2335,90 @@ static void zm_resumeStateBy(zm_VM *vm, zm_State *s, void *argument,
 			           "tring to resume a closed task");
 		}
 	}
+}
 
 
+/* resume - add to worker
+ * (worker  has been temporary stored in next pointer)
+ */
+static void zm_resumeStateBy(zm_VM *vm, zm_State *s, void *argument,
+                                                     const char *ref,
+                                                const char *filename,
+                                                           int nline)
+{
+	zm_checkResumeBy(vm, s, ref, filename, nline);
 	zm_setArgument(s, argument);
 	zm_resumeState(vm, s);
 }
 
 
+/*
+ * Resume a subtask (zmSUB) or a subtask caller. With zm_setInlineSub the
+ * state is not added to the worker now: zm_go run it just after the current
+ * step (see zm_linkHandoff).
+ */
+static int zm_canInline(zm_VM *vm)
+{
+	return ((vm->session.stepping) &&
+	        (vm->session.nest < vm->inlinesub) &&
+	        (!vm->session.fixedworker) &&
+	        (!vm->session.handoff));
+}
+
+
+static void zm_resumeNext(zm_VM *vm, zm_State *s)
+{
+	if (!zm_canInline(vm)) {
+		zm_resumeState(vm, s);
+		return;
+	}
+
+	ZM_D("resumeNext: inline state [ref %zx]", s);
+
+	zm_enableFlag(s, ZM_STATE_RUN);
+
+	zm_disableFlag(s, ZM_STATE_WAITING);
+
+	#ifdef ZM_ENABLE_LATENCY
+	s->resumed = zm_nanotime();
+	#endif
+
+	#ifdef ZM_ENABLE_RECORDER
+	zm_record(vm, ZM_RECORD_RESUME, s, ((zm_Worker*)s->next)->machine->name,
+	          0, 0, 0);
+	#endif
+
+	/* s->next still contains the worker */
+	vm->session.handoff = s;
+}
+
+
+/*
+ * Add the inline state to the worker as current state (next processed)
+ */
+static void zm_linkHandoff(zm_VM *vm, zm_Worker *worker, zm_State *s)
+{
+	if (worker->nstate == 0) {
+		zm_stateRewind(worker, s);
+		s->next = NULL;
+		zm_addWorker(vm, worker);
+		return;
+	}
+
+	if (worker->states.previous)
+		worker->states.previous->next = s;
+	else
+		worker->states.first = s;
+
+	s->next = worker->states.current;
+	worker->states.current = s;
+	worker->nstate++;
+}
+
+
+static void zm_joinReturn(zm_VM *vm, zm_State *c, zm_State *sub);
+
+
 /*
  * Resume the caller of a subtask.
  */
@@ -2044,6 +2430,23 @@ static void zm_resumeCaller(zm_VM *vm, zm_State *sub, int iter)
 
 	c = zm_caller(sub);
 
+	#ifdef ZM_ENABLE_TRACE
+	zm_traceEdge(vm, ZM_TRACE_RETURN, sub, c);
+	#endif
+
+	if (zm_ext(c, join)) {
+		/* caller is waiting more subtasks (zmSUBALL, zmSUBANY) or
+		 * a deadline (zmSUB_DEADLINE: iter as a plain subtask) */
+		if ((iter) && (c->on.iter) &&
+		    (c->ext->join->mode == ZM_JOIN_DEADLINE) &&
+		    (!c->ext->join->exception))
+			c->on.resume = c->on.iter;
+
+		zm_setCaller(sub, NULL);
+		zm_joinReturn(vm, c, sub);
+		return;
+	}
+
 	if (iter) {
 		/*  [ON_RESUME_SWITCH]*/
 		if (c->on.iter) {
@@ -2055,7 +2458,7 @@ static void zm_resumeCaller(zm_VM *vm, zm_State *sub, int iter)
 	zm_setCaller(sub, NULL);
 
 	/*** resume caller */
-	zm_resumeState(vm, c);
+	zm_resumeNext(vm, c);
 }
 
 
@@ -2115,13 +2518,8 @@ static void zm_suspendCurrentState(zm_VM* vm, int waiting)
 /**
  *
  */
-static void zm_suspendByYield(zm_VM* vm, zm_Yield ms, int waiting)
+static void zm_setResumePoints(zm_VM* vm, zm_State *state, zm_Yield ms)
 {
-
-	zm_State *state = zm_getCurrentState(vm);
-
-	ZM_D("suspendCurrentState -- state : [ref %zx]", state);
-
 	if (ms.resume >= ZM_RESERVED)
 		zm_zmstateReserved(vm, ms.resume, "YSU.RS");
 
@@ -2134,6 +2532,17 @@ static void zm_suspendByYield(zm_VM* vm, zm_Yield ms, int waiting)
 	state->on.resume = ms.resume;
 	state->on.iter = ms.iter;
 	state->on.c4tch = ms.c4tch;
+}
+
+
+static void zm_suspendByYield(zm_VM* vm, zm_Yield ms, int waiting)
+{
+
+	zm_State *state = zm_getCurrentState(vm);
+
+	ZM_D("suspendCurrentState -- state : [ref %zx]", state);
+
+	zm_setResumePoints(vm, state, ms);
 
 	zm_suspendCurrentState(vm, waiting);
 }
@@ -2172,12 +2581,27 @@ static void zm_removeStateFromSiblings(zm_VM *vm, zm_State *s)
 
 
 static void zm_unbindEvent(zm_VM* vm, zm_State *s, void* argument, int scope);
+static void zm_dropSubscription(zm_VM *vm, zm_State *s, void *argument,
+                                int scope);
 static void zm_abortTask(zm_VM *vm, zm_State *state, const char *refname);
+static void zm_freeJoin(zm_VM *vm, zm_State *s);
+static zm_Exception* zm_joinRaise(zm_VM *vm, zm_State *c, zm_Exception *e);
+static zm_StateExt* zm_stateExt(zm_State *s);
 
 
-static zm_Exception* zm_newException(int kind)
+/*
+ * Exceptions and traces are recycled in per-vm free lists (see
+ * zm_reserveExceptions): a warm vm raise and catch without malloc.
+ */
+static zm_Exception* zm_newException(zm_VM *vm, int kind)
 {
-	zm_Exception *e = zm_alloc(zm_Exception);
+	zm_Exception *e = vm->epool.exceptions;
+
+	if (e)
+		vm->epool.exceptions = e->link;
+	else
+		e = zm_alloc(zm_Exception);
+
 	e->elock = ZM_ELOCK_OFF;
 	e->kind = kind;
 	e->code = 0;
@@ -2186,17 +2610,38 @@ static zm_Exception* zm_newException(int kind)
 	e->etrace = NULL;
 	e->raisestate = NULL;
 	e->beforecatch = NULL;
+	e->link = NULL;
 
 	return e;
 }
 
 
+static void zm_freeException(zm_VM *vm, zm_Exception *e)
+{
+	e->link = vm->epool.exceptions;
+	vm->epool.exceptions = e;
+}
+
+
+static zm_Trace* zm_newTrace(zm_VM *vm)
+{
+	zm_Trace *t = vm->epool.traces;
+
+	if (t) {
+		vm->epool.traces = t->next;
+		return t;
+	}
+
+	return zm_alloc(zm_Trace);
+}
+
+
 /**
  * Append a state to the exception traceback
  */
 static void zm_appendTrace(zm_VM *vm, zm_Exception* e, zm_State *state)
 {
-	zm_Trace* t = zm_alloc(zm_Trace);
+	zm_Trace* t = zm_newTrace(vm);
 
 	ZM_D("append Trace Exception state = [ref %zx]", state);
 
@@ -2227,18 +2672,62 @@ static void zm_appendTrace(zm_VM *vm, zm_Exception* e, zm_State *state)
 }
 
 
-static void zm_freeTrace(zm_Exception *e)
+static void zm_freeTrace(zm_VM *vm, zm_Exception *e)
+{
+	zm_Trace *t = e->etrace;
+
+	if (!t)
+		return;
+
+	while (t->next)
+		t = t->next;
+
+	t->next = vm->epool.traces;
+	vm->epool.traces = e->etrace;
+
+	e->etrace = NULL;
+}
+
+
+static void zm_freeExceptionPool(zm_VM *vm)
 {
-	zm_Trace *t, *next;
+	zm_Exception *e = vm->epool.exceptions;
+	zm_Trace *t = vm->epool.traces;
+
+	while (e) {
+		zm_Exception *next = e->link;
+		zm_free(zm_Exception, e);
+		e = next;
+	}
 
-	t = e->etrace;
 	while (t) {
-		next = t->next;
+		zm_Trace *next = t->next;
 		zm_free(zm_Trace, t);
 		t = next;
 	}
 
-	e->etrace = NULL;
+	vm->epool.exceptions = NULL;
+	vm->epool.traces = NULL;
+}
+
+
+/*
+ * Fill the vm pool with n exceptions and n * k traces: then n exceptions
+ * caught within k tasks (raiser and catcher included) don't use malloc.
+ */
+void zm_reserveExceptions(zm_VM *vm, size_t n, size_t k)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		zm_freeException(vm, zm_alloc(zm_Exception));
+
+	for (i = 0; i < n * k; i++) {
+		zm_Trace *t = zm_alloc(zm_Trace);
+
+		t->next = vm->epool.traces;
+		vm->epool.traces = t;
+	}
 }
 
 
@@ -2337,6 +2826,7 @@ static void zm_initLockAndImplode(zm_LockAndImplode *li, int implodeby)
 	li->justlock.exception = NULL;
 	li->justlock.state = NULL;
 	li->running = NULL;
+	li->morerunning = NULL;
 
 	li->fromdeep = 0;
 	li->todeep = 0;
@@ -2486,16 +2976,18 @@ static void zm_initAsyncSerialization(zm_VM* vm, zm_State *state,
 		           "found a running state in a sync implosion");
 	}
 
-	if (li->running) {
-		zm_fatalInit(vm, NULL);
-		zm_fatalDo(ZM_FATAL_U1, "LIUNLN.2R", "more than "
-		           "one running state in async implosion");
-	}
-
 	ZM_D("Init async serialization");
 
 	/** set implode running reference */
-	li->running = state;
+	if (!li->running) {
+		li->running = state;
+	} else {
+		/* more running states (event unbind, zmSUBALL members) */
+		if (!li->morerunning)
+			li->morerunning = zm_queueNew();
+
+		zm_queueAdd(li->morerunning, state, NULL);
+	}
 
 	/* state cannot be currentstate (see ABRT.SELF, DEEPLCK.SELF)  */
 	state->pmode = ZM_PMODE_ASYNCIMPLODE;
@@ -2509,6 +3001,14 @@ static void zm_setImplodeLock(zm_VM *vm, zm_LockAndImplode* li, zm_State *state)
 	if (state->flag & ZM_STATE_EVENTLOCKED)
 		zm_unbindEvent(vm, state, NULL, ZM_EVENT_UNBIND_ABORT);
 
+	if (zm_ext(state, subscription))
+		zm_dropSubscription(vm, state, NULL, ZM_EVENT_UNBIND_ABORT);
+
+	if (zm_ext(state, join))
+		zm_freeJoin(vm, state);
+
+	zm_disableFlag(state, ZM_STATE_CANCEL);
+
 	/** save current zmop in iter to be extract with zmGetCloseOp*/
 	state->on.iter = state->on.resume;
 	state->on.resume = ZM_TERM;
@@ -2519,7 +3019,7 @@ static void zm_setImplodeLock(zm_VM *vm, zm_LockAndImplode* li, zm_State *state)
 	/* This must be done after eventUnbind call because*/
 	/* when it resume parent check implosion lock flag */
 	/* #UNBIND_IMLOCK*/
-	state->flag |= ZM_STATE_IMPLOSIONLOCK;
+	zm_enableFlag(state, ZM_STATE_IMPLOSIONLOCK);
 
 	state->pmode = ZM_PMODE_CLOSE;
 
@@ -2606,17 +3106,21 @@ static void zm_deepLockOverlap(zm_VM *vm, zm_LockAndImplode* li, zm_State *s)
 }
 
 
-static void zm_deepLock(zm_VM *vm, zm_State *state, zm_LockAndImplode *li)
+/*
+ * lock max n states of the deepstack (return the number of states popped),
+ * deepstack is free (and set to NULL) when empty
+ */
+static size_t zm_deepLockN(zm_VM *vm, zm_LockAndImplode *li, size_t n)
 {
-	ZM_D("deepLock - init");
-
-	if (state)
-		zm_queueAdd(li->deepstack, state, NULL);
+	zm_State *state;
+	size_t i = 0;
 
 	/* deepstack is used to recursive lock subtasks
 	 * (without recursive functions)
 	 */
-	while ((state = zm_queuePop0(li->deepstack, NULL))) {
+	while ((i < n) && (state = zm_queuePop0(li->deepstack, NULL))) {
+		i++;
+
 		if ((vm->plock) && (state == zm_getCurrentState(vm))) {
 			zm_fatalInitByLI(vm, li);
 			zm_fatalDo(ZM_FATAL_U1, "DEEPLCK.SELF",
@@ -2644,19 +3148,32 @@ static void zm_deepLock(zm_VM *vm, zm_State *state, zm_LockAndImplode *li)
 		}
 	}
 
-	zm_queueFree(li->deepstack);
+	if (zm_queueIsEmpty(li->deepstack)) {
+		zm_queueFree(li->deepstack);
+		li->deepstack = NULL;
+	}
+
+	return i;
+}
+
+
+static void zm_deepLock(zm_VM *vm, zm_State *state, zm_LockAndImplode *li)
+{
+	ZM_D("deepLock - init");
+
+	if (state)
+		zm_queueAdd(li->deepstack, state, NULL);
 
+	zm_deepLockN(vm, li, ZM_NOLIMIT);
 
 	ZM_D("deepLock - end");
 }
 
 
-static zm_StateQueue** zm_lock2ImplodeStack(zm_LockAndImplode *li)
+static zm_StateQueue** zm_newImplodeStack(zm_LockAndImplode *li)
 {
 	zm_StateQueue** implodestack;
-	zm_State *state;
-	size_t from = li->fromdeep;
-	size_t fromto = 1 + li->todeep - from;
+	size_t fromto = 1 + li->todeep - li->fromdeep;
 	size_t i;
 
 	ZM_D("lock2deepstack - from=%d, to=%d", li->fromdeep, li->todeep);
@@ -2668,27 +3185,57 @@ static zm_StateQueue** zm_lock2ImplodeStack(zm_LockAndImplode *li)
 		implodestack[i] = zm_queueNew();
 	}
 
+	return implodestack;
+}
+
+
+/*
+ * move max n states from lockstack to implosion stack (return the number
+ * of states moved), lockstack is free (and set to NULL) when empty
+ */
+static size_t zm_lock2ImplodeStackN(zm_LockAndImplode *li,
+                                    zm_StateQueue **implodestack, size_t n)
+{
+	zm_State *state;
+	size_t from = li->fromdeep;
+	size_t i = 0;
+
 	ZM_D("lock2deepstack - add elements in implosion stack by deep");
 	/* add element in implosion stack by deep*/
-	while ((state = zm_queuePop0(li->lockstack, NULL))) {
-		size_t n = zm_getDeep(state);
+	while ((i < n) && (state = zm_queuePop0(li->lockstack, NULL))) {
+		size_t deep = zm_getDeep(state);
+
+		zm_queueAdd(implodestack[deep - from], state, NULL);
+		i++;
+	}
 
-		zm_queueAdd(implodestack[n - from], state, NULL);
+	if (zm_queueIsEmpty(li->lockstack)) {
+		ZM_D("lock2deepstack - free lockstack");
+		zm_queueFree(li->lockstack);
+		li->lockstack = NULL;
 	}
 
-	ZM_D("lock2deepstack - free lockstack");
-	zm_queueFree(li->lockstack);
+	return i;
+}
+
+
+static zm_StateQueue** zm_lock2ImplodeStack(zm_LockAndImplode *li)
+{
+	zm_StateQueue** implodestack = zm_newImplodeStack(li);
+
+	zm_lock2ImplodeStackN(li, implodestack, ZM_NOLIMIT);
 
 	return implodestack;
 }
 
 
-static void zm_pushAsyncImplosionStart(zm_State *running, zm_State *start)
+static zm_Exception* zm_pushAsyncImplosionStart(zm_VM *vm, zm_State *running,
+                                                 zm_State *start)
 {
 	/* #ASYNC_SERIALIZATION [step 2] */
 	zm_Exception *e;
 
-	e = zm_newException( ZM_EXCEPTION_STARTIMPLOSION );
+	e = zm_newException(vm, ZM_EXCEPTION_STARTIMPLOSION);
 
 	/** save implosion start in raisestate */
 	e->raisestate = start;
@@ -2697,20 +3244,34 @@ static void zm_pushAsyncImplosionStart(zm_State *running, zm_State *start)
 	e->data = running->exception;
 
 	running->exception = e;
+
+	return e;
 }
 
 
-static zm_State* zm_popAsyncImplosionStart(zm_State *state)
+static zm_State* zm_popAsyncImplosionStart(zm_VM *vm, zm_State *state)
 {
 	/* #ASYNC_SERIALIZATION [step 3] */
 	zm_Exception *e = (zm_Exception *)state->exception->data;
+	zm_Exception *shared = state->exception->link;
 
 	zm_State *implosionstart = state->exception->raisestate;
 
-	zm_free(zm_Exception, state->exception);
+	zm_freeException(vm, state->exception);
 
 	state->exception = e;
 
+	if (shared) {
+		/* more running states: the implosion start when the last
+		 * one has been suspended (counter in shared->code) */
+		implosionstart = NULL;
+
+		if (--shared->code == 0) {
+			implosionstart = shared->raisestate;
+			zm_freeException(vm, shared);
+		}
+	}
+
 	return implosionstart;
 }
 
@@ -2727,18 +3288,14 @@ static void zm_serialize(zm_State *state, zm_State *tail)
 }
 
 
-static zm_State *zm_serializeImplosion(zm_LockAndImplode *li,
-                                zm_StateQueue **implodestack,
-                                        zm_Exception *except)
+/*
+ * first element of the implosion chain
+ */
+static zm_State *zm_serializeFirst(zm_LockAndImplode *li,
+                                   zm_StateQueue **implodestack,
+                                   zm_Exception *except)
 {
-	size_t from = li->fromdeep;
-	size_t to = li->todeep;
-	size_t fromto = 1 + to - from;
-	size_t i;
-
-	zm_State *state, *last;
-
-	state = zm_queuePop0(implodestack[0], NULL);
+	zm_State *state = zm_queuePop0(implodestack[0], NULL);
 
 	/* set the chaintail state (error raising state) as caller of the
 	   first implosion element */
@@ -2755,24 +3312,57 @@ static zm_State *zm_serializeImplosion(zm_LockAndImplode *li,
 
 	ZM_D("i-serialize - first = %zx", state);
 
-	last = state;
+	return state;
+}
+
+
+/*
+ * serialize max n states from the deep *level (return the number of states
+ * serialized), the implosion stack is free when *level > li->todeep
+ */
+static size_t zm_serializeN(zm_LockAndImplode *li, zm_StateQueue **implodestack,
+                            size_t *level, zm_State **last, size_t n)
+{
+	size_t from = li->fromdeep;
+	size_t to = li->todeep;
+	size_t i = 0;
+	zm_State *state;
+
+	for (; *level <= to; (*level)++) {
+		zm_StateQueue *q = implodestack[*level - from];
 
-	for (i = from; i <= to; i++) {
-		ZM_D("i-serialize - deep = %d", i);
+		ZM_D("i-serialize - deep = %d", *level);
 
-		while ((state = zm_queuePop0(implodestack[i-from],NULL))) {
-			ZM_D("i-serialize - comeback(%zx) = %zx", state,last);
-			zm_serialize(state, last);
-			last = state;
+		while ((i < n) && (state = zm_queuePop0(q, NULL))) {
+			ZM_D("i-serialize - comeback(%zx) = %zx", state,
+			     *last);
+			zm_serialize(state, *last);
+			*last = state;
+			i++;
 		}
 
-		zm_queueFree(implodestack[i - from]);
+		if (!zm_queueIsEmpty(q))
+			return i;
+
+		zm_queueFree(q);
 	}
 
+	ZM_D("i-serialize - free implodestack[%d]", 1 + to - from);
+
+	zm_nfree(zm_StateQueue*, 1 + to - from, implodestack);
+
+	return i;
+}
+
 
-	ZM_D("i-serialize - free implodestack[%d]", fromto);
+static zm_State *zm_serializeImplosion(zm_LockAndImplode *li,
+                                zm_StateQueue **implodestack,
+                                        zm_Exception *except)
+{
+	size_t level = li->fromdeep;
+	zm_State *last = zm_serializeFirst(li, implodestack, except);
 
-	zm_nfree(zm_StateQueue*, fromto, implodestack);
+	zm_serializeN(li, implodestack, &level, &last, ZM_NOLIMIT);
 
 	ZM_D("i-serialize - last = %zx", last);
 
@@ -2795,21 +3385,45 @@ static void zm_startImplosion(zm_VM *vm, zm_LockAndImplode *li, zm_State *last)
 		ZM_D("startImplode - before catch = %zx", state);
 		/* link async lock and implode with sync one */
 		zm_setCaller(state, last);
+
+		if (li->morerunning)
+			zm_queueFree(li->morerunning);
+
 		return;
 	}
 
 	/** last pop element is the first to run*/
 	ZM_D("startImplode - have a running state [ref %zx]?", li->running);
 
-	if (li->running) {
+	if (li->morerunning) {
+		zm_Exception *shared;
+		zm_State *state;
+
+		ZM_D("startImplode - async serialization (more running)");
+		/* #ASYNC_SERIALIZATION [step 2]*/
+		/* each running state has a marker linked to a shared one
+		 * that count the running states still to be suspended */
+		shared = zm_newException(vm, ZM_EXCEPTION_STARTIMPLOSION);
+		shared->raisestate = last;
+
+		zm_queueAdd(li->morerunning, li->running, NULL);
+
+		while ((state = zm_queuePop0(li->morerunning, NULL))) {
+			zm_pushAsyncImplosionStart(vm, state, NULL)->link = shared;
+			shared->code++;
+		}
+
+		zm_queueFree(li->morerunning);
+
+	} else if (li->running) {
 		ZM_D("startImplode - async serialization");
 		/* #ASYNC_SERIALIZATION [step 2]*/
 		/* there is just a running state, set last in root to be */
 		/* resumed after running state as been suspended */
-		zm_pushAsyncImplosionStart(li->running, last);
+		zm_pushAsyncImplosionStart(vm, li->running, last);
 	} else {
 		ZM_D("startImplode - resume [ref %zx]", last);
-		zm_resumeState(vm, last);
+		zm_resumeNext(vm, last);
 	}
 }
 
@@ -2826,10 +3440,12 @@ static void zm_implode(zm_VM *vm, zm_LockAndImplode *li, zm_Exception *e)
 		/* no element to close */
 		zm_queueFree(li->lockstack);
 
-		if (e) {
+		if ((e) && (li->chaintail)) {
 			ZM_D("implode - totaly zmRESET-ed");
 			/* totaly resetted exception */
-			if (li->chaintail)
+			if (zm_ext(li->chaintail, join))
+				zm_joinReturn(vm, li->chaintail, NULL);
+			else
 				zm_resumeState(vm, li->chaintail);
 		}
 
@@ -2853,6 +3469,193 @@ static void zm_implode(zm_VM *vm, zm_LockAndImplode *li, zm_Exception *e)
 }
 
 
+/*
+ * Run an incremental implosion for max *budget states (lock, implosion stack
+ * and serialization are counted separately). Return true when the implosion
+ * has been started (see zm_setImplodeSlice).
+ */
+static int zm_implodeSlice(zm_VM *vm, zm_Implosion *im, size_t *budget)
+{
+	zm_LockAndImplode *li = &im->li;
+
+	switch (im->phase) {
+	case ZM_IMPLODE_LOCK:
+		*budget -= zm_deepLockN(vm, li, *budget);
+
+		if (li->deepstack)
+			return false;
+
+		if (zm_isSyncImplode(li))
+			zm_checkContinue(vm, li);
+
+		if (li->count == 0) {
+			zm_implode(vm, li, NULL);
+			return true;
+		}
+
+		im->implodestack = zm_newImplodeStack(li);
+		im->phase = ZM_IMPLODE_STACK;
+
+		/* fall through */
+	case ZM_IMPLODE_STACK:
+		*budget -= zm_lock2ImplodeStackN(li, im->implodestack, *budget);
+
+		if (li->lockstack)
+			return false;
+
+		im->last = zm_serializeFirst(li, im->implodestack, NULL);
+		im->level = li->fromdeep;
+		im->phase = ZM_IMPLODE_CHAIN;
+
+		/* fall through */
+	case ZM_IMPLODE_CHAIN:
+		*budget -= zm_serializeN(li, im->implodestack, &im->level,
+		                         &im->last, *budget);
+
+		if (im->level <= (size_t)li->todeep)
+			return false;
+
+		zm_startImplosion(vm, li, im->last);
+		return true;
+	}
+
+	return true;
+}
+
+
+/*
+ * Lock and implode state subtree (li just initialized) in slices: if the
+ * first slice doesn't complete the implosion the root is frozen (its states
+ * are not processed by zm_go) and the implosion continue in the next zm_go.
+ */
+static void zm_implodeSliced(zm_VM *vm, zm_State *state, zm_LockAndImplode *li)
+{
+	size_t budget = vm->implosions.slice;
+	zm_Implosion im, *p;
+
+	im.li = *li;
+	im.phase = ZM_IMPLODE_LOCK;
+	im.root = zm_root(state);
+	im.parked = NULL;
+	im.next = NULL;
+
+	zm_queueAdd(im.li.deepstack, state, NULL);
+
+	if (zm_implodeSlice(vm, &im, &budget))
+		return;
+
+	ZM_D("implodeSliced - freeze root [ref %zx]", im.root);
+
+	p = zm_alloc(zm_Implosion);
+	*p = im;
+
+	zm_enableFlag(p->root, ZM_STATE_IMPLODING);
+
+	if (vm->implosions.last)
+		vm->implosions.last->next = p;
+	else
+		vm->implosions.first = p;
+
+	vm->implosions.last = p;
+}
+
+
+static void zm_implodeDone(zm_VM *vm, zm_Implosion *p, zm_Implosion *prev)
+{
+	if (prev)
+		prev->next = p->next;
+	else
+		vm->implosions.first = p->next;
+
+	if (vm->implosions.last == p)
+		vm->implosions.last = prev;
+
+	zm_disableFlag(p->root, ZM_STATE_IMPLODING);
+
+	if (p->parked) {
+		zm_State *s;
+
+		/* frozen states back to their worker (stored in next) */
+		while ((s = zm_queuePop0(p->parked, NULL)))
+			zm_linkState(vm, (zm_Worker*)s->next, s);
+
+		zm_queueFree(p->parked);
+	}
+
+	zm_free(zm_Implosion, p);
+}
+
+
+/*
+ * Move the current state of worker (a running state of a frozen root) out
+ * of the worker list: it's linked again by zm_implodeDone.
+ */
+static void zm_implodePark(zm_VM *vm, zm_Worker *worker, zm_State *state)
+{
+	zm_Implosion *p = vm->implosions.first;
+	zm_State *root = zm_root(state);
+
+	while (p->root != root)
+		p = p->next;
+
+	ZM_D("implodePark - state [ref %zx]", state);
+
+	vm->session.worker = worker;
+	vm->session.suspendop = 0;
+	zm_unlinkCurrentState(vm);
+
+	/* still running: the worker is stored in next as for suspend */
+	state->next = (zm_State*)worker;
+
+	if (!p->parked)
+		p->parked = zm_queueNew();
+
+	zm_queueAdd(p->parked, state, NULL);
+}
+
+
+/*
+ * continue the incremental implosions (max vm->implosions.slice states):
+ * it's done once for each zm_go cycle
+ */
+static void zm_implodeContinue(zm_VM *vm)
+{
+	size_t budget = vm->implosions.slice;
+	zm_Implosion *p;
+
+	while ((budget) && (p = vm->implosions.first)) {
+		if (!zm_implodeSlice(vm, p, &budget))
+			return;
+
+		zm_implodeDone(vm, p, NULL);
+	}
+}
+
+
+/*
+ * complete now the incremental implosion of root (if any): a new close
+ * operation over a frozen root must see its states just locked
+ */
+static void zm_implodeFlush(zm_VM *vm, zm_State *root)
+{
+	zm_Implosion *p = vm->implosions.first;
+	zm_Implosion *prev = NULL;
+
+	for (; p; prev = p, p = p->next) {
+		size_t budget = ZM_NOLIMIT;
+
+		if (p->root != root)
+			continue;
+
+		ZM_D("implodeFlush - root [ref %zx]", root);
+
+		zm_implodeSlice(vm, p, &budget);
+		zm_implodeDone(vm, p, prev);
+		return;
+	}
+}
+
+
 static int zm_hasReset(zm_State *s)
 {
 	return (s->on.c4tch) && zm_hasntFlag(s, ZM_STATE_CATCH);
@@ -2986,11 +3789,13 @@ static zm_State *zm_lockAndTrace(zm_VM *vm, zm_LockAndImplode *li, zm_State *s,
 		zm_lockByException(vm, li, s);
 
 		s = catcher;
-	} while (zm_hasntFlag(catcher, ZM_STATE_CATCH));
+	} while ((zm_hasntFlag(catcher, ZM_STATE_CATCH)) && (!zm_ext(catcher, join)));
 
 	ZM_D("lockAndImplodeByException - catch state = %zx", catcher);
 
-	zm_appendTrace(vm, e, catcher);
+	/* a join caller is traced when the exception is re-raised */
+	if (!zm_ext(catcher, join))
+		zm_appendTrace(vm, e, catcher);
 
 	return catcher;
 }
@@ -3005,6 +3810,9 @@ static void zm_lockAndImplodeByAbortException(zm_VM *vm, zm_State *state,
 
 	ZM_D("lockAndImplodeByException - %zx", state);
 
+	if (zm_hasFlag(zm_root(state), ZM_STATE_IMPLODING))
+		zm_implodeFlush(vm, zm_root(state));
+
 	if (zm_uncaughtException(vm, state, e)) {
 		return;
 	}
@@ -3022,8 +3830,14 @@ static void zm_lockAndImplodeByAbortException(zm_VM *vm, zm_State *state,
 	/* set the tail of the implosion */
 	li.chaintail = catcher;
 
-	/* set exception in catch state */
-	catcher->exception = e;
+	if (zm_ext(catcher, join)) {
+		/* a member of zmSUBALL/zmSUBANY: the exception is re-raised
+		   in the join caller when all members are returned */
+		e = zm_joinRaise(vm, catcher, e);
+	} else {
+		/* set exception in catch state */
+		catcher->exception = e;
+	}
 
 	/* precautional reset for zmDROP (serializeImplosion just reset it) */
 	e->beforecatch = NULL;
@@ -3055,6 +3869,16 @@ static void zm_lockAndImplodeBy(zm_VM *vm, zm_State *state, int implodeby,
 	li.filename = filename;
 	li.nline = nline;
 
+	#ifdef ZM_ENABLE_RECORDER
+	/* machine name is known only for the current task */
+	zm_record(vm, ZM_RECORD_CLOSE, state,
+	          (state == zm_getCurrentState(vm)) ?
+	          zm_getCurrentMachineName(vm) : NULL, 0, 0, 0);
+	#endif
+
+	if (zm_hasFlag(zm_root(state), ZM_STATE_IMPLODING))
+		zm_implodeFlush(vm, zm_root(state));
+
 	if (zm_isTask(state)) {
 		/* ptask */
 		if (!state->subtasks) {
@@ -3064,6 +3888,11 @@ static void zm_lockAndImplodeBy(zm_VM *vm, zm_State *state, int implodeby,
 
 		zm_initLockAndImplode(&li, implodeby);
 
+		if (vm->implosions.slice) {
+			zm_implodeSliced(vm, state, &li);
+			return;
+		}
+
 		zm_deepLock(vm, state, &li);
 
 		if (zm_isSyncImplode(&li))
@@ -3081,6 +3910,11 @@ static void zm_lockAndImplodeBy(zm_VM *vm, zm_State *state, int implodeby,
 		 */
 		li.chaintail = zm_getCaller(state);
 
+		if (vm->implosions.slice) {
+			zm_implodeSliced(vm, state, &li);
+			return;
+		}
+
 		/* calculate: from and to */
 		zm_deepLock(vm, state, &li);
 
@@ -3218,6 +4052,11 @@ static zm_yield_t zm_raiseException(zm_VM *vm, zm_Exception* e)
 	/* set exception */
 	state->exception = e;
 
+	#ifdef ZM_ENABLE_RECORDER
+	zm_record(vm, ZM_RECORD_RAISE, state, zm_getCurrentMachineName(vm),
+	          (uint32_t)e->code, e->kind, 0);
+	#endif
+
 	if (e->kind == ZM_EXCEPTION_ABORT)
 		return ZM_TASK_RAISE_ABORT_EXCEPTION;
 	else
@@ -3234,7 +4073,7 @@ static void zm_unraise(zm_VM *vm, zm_State* state, void *argument,
 
 	zm_setCaller(e->beforecatch, zm_getCurrentState(vm));
 
-	zm_free(zm_Exception, e);
+	zm_freeException(vm, e);
 
 	state->exception = NULL;
 }
@@ -3283,7 +4122,7 @@ void zm_uFree(zm_VM *vm, zm_Exception *e)
 {
 	switch(e->kind) {
 	case ZM_EXCEPTION_UNCAUGHT:
-		zm_freeTrace(e);
+		zm_freeTrace(vm, e);
 		break;
 
 	case ZM_EXCEPTION_ABORT:
@@ -3302,7 +4141,7 @@ void zm_uFree(zm_VM *vm, zm_Exception *e)
 
 	e->msg = NULL;
 	e->data = NULL;
-	zm_free(zm_Exception, e);
+	zm_freeException(vm, e);
 }
 
 
@@ -3398,7 +4237,7 @@ zm_yield_t izmEXCEPT(zm_VM *vm, int kind, int ecode, const char *msg,
 	const char *refname;
 	zm_Exception *e;
 
-	e = zm_newException( kind );
+	e = zm_newException(vm, kind);
 
 	if (kind == ZM_EXCEPTION_ABORT)
 		refname = "zmABORT";
@@ -3554,89 +4393,331 @@ uint8_t izmGetCloseOp(zm_VM *vm, const char *filename, int nline)
 
 
 /* ----------------------------------------------------------------------------
- *  EVENT                                                        (SECTION CORE)
+ *  TIMER                                                        (SECTION CORE)
  * --------------------------------------------------------------------------*/
 
+/*
+ * Timers of zmEVENT_TIMEOUT and zmSUB_DEADLINE are stored in a hashed
+ * timing wheel: slot
+ * (expire % ZM_TIMER_WHEEL) contains a double linked list of timers so
+ * insert and cancel (the event arrive before the timeout) are O(1).
+ * Timers are processed at the begin of zm_go (and in zm_poll).
+ */
 
+#define ZM_TIMER_MASK (ZM_TIMER_WHEEL - 1)
 
-static void zm_bindEvent(zm_Event *event, zm_State *s)
-{
 
-	zm_EventBinder *evb = zm_alloc(zm_EventBinder);
+static void zm_deadlineExpired(zm_VM *vm, zm_State *c);
 
-	zm_enableFlag(s, ZM_STATE_EVENTLOCKED);
 
-	/* save state->next in event binder (now contain next state) */
-	evb->statenext = (void*)s->next;
+static uint64_t zm_defaultClock(zm_VM *vm)
+{
+	#if defined(_POSIX_TIMERS) && (_POSIX_TIMERS > 0)
+	struct timespec ts;
 
-	/* save evb inside state next (to allow switch in busy_waiting_event)*/
-	s->next = (zm_State*)evb;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
 
-	/* In ZM_TASK_BUSY_WAITING_EVENT state->next will be temporary
-	 * recovered using statenext to call zm_suspendCurrentState
-	 * that replace state->next with the worker. After worker
-	 * in state->next will be saved (again) in evb->statenext and
-	 * state->next will be replaced with evb    #EVENT_BIND
-	 *
-	 * during this transaction state have event flag [we] but not
-	 * waiting flag #EVB_FLAG
-	 */
+	return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+	#else
+	/* second resolution: use zm_setClock for a better clock */
+	return (uint64_t)time(NULL) * 1000;
+	#endif
+}
 
-	evb->event = event;
-	evb->owner = s;
-	event->count++;
 
+#ifdef ZM_NANOTIME
+/* monotonic nanoseconds (statistics, latency, trace and profile) */
+static uint64_t zm_nanotime()
+{
+	#if defined(_POSIX_TIMERS) && (_POSIX_TIMERS > 0)
+	struct timespec ts;
 
-	if (!event->bindlist) {
-		evb->next = evb; /* ring */
-		evb->prev = evb;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
 
-		event->bindlist = evb;
-	} else {
-		evb->prev = event->bindlist->prev;
-		evb->next = event->bindlist;
+	return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+	#else
+	return (uint64_t)clock() * (1000000000 / CLOCKS_PER_SEC);
+	#endif
+}
+#endif
 
-		event->bindlist->prev->next = evb;
-		event->bindlist->prev = evb;
+
+void zm_setClock(zm_VM *vm, zm_clock_cb clock)
+{
+	if (vm->timers.count) {
+		zm_fatalInit(vm, "zm_setClock");
+		zm_fatalDo(ZM_FATAL_GCODE, "SETCLK.TM",
+		           "cannot change clock with active timers");
 	}
+
+	vm->timers.clock = clock;
 }
 
 
-static const char* zm_getUnbindEventScope(int flag)
+uint64_t zm_now(zm_VM *vm)
 {
-	if (flag & ZM_EVENT_UNBIND_REQUEST)
-		return "ZM_UNBIND_REQUEST";
+	if (vm->timers.clock)
+		return vm->timers.clock(vm);
 
-	if (flag & ZM_EVENT_UNBIND_ABORT)
-		return "ZM_UNBIND_ABORT";
-
-	/* this is impossible because unbindEvent is call only in lock and
-	   implode and in unbind request with defined (const) scope value */
-	return "[internal error]";
+	return zm_defaultClock(vm);
 }
 
 
-/* note: event binder free evb reference*/
-static void zm_unbindEvent(zm_VM* vm, zm_State *s, void* argument, int scope)
+static zm_Timer* zm_addTimer(zm_VM *vm, unsigned int ms)
 {
-	zm_EventBinder *evb = ((zm_EventBinder*)s->next);
-	int unbindscope = (scope & ZM_EVENT_UNBIND);
+	zm_Timer *t = vm->timers.freelist;
+	uint64_t now = zm_now(vm);
+	zm_Timer **slot;
 
-	ZM_D("zm_unbindEvent: check flag");
+	if (!vm->timers.wheel) {
+		size_t i;
 
-	if (s->flag & ZM_STATE_EVENTLOCKED) {
-		zm_disableFlag(s, ZM_STATE_EVENTLOCKED);
-	} else {
-		zm_fatalInit(vm, NULL);
-		zm_fatalDo(ZM_FATAL_U1, "UNBNDEV",
-		           "zm_State doesn't have a binded event (scope = %s)",
-		           zm_getUnbindEventScope(unbindscope));
+		vm->timers.wheel = zm_nalloc(zm_Timer*, ZM_TIMER_WHEEL);
+
+		for (i = 0; i < ZM_TIMER_WHEEL; i++)
+			vm->timers.wheel[i] = NULL;
 	}
 
-	if ((unbindscope) && (evb->event->evcb))
-		evb->event->evcb(vm, unbindscope, evb->event, s, argument);
+	if (t)
+		vm->timers.freelist = t->next;
+	else
+		t = zm_alloc(zm_Timer);
+
+	if (!vm->timers.count)
+		vm->timers.last = now;
+
+	/* slots until `last` are just processed */
+	t->expire = now + ms;
+	if (t->expire <= vm->timers.last)
+		t->expire = vm->timers.last + 1;
+
+	t->waiting = NULL;
+	t->deadline = NULL;
+
+	slot = &vm->timers.wheel[t->expire & ZM_TIMER_MASK];
+
+	t->prev = NULL;
+	t->next = *slot;
+
+	if (*slot)
+		(*slot)->prev = t;
+
+	*slot = t;
+
+	vm->timers.count++;
+
+	return t;
+}
+
+
+static void zm_cancelTimer(zm_VM *vm, zm_Timer *t)
+{
+	if (t->prev)
+		t->prev->next = t->next;
+	else
+		vm->timers.wheel[t->expire & ZM_TIMER_MASK] = t->next;
+
+	if (t->next)
+		t->next->prev = t->prev;
+
+	if (t->waiting)
+		t->waiting->ext->timer = NULL;
+	else if ((t->deadline) && (t->deadline->ext->join))
+		t->deadline->ext->join->timer = NULL;
+
+	t->waiting = NULL;
+	t->deadline = NULL;
+
+	vm->timers.count--;
+
+	/* reuse */
+	t->next = vm->timers.freelist;
+	vm->timers.freelist = t;
+}
+
+
+/*
+ * Move the expired timers of a slot to the list after head: head is not a
+ * wheel slot (head->prev is never NULL) so zm_cancelTimer remove them
+ * from the expired list too.
+ */
+static void zm_expireSlot(zm_Timer **slot, zm_Timer *head, uint64_t now)
+{
+	zm_Timer *t = *slot;
+
+	while (t) {
+		zm_Timer *next = t->next;
+
+		/* other timers are in the next turns */
+		if (t->expire <= now) {
+			if (t->prev)
+				t->prev->next = t->next;
+			else
+				*slot = t->next;
+
+			if (t->next)
+				t->next->prev = t->prev;
+
+			t->prev = head;
+			t->next = head->next;
+
+			if (head->next)
+				head->next->prev = t;
+
+			head->next = t;
+		}
+
+		t = next;
+	}
+}
+
+
+/*
+ * unbind tasks with expired timer, return the number of resumed tasks
+ */
+static size_t zm_processTimers(zm_VM *vm)
+{
+	uint64_t now = zm_now(vm);
+	uint64_t tick, end;
+	size_t count = 0;
+	zm_Timer expired;
+
+	if ((!vm->timers.count) || (now <= vm->timers.last))
+		return 0;
+
+	/* a full turn check all slots */
+	tick = vm->timers.last + 1;
+	end = (now - vm->timers.last >= ZM_TIMER_WHEEL) ?
+	      tick + ZM_TIMER_WHEEL - 1 : now;
+
+	for (; (tick <= end) && (vm->timers.count); tick++) {
+		zm_Timer *t;
+
+		expired.next = NULL;
+		zm_expireSlot(&vm->timers.wheel[tick & ZM_TIMER_MASK], &expired, now);
+
+		/* a callback can cancel the other expired timers */
+		while ((t = expired.next)) {
+			if (t->waiting) {
+				ZM_D("zm_processTimers: timeout");
+				/* unbind cancel the timer */
+				zm_unbindEvent(vm, t->waiting, ZM_TIMEOUT,
+				               ZM_EVENT_UNBIND_REQUEST);
+				count++;
+			} else {
+				zm_State *c = t->deadline;
+
+				ZM_D("zm_processTimers: deadline");
+				/* the close of the subtask can cancel the deadlines
+				   of the nested zmSUB_DEADLINE */
+				zm_cancelTimer(vm, t);
+				zm_deadlineExpired(vm, c);
+				count++;
+			}
+		}
+	}
+
+	vm->timers.last = now;
+
+	return count;
+}
+
+
+/*
+ * Return the milliseconds to the next timeout (-1 if there aren't timers)
+ */
+int zm_nextTimeout(zm_VM *vm)
+{
+	uint64_t now, tick;
+
+	if (!vm->timers.count)
+		return -1;
+
+	now = zm_now(vm);
+
+	for (tick = vm->timers.last + 1;
+	     tick <= vm->timers.last + ZM_TIMER_WHEEL; tick++) {
+		zm_Timer *t = vm->timers.wheel[tick & ZM_TIMER_MASK];
+
+		for (; t; t = t->next) {
+			if (t->expire <= tick)
+				return (tick <= now) ? 0 : (int)(tick - now);
+		}
+	}
+
+	/* nothing in this turn */
+	tick = vm->timers.last + ZM_TIMER_WHEEL;
+	return (tick <= now) ? 0 : (int)(tick - now);
+}
+
+
+static void zm_freeTimers(zm_VM *vm)
+{
+	zm_Timer *t = vm->timers.freelist;
+
+	while (t) {
+		zm_Timer *next = t->next;
+		zm_free(zm_Timer, t);
+		t = next;
+	}
+
+	if (vm->timers.wheel)
+		zm_nfree(zm_Timer*, ZM_TIMER_WHEEL, vm->timers.wheel);
+}
+
+
+
+/* ----------------------------------------------------------------------------
+ *  EVENT                                                        (SECTION CORE)
+ * --------------------------------------------------------------------------*/
+
+
+
+static void zm_lockOnBinder(zm_State *s, zm_EventBinder *evb)
+{
+	zm_enableFlag(s, ZM_STATE_EVENTLOCKED);
+
+	/* save state->next in event binder (now contain next state) */
+	evb->statenext = (void*)s->next;
+
+	/* save evb inside state next (to allow switch in busy_waiting_event)*/
+	s->next = (zm_State*)evb;
+
+	/* In ZM_TASK_BUSY_WAITING_EVENT state->next will be temporary
+	 * recovered using statenext to call zm_suspendCurrentState
+	 * that replace state->next with the worker. After worker
+	 * in state->next will be saved (again) in evb->statenext and
+	 * state->next will be replaced with evb    #EVENT_BIND
+	 *
+	 * during this transaction state have event flag [we] but not
+	 * waiting flag #EVB_FLAG
+	 */
+}
+
+
+static void zm_addBinder(zm_Event *event, zm_EventBinder *evb)
+{
+	evb->event = event;
+	event->count++;
+
+
+	if (!event->bindlist) {
+		evb->next = evb; /* ring */
+		evb->prev = evb;
+
+		event->bindlist = evb;
+	} else {
+		evb->prev = event->bindlist->prev;
+		evb->next = event->bindlist;
+
+		event->bindlist->prev->next = evb;
+		event->bindlist->prev = evb;
+	}
+}
 
 
+static void zm_removeBinder(zm_EventBinder *evb)
+{
 	/* check if evb is the first element of the bindlist*/
 	if (evb->event->bindlist == evb) {
 		if (evb->event->bindlist->next == evb) {
@@ -3656,8 +4737,85 @@ static void zm_unbindEvent(zm_VM* vm, zm_State *s, void* argument, int scope)
 	}
 
 	evb->event->count--;
+}
+
+
+/* the subscription of the owner of evb (NULL for a one-shot bind) */
+static zm_Subscription* zm_subscriptionOf(zm_EventBinder *evb)
+{
+	zm_Subscription *sub = zm_ext(evb->owner, subscription);
+
+	return ((sub) && (&sub->evb == evb)) ? sub : NULL;
+}
+
+
+static void zm_bindEvent(zm_Event *event, zm_State *s)
+{
+	zm_EventBinder *evb = zm_alloc(zm_EventBinder);
+
+	evb->owner = s;
+
+	zm_lockOnBinder(s, evb);
+	zm_addBinder(event, evb);
+}
+
+
+static const char* zm_getUnbindEventScope(int flag)
+{
+	if (flag & ZM_EVENT_UNBIND_REQUEST)
+		return "ZM_UNBIND_REQUEST";
+
+	if (flag & ZM_EVENT_UNBIND_ABORT)
+		return "ZM_UNBIND_ABORT";
+
+	/* this is impossible because unbindEvent is call only in lock and
+	   implode and in unbind request with defined (const) scope value */
+	return "[internal error]";
+}
+
+
+/* note: event binder free evb reference*/
+static void zm_unbindEvent(zm_VM* vm, zm_State *s, void* argument, int scope)
+{
+	zm_EventBinder *evb = ((zm_EventBinder*)s->next);
+	zm_Subscription *sub = zm_subscriptionOf(evb);
+	int unbindscope = (scope & ZM_EVENT_UNBIND);
+
+	ZM_D("zm_unbindEvent: check flag");
+
+	if (s->flag & ZM_STATE_EVENTLOCKED) {
+		zm_disableFlag(s, ZM_STATE_EVENTLOCKED);
+	} else {
+		zm_fatalInit(vm, NULL);
+		zm_fatalDo(ZM_FATAL_U1, "UNBNDEV",
+		           "zm_State doesn't have a binded event (scope = %s)",
+		           zm_getUnbindEventScope(unbindscope));
+	}
+
+	if ((unbindscope) && (evb->event->evcb))
+		evb->event->evcb(vm, unbindscope, evb->event, s, argument);
+
 	s->next = (zm_State*)evb->statenext;
 
+	/* event before timeout (or timeout itself) */
+	if (zm_ext(s, timer))
+		zm_cancelTimer(vm, s->ext->timer);
+
+	if ((sub) && (!unbindscope)) {
+		/* trigger a subscription: evb still in bindlist */
+		sub->flag &= ~ZM_EVB_WAITING;
+
+		ZM_D("zm_unbindEvent: resume subscriber");
+		zm_resumeState(vm, s);
+		zm_setArgument(s, argument);
+		return;
+	}
+
+	zm_removeBinder(evb);
+
+	if (sub)
+		s->ext->subscription = NULL;
+
 	if ((unbindscope) && (s->on.iter))
 		s->on.resume = s->on.iter;
 
@@ -3667,7 +4825,10 @@ static void zm_unbindEvent(zm_VM* vm, zm_State *s, void* argument, int scope)
 	zm_setArgument(s, argument);
 
 	ZM_D("zm_unbindEvent: free event binder");
-	zm_free(zm_EventBinder, evb);
+	if (sub)
+		zm_free(zm_Subscription, sub);
+	else
+		zm_free(zm_EventBinder, evb);
 
 	ZM_D("zm_unbindEvent: end");
 }
@@ -3689,12 +4850,23 @@ static void zm_triggerWrongReturn(zm_VM *vm, int r)
 }
 
 
-static int zm_triggerEVB(zm_VM *vm, zm_EventBinder *evb, void *arg)
+/*
+ * Trigger a binder with arg: *resumed is set to true only if its task is
+ * resumed (a coalesced subscription or a refused trigger doesn't count).
+ * last is the argument of the last trigger of a run of the same event
+ * (see zm_triggerBatch): a resumed subscription with last != arg keep
+ * a pending trigger with last (as the following triggers would do).
+ */
+static int zm_triggerEVB(zm_VM *vm, zm_EventBinder *evb, void *arg,
+                         void *last, int repeat, int *resumed)
 {
 	zm_Event *event = evb->event;
 	zm_State *s = evb->owner;
+	zm_Subscription *sub = zm_subscriptionOf(evb);
 	int r = ZM_EVENT_ACCEPTED;
 
+	*resumed = false;
+
 	if (zm_hasFlag(event, ZM_EVENT_TRIGGER) && (event->evcb)) {
 		ZM_D("zm_trigger: cb(state = [ref %zx])", s);
 
@@ -3710,8 +4882,25 @@ static int zm_triggerEVB(zm_VM *vm, zm_EventBinder *evb, void *arg)
 			return r;
 	}
 
-	/* no trigger callback: resume state */
+	if ((sub) && !(sub->flag & ZM_EVB_WAITING)) {
+		/* subscriber is running (or waiting something else):
+		   coalesce with other triggers, last argument win */
+		ZM_D("zm_trigger: coalesce (state = [ref %zx])", s);
+		sub->flag |= ZM_EVB_PENDING;
+		sub->arg = last;
+		return r;
+	}
+
+	/* no trigger callback: resume state (a subscription binder is not
+	   free by the unbind) */
 	zm_unbindEvent(vm, s, arg, ZM_EVENT_TRIGGER | ZM_EVENT_ACCEPTED);
+	*resumed = true;
+
+	if ((repeat) && (sub)) {
+		/* the other triggers of the run coalesce */
+		sub->flag |= ZM_EVB_PENDING;
+		sub->arg = last;
+	}
 
 	return r;
 }
@@ -3732,13 +4921,21 @@ static int zm_trigger0(zm_VM *vm, zm_Event *event, void *arg)
 
 
 /*
- * argument will be passed to trigger callback (if set) and as zmarg to
- * binded tasks that will accept this event
+ * Trigger event resuming max `max` accepting tasks. repeat is true when
+ * the trigger stand for a run of triggers of the same event (argument is
+ * the first argument and last the last one, see zm_triggerBatch).
  */
-size_t zm_trigger(zm_VM *vm, zm_Event *event, void *argument)
+static size_t zm_triggerFetch0(zm_VM *vm, zm_Event *event, void *argument,
+                               void *last, int repeat, size_t max)
 {
 	zm_EventBinder *evb, *nextevb;
-	int r, n, count = 0;
+	size_t count = 0;
+	int r, n, resumed;
+
+	/* nothing to do: no callback to call and no task to resume */
+	if ((!event->bindlist) && !(zm_hasFlag(event, ZM_EVENT_TRIGGER) &&
+	                            (event->evcb)))
+		return 0;
 
 	ZM_D("zm_trigger: PRE-FETCH");
 
@@ -3763,7 +4960,7 @@ size_t zm_trigger(zm_VM *vm, zm_Event *event, void *argument)
 
 	evb = event->bindlist;
 
-	if (!evb)
+	if ((!evb) || (!max))
 		return 0;
 
 	n = event->count;
@@ -3778,11 +4975,11 @@ size_t zm_trigger(zm_VM *vm, zm_Event *event, void *argument)
 		 * situation do-while end */
 		nextevb = evb->next;
 
-		r = zm_triggerEVB(vm, evb, argument);
-
-		if (r & ZM_EVENT_ACCEPTED)
-			count++;
+		r = zm_triggerEVB(vm, evb, argument, last, repeat, &resumed);
 
+		/* reached the max number of task to resume */
+		if ((resumed) && (++count == max))
+			break;
 
 		if (r & ZM_EVENT_STOP) /* stop fetching other task */
 			break;
@@ -3795,60 +4992,229 @@ size_t zm_trigger(zm_VM *vm, zm_Event *event, void *argument)
 }
 
 
-zm_Event* zm_newEvent(void *data)
+#ifdef ZM_ENABLE_TRACE
+static void zm_traceTrigger(zm_VM *vm, zm_Event *event, size_t count);
+#endif
+
+
+static size_t zm_triggerFetch(zm_VM *vm, zm_Event *event, void *argument,
+                              void *last, int repeat, size_t max)
 {
-	zm_Event *event = zm_alloc(zm_Event);
+	#if defined(ZM_ENABLE_TRACE) || defined(ZM_ENABLE_RECORDER)
+	size_t count = zm_triggerFetch0(vm, event, argument, last, repeat,
+	                                max);
 
-	event->bindlist = NULL;
-	event->count = 0;
-	event->flag = 0;
-	event->evcb = NULL;
-	event->data = data;
+	#ifdef ZM_ENABLE_TRACE
+	zm_traceTrigger(vm, event, count);
+	#endif
 
-	return event;
+	#ifdef ZM_ENABLE_RECORDER
+	zm_record(vm, ZM_RECORD_TRIGGER, event, NULL, (uint32_t)count, 0, 0);
+	#endif
+
+	return count;
+	#else
+	return zm_triggerFetch0(vm, event, argument, last, repeat, max);
+	#endif
 }
 
 
-void zm_setEventCB(zm_VM *vm, zm_Event* event, zm_event_cb cb, int scope)
+/*
+ * argument will be passed to trigger callback (if set) and as zmarg to
+ * binded tasks that will accept this event
+ */
+size_t zm_trigger(zm_VM *vm, zm_Event *event, void *argument)
 {
-	/* TODO check consitency between cb and scope argument */
-	event->flag = scope;
-	event->evcb = cb;
+	return zm_triggerFetch(vm, event, argument, argument, false,
+	                       (size_t)-1);
 }
 
 
-size_t zm_unbindAll(zm_VM *vm, zm_Event *event, void *argument)
+/*
+ * as zm_trigger but resume max `k` tasks: the other binded tasks still
+ * wait (in the same order)
+ */
+size_t zm_triggerN(zm_VM *vm, zm_Event *event, void *argument, size_t k)
 {
-	size_t n = event->count;
+	return zm_triggerFetch(vm, event, argument, argument, false, k);
+}
 
-	while(event->bindlist) {
-		zm_State *s = event->bindlist->owner;
-		zm_unbindEvent(vm, s, argument, ZM_EVENT_UNBIND_REQUEST);
-	}
 
-	#ifdef ZM_CHECK_CONSISTENCY
-	if (event->count != 0) {
-		zm_fatalInit(vm, NULL);
-		zm_fatalDo(ZM_FATAL_U1, "UNBIND.STL",
-			   "event counter bind list not 0 after unbind all");
+/*
+ * trigger events[i] with arguments[i] (arguments can be NULL) for i in
+ * [0, n). A run of equal consecutive events without a trigger callback is
+ * triggered once (one walk of the binders) with the first argument of the
+ * run: the triggers after the first would find only the subscriptions,
+ * that coalesce with the last argument. An event with a trigger callback
+ * is triggered once per element (the callback accept, refuse or stop each
+ * argument). Return the total number of resumed tasks.
+ */
+size_t zm_triggerBatch(zm_VM *vm, zm_Event **events, void **arguments,
+                       size_t n)
+{
+	size_t i = 0, j, count = 0;
+
+	while (i < n) {
+		j = i + 1;
+
+		if (!(zm_hasFlag(events[i], ZM_EVENT_TRIGGER) && (events[i]->evcb)))
+			for (; (j < n) && (events[j] == events[i]); j++)
+				;
+
+		count += zm_triggerFetch(vm, events[i],
+		                         (arguments) ? arguments[i] : NULL,
+		                         (arguments) ? arguments[j - 1] : NULL,
+		                         (j - i > 1), (size_t)-1);
+		i = j;
 	}
-	#endif
 
-	return n;
+	return count;
 }
 
 
-size_t zm_unbind(zm_VM *vm, zm_Event *event, zm_State* s, void *argument)
+static void zm_initEvent(zm_Event *event, void *data)
 {
+	event->bindlist = NULL;
+	event->count = 0;
+	event->flag = 0;
+	event->evcb = NULL;
+	event->data = data;
+}
+
+
+zm_Event* zm_newEvent(void *data)
+{
+	zm_Event *event = zm_alloc(zm_Event);
+
+	zm_initEvent(event, data);
+
+	return event;
+}
+
+
+void zm_setEventCB(zm_VM *vm, zm_Event* event, zm_event_cb cb, int scope)
+{
+	/* TODO check consitency between cb and scope argument */
+	event->flag = scope | (event->flag & ZM_EVENT_FD);
+	event->evcb = cb;
+}
+
+
+/*
+ * Remove a not waiting subscriber from the bindlist: the unbind will be
+ * notified to the owner at next zmSUBSCRIBE
+ */
+static void zm_detachSubscription(zm_VM *vm, zm_Subscription *sub,
+                                  void *argument, int scope)
+{
+	zm_EventBinder *evb = &sub->evb;
+
+	if (evb->event->evcb)
+		evb->event->evcb(vm, scope, evb->event, evb->owner, argument);
+
+	zm_removeBinder(evb);
+
+	sub->flag = (sub->flag & ~ZM_EVB_PENDING) | ZM_EVB_UNBOUND;
+	sub->arg = argument;
+}
+
+
+static void zm_unbindBinder(zm_VM *vm, zm_EventBinder *evb, void *argument,
+                            int scope)
+{
+	zm_Subscription *sub = zm_subscriptionOf(evb);
+
+	if ((sub) && !(sub->flag & ZM_EVB_WAITING))
+		zm_detachSubscription(vm, sub, argument, scope);
+	else
+		zm_unbindEvent(vm, evb->owner, argument, scope);
+}
+
+
+/*
+ * free the subscription of a not waiting task (scope 0: without the
+ * unbind callback)
+ */
+static void zm_dropSubscription(zm_VM *vm, zm_State *s, void *argument,
+                                int scope)
+{
+	zm_Subscription *sub = s->ext->subscription;
+	zm_EventBinder *evb = &sub->evb;
+
+	if (!(sub->flag & ZM_EVB_UNBOUND)) {
+		if ((scope) && (evb->event->evcb))
+			evb->event->evcb(vm, scope, evb->event, s, argument);
+
+		zm_removeBinder(evb);
+	}
+
+	s->ext->subscription = NULL;
+	zm_free(zm_Subscription, sub);
+}
+
+
+size_t zm_unbindAll(zm_VM *vm, zm_Event *event, void *argument)
+{
+	size_t n = event->count;
+
+	while(event->bindlist)
+		zm_unbindBinder(vm, event->bindlist, argument,
+		                ZM_EVENT_UNBIND_REQUEST);
+
+	#ifdef ZM_CHECK_CONSISTENCY
+	if (event->count != 0) {
+		zm_fatalInit(vm, NULL);
+		zm_fatalDo(ZM_FATAL_U1, "UNBIND.STL",
+			   "event counter bind list not 0 after unbind all");
+	}
+	#endif
+
+	return n;
+}
+
+
+size_t zm_unbind(zm_VM *vm, zm_Event *event, zm_State* s, void *argument)
+{
+	zm_Subscription *sub = zm_ext(s, subscription);
+
+	/* running subscriber */
+	if ((sub) && (sub->evb.event == event) &&
+	    !(sub->flag & (ZM_EVB_WAITING | ZM_EVB_UNBOUND))) {
+		zm_detachSubscription(vm, sub, argument,
+		                      ZM_EVENT_UNBIND_REQUEST);
+		return 1;
+	}
+
+	if (zm_hasntFlag(s, ZM_STATE_EVENTLOCKED))
+		return 0;
 
-	if (zm_hasntFlag(s, ZM_STATE_EVENTLOCKED))
-		return 0;
-
 	zm_unbindEvent(vm, s, argument, ZM_EVENT_UNBIND_REQUEST);
 	return 1;
 }
 
 
+/*
+ * Remove the persistent subscription of `s` (a subscriber waiting the event
+ * is unbinded as in zm_unbind). Return 0 if `s` hasn't a subscription.
+ */
+size_t zm_unsubscribe(zm_VM *vm, zm_State* s, void *argument)
+{
+	zm_Subscription *sub = zm_ext(s, subscription);
+
+	if (!sub)
+		return 0;
+
+	if (sub->flag & ZM_EVB_WAITING) {
+		zm_unbindEvent(vm, s, argument, ZM_EVENT_UNBIND_REQUEST);
+		return 1;
+	}
+
+	zm_dropSubscription(vm, s, argument, ZM_EVENT_UNBIND_REQUEST);
+
+	return 1;
+}
+
+
 void zm_freeEvent(zm_VM *vm, zm_Event *event)
 {
 	if (event->count) {
@@ -3889,686 +5255,2876 @@ zm_yield_t izmEVENT(zm_VM* vm, zm_Event *e, const char *filename, int nline)
 }
 
 
-/* ----------------------------------------------------------------------------
- *  MACHINE & WORKER                                             (SECTION CORE)
- * --------------------------------------------------------------------------*/
-
-#ifdef ZM_BYTE_ORDER_RUNTIME
-static zm_Yield zm_r2Y(zm_yield_t n)
+/*
+ * yield to event with timeout: if the event is not triggered in `ms`
+ * milliseconds the task is unbinded (as zm_unbind) with ZM_TIMEOUT as
+ * resume argument
+ */
+zm_yield_t izmEVENT_TIMEOUT(zm_VM* vm, zm_Event *e, unsigned int ms,
+                            const char *filename, int nline)
 {
-	zm_Yield y;
+	zm_yield_t r = izmEVENT(vm, e, filename, nline);
+	zm_State *s = zm_getCurrentState(vm);
+	zm_Timer *t = zm_addTimer(vm, ms);
 
-	y.resume = n & 0xFF;
-	y.c4tch = (n >> 8) & 0xFF;
-	y.iter = (n >> 16) & 0xFF;
-	y.cmd = (n >> 24) & 0xFF;
+	t->waiting = s;
+	zm_stateExt(s)->timer = t;
 
-	return y;
-}
-#else
-static zm_Yield zm_r2Y(zm_yield_t n)
-{
-	return (zm_Yield)n;
+	return r;
 }
+
+
+#ifdef ZM_ENABLE_EPOLL
+static void zm_armFdEvent(zm_VM *vm, zm_FdEvent *fe, const char *ref,
+                          const char *fn, int nl);
 #endif
 
 
-static void zm_machineInit(zm_Machine *machine)
+/*
+ * yield to event with a persistent bind: the task remain in the event
+ * bindlist after the trigger and the triggers arrived while the task is
+ * running are coalesced in the next zmSUBSCRIBE (that doesn't suspend).
+ */
+zm_yield_t izmSUBSCRIBE(zm_VM* vm, zm_Event *e, const char *filename,
+                        int nline)
 {
-	zm_lockOn(NULL);
-	if (machine->id == -1)
-		machine->id = zmg_mcounter++;
-	zm_lockOff(NULL);
-}
+	zm_State *s = zm_getCurrentState(vm);
+	zm_Subscription *sub = zm_ext(s, subscription);
 
+	ZM_ASSERT_VMLOCK("SUBSCR.VLCK", "zmSUBSCRIBE", filename, nline);
 
-static zm_Yield zm_machineStep(zm_VM *vm, zm_Worker *worker, zm_State *s)
-{
-	zm_yield_t n;
+	if (s->flag & ZM_STATE_EVENTLOCKED) {
+		zm_fatalInitAt(vm, "zmSUBSCRIBE", filename, nline);
+		zm_fatalDo(ZM_FATAL_YCODE, "SUBSCR.1",
+		           "this state is just associated to an event");
+	}
 
-	vm->plock = true;
+	if (sub) {
+		if (sub->flag & (ZM_EVB_PENDING | ZM_EVB_UNBOUND))
+			return ZM_TASK_EVENT_READY;
 
-	n = (worker->machine->fun)(vm, s->on.resume, s->rearg);
+		if (sub->evb.event != e) {
+			zm_fatalInitAt(vm, "zmSUBSCRIBE", filename, nline);
+			zm_fatalDo(ZM_FATAL_YCODE, "SUBSCR.2",
+			           "task is just subscribed to another event");
+		}
+	} else {
+		ZM_D("zmSUBSCRIBE - new subscription: [ref %zx]", s);
 
-	vm->plock = false;
+		sub = zm_alloc(zm_Subscription);
+		sub->evb.owner = s;
+		sub->flag = ZM_EVB_SUBSCRIPTION;
+		sub->arg = NULL;
 
-	s->rearg = NULL;
+		zm_addBinder(e, &sub->evb);
+		zm_stateExt(s)->subscription = sub;
+	}
 
-	return zm_r2Y(n);
+	#ifdef ZM_ENABLE_EPOLL
+	/* an fd-event is disabled at each readiness (oneshot): re-arm it */
+	if (zm_hasFlag(e, ZM_EVENT_FD))
+		zm_armFdEvent(vm, (zm_FdEvent*)e->data, "zmSUBSCRIBE",
+		              filename, nline);
+	#endif
+
+	sub->flag |= ZM_EVB_WAITING;
+	zm_lockOnBinder(s, &sub->evb);
+
+	return ZM_TASK_BUSY_WAITING_EVENT;
 }
 
 
-static zm_Yield zm_machineStep0(zm_VM *vm, zm_Worker *worker, zm_State *s)
-{
-	zm_State *savestate = vm->session.state;
-	zm_Worker *saveworker = vm->session.worker;
-	int savelock = vm->plock;
-	zm_yield_t n;
+/* ----------------------------------------------------------------------------
+ *  JOIN                                                         (SECTION CORE)
+ * --------------------------------------------------------------------------*/
 
-	/*if (sub) not sure about this FIXME
-		zm_setCaller(s, zm_getCurrentState(vm)); */
+/*
+ * Push in q the subtasks of c that have c as caller: the members of a
+ * join (zmSUBALL, zmSUBANY) or the subtask waited by c.
+ */
+static void zm_cancelPush(zm_StateQueue *q, zm_State *c)
+{
+	zm_State *sub = c->subtasks;
 
-	vm->plock = true;
-	vm->session.worker = worker;
-	vm->session.state = s;
+	if (!sub)
+		return;
 
-	n = (worker->machine->fun)(vm, ZM_INIT, NULL);
+	do {
+		if (zm_getCaller(sub) == c)
+			zm_queueAdd(q, sub, NULL);
 
-	vm->session.state = savestate;
-	vm->session.worker = saveworker;
-	vm->plock = savelock;
+		sub = sub->siblings.next;
+	} while (sub != c->subtasks);
+}
 
-	/* if (sub)
-		zm_setCaller(s, NULL); */
 
-	return zm_r2Y(n);
+/*
+ * Bring a cancelled state to its next step
+ */
+static void zm_cancelWake(zm_VM *vm, zm_StateQueue *q, zm_State *s)
+{
+	if (zm_hasFlag(s, ZM_STATE_EVENTLOCKED)) {
+		zm_unbindEvent(vm, s, NULL, ZM_EVENT_UNBIND_ABORT);
+	} else if (zm_hasFlag(s, ZM_STATE_WAITING)) {
+		/* closed when its subtask (or join) return */
+		zm_cancelPush(q, s);
+	} else if (zm_hasFlag(s, ZM_STATE_RUN)) {
+		return;
+	} else if (zm_isTask(s)) {
+		zm_resumeState(vm, s);
+	} else {
+		/* a suspended subtask (just returned to the caller) is
+		   closed with its parent */
+		zm_disableFlag(s, ZM_STATE_CANCEL);
+	}
 }
 
 
 /*
- * MWH: Machine Worker Hashtable
+ * Request a forced zmTERM to each state in q (and to the subtasks they
+ * are waiting for). The TERM is processed at the next step of the state
+ * so the normal lock-and-implode rules hold (see zm_cancelYield).
  */
-static void zm_mwhInit(zm_VM *vm)
+static void zm_cancelQueue(zm_VM *vm, zm_StateQueue *q)
 {
-	/* hlist in MT can be initalized too small (if others threads perform
-	   many counter increments) anyway mwhAdd will resize it in a MT-safe
-	   way */
-	size_t len = zmg_mcounter + ZM_MACHINE_HLIST_INC;
+	zm_State *s;
 
-	vm->mwh.len = len;
+	while ((s = zm_queuePop0(q, NULL))) {
+		if ((s->pmode != ZM_PMODE_NORMAL) ||
+		    (zm_hasFlag(s, ZM_STATE_IMPLOSIONLOCK | ZM_STATE_CANCEL)))
+			continue;
 
-	vm->mwh.hlist = zm_nalloc(zm_Worker*, len);
+		ZM_D("cancel: %zx", s);
 
-	memset(vm->mwh.hlist, 0, len * sizeof(zm_Worker*));
+		zm_enableFlag(s, ZM_STATE_CANCEL);
+
+		zm_cancelWake(vm, q, s);
+	}
 
+	zm_queueFree(q);
 }
 
 
-static void zm_mwhFree(zm_VM *vm)
+static void zm_cancelState(zm_VM *vm, zm_State *s)
 {
-	zm_nfree(zm_Worker *, vm->mwh.len, vm->mwh.hlist);
+	zm_StateQueue *q = zm_queueNew();
+
+	zm_queueAdd(q, s, NULL);
+	zm_cancelQueue(vm, q);
 }
 
 
-static zm_Worker* zm_mwhGet(zm_VM *vm, zm_Machine *machine)
+/*
+ * A state cancelled while it was running has just yield: if it has been
+ * suspended (or bound to an event) wake it to process the cancel.
+ */
+static void zm_cancelAfterYield(zm_VM *vm, zm_State *s)
 {
-	/* uninitialized machine*/
-	if (machine->id == -1)
-		return NULL;
+	zm_StateQueue *q;
 
-	/* chek if associative array must grow */
-	if (machine->id >= vm->mwh.len)
-		return NULL;
+	if ((s->pmode != ZM_PMODE_NORMAL) ||
+	    (zm_hasFlag(s, ZM_STATE_IMPLOSIONLOCK)))
+		return;
 
-	return vm->mwh.hlist[machine->id];
+	q = zm_queueNew();
+	zm_cancelWake(vm, q, s);
+	zm_cancelQueue(vm, q);
 }
 
 
-static void zm_mwhGrow(zm_VM *vm, size_t len)
+static void zm_joinCancel(zm_VM *vm, zm_State *c)
 {
-	size_t growed = (len - vm->mwh.len) * sizeof(zm_Worker*);
-
-	vm->mwh.hlist = zm_nrealloc(vm->mwh.hlist, zm_Worker*, len);
+	zm_StateQueue *q = zm_queueNew();
 
-	memset(vm->mwh.hlist + vm->mwh.len, 0, growed);
-
-	vm->mwh.len = len;
+	zm_cancelPush(q, c);
+	zm_cancelQueue(vm, q);
 }
 
 
-static void zm_mwhSet(zm_VM *vm, zm_Machine *machine, zm_Worker *worker)
+static void zm_freeJoin(zm_VM *vm, zm_State *s)
 {
-	if (machine->id == -1)
-		zm_machineInit(machine);
+	zm_Exception *e = s->ext->join->exception;
 
-	if (machine->id >= vm->mwh.len)
-		zm_mwhGrow(vm, machine->id + ZM_MACHINE_HLIST_INC);
+	if (s->ext->join->timer)
+		zm_cancelTimer(vm, s->ext->join->timer);
 
-	vm->mwh.hlist[machine->id] = worker;
+	if (e) {
+		zm_freeTrace(vm, e);
+		zm_freeException(vm, e);
+	}
+
+	zm_free(zm_Join, s->ext->join);
+	s->ext->join = NULL;
 }
 
 
-static zm_Worker* zm_newWorker(zm_VM *vm, zm_Machine *machine)
+/*
+ * All members are returned: resume the join caller or re-raise the
+ * exception of the first failed member.
+ */
+static void zm_joinEnd(zm_VM *vm, zm_State *c)
 {
-	zm_Worker* w;
+	zm_Join *join = c->ext->join;
+	zm_Exception *e = join->exception;
+	void *winner = join->winner;
 
-	w = zm_alloc(zm_Worker);
+	int mode = join->mode;
 
-	w->cyclestep = 1;
-	w->machine = machine;
+	ZM_D("join end: %zx", c);
 
-	w->states.first = NULL;
-	w->states.current = NULL;
-	w->states.previous = NULL;
-	w->nstate = 0;
+	if (join->timer)
+		zm_cancelTimer(vm, join->timer);
 
-	w->next = NULL;
+	c->ext->join = NULL;
+	zm_free(zm_Join, join);
 
-	return w;
-}
+	if (!e) {
+		zm_resumeState(vm, c);
 
+		/* zmSUB_DEADLINE keep the zmresult of the subtask */
+		if (mode != ZM_JOIN_DEADLINE)
+			zm_setArgument(c, winner);
 
-static void zm_freeWorker(zm_VM* vm, zm_Worker *w)
-{
-	zm_free(zm_Worker, w);
+		return;
+	}
+
+	e->beforecatch = NULL;
+
+	if (zm_hasFlag(c, ZM_STATE_CATCH)) {
+		zm_appendTrace(vm, e, c);
+		c->exception = e;
+		zm_resumeState(vm, c);
+	} else {
+		zm_lockAndImplodeByAbortException(vm, c, e);
+	}
 }
 
 
-static zm_Worker* zm_getWorker(zm_VM *vm, zm_Machine *machine)
+/*
+ * A member of the join of c is returned (sub = NULL when the member
+ * has been totally reset by an exception)
+ */
+static void zm_joinReturn(zm_VM *vm, zm_State *c, zm_State *sub)
 {
-	zm_Worker *worker = zm_mwhGet(vm, machine);
+	zm_Join *join = c->ext->join;
 
-	if (worker)
-		return worker;
+	ZM_D("join return: %zx -> %zx", sub, c);
 
-	worker = zm_newWorker(vm, machine);
+	join->pending--;
 
-	zm_mwhSet(vm, machine, worker);
+	if ((join->mode == ZM_JOIN_ANY) && (sub) && (!join->winner) &&
+	    (!join->exception)) {
+		/* sub can be freed (autofree) before the join end */
+		join->winner = sub->data;
+		zm_joinCancel(vm, c);
+	}
 
-	return worker;
+	if (!join->pending)
+		zm_joinEnd(vm, c);
 }
 
 
-/* ----------------------------------------------------------------------------
- *  TASK & SUBTASK                                               (SECTION CORE)
- * --------------------------------------------------------------------------*/
+/*
+ * An abort-exception reached the join caller c: keep the first one
+ * (returned) and cancel the other members.
+ */
+static zm_Exception* zm_joinRaise(zm_VM *vm, zm_State *c, zm_Exception *e)
+{
+	zm_Join *join = c->ext->join;
 
+	if (join->exception) {
+		ZM_D("join raise: drop exception %zx", e);
+		zm_freeTrace(vm, e);
+		zm_freeException(vm, e);
+		return join->exception;
+	}
 
-static void zm_addStateToSiblingsRing(zm_State **first, zm_State *state)
-{
-	if ((*first) == NULL) {
-		(*first) = state;
-		state->siblings.next = state->siblings.prev = state;
-	} else {
-		/* put state as the second element
-		   (between child and child.next)*/
-		state->siblings.next = (*first)->siblings.next;
-		state->siblings.prev = (*first);
+	ZM_D("join raise: %zx", e);
 
-		(*first)->siblings.next->siblings.prev = state;
-		(*first)->siblings.next = state;
-	}
+	join->exception = e;
+	zm_joinCancel(vm, c);
 
+	return e;
 }
 
 
-static void zm_addParent(zm_VM *vm, zm_State* s, const char *ref,
-                                 const char *filename, int nline)
+/*
+ * The deadline of zmSUB_DEADLINE is expired: close the subtask and
+ * raise a timeout exception in the caller c
+ */
+static void zm_deadlineExpired(zm_VM *vm, zm_State *c)
 {
-	zm_Parent *parent = zm_alloc(zm_Parent);
-	zm_State *current = zm_getCurrentState(vm);
-	size_t deep = zm_getDeep(current) + 1;
-
-	if (zm_hasFlag(current, ZM_STATE_IMPLOSIONLOCK)) {
-		zm_fatalInitAt(vm, ref, filename, nline);
-		zm_fatalDo(ZM_FATAL_TCODE, "ADDTASK.P",
-		           "cannot create task in ZM_TERM");
-	}
-
-	parent->stacksize = deep;
-	parent->stack = zm_nalloc(zm_State*, deep);
+	zm_Join *join = c->ext->join;
+	zm_Exception *e;
 
-	if (deep > 1) {
-		memcpy(parent->stack, current->parent->stack,
-		       (deep-1) * sizeof(zm_State*));
-	}
+	/* subtask is just closing by an exception */
+	if (join->exception)
+		return;
 
-	parent->stack[ deep - 1 ] = current;
+	e = zm_newException(vm, ZM_EXCEPTION_ABORT);
+	e->msg = "deadline expired";
+	e->data = ZM_TIMEOUT;
 
-	parent->comeback = NULL;
+	join->exception = e;
 
-	s->parent = parent;
+	zm_joinCancel(vm, c);
 }
 
 
-static void zm_runInit(zm_VM *vm, zm_Worker *worker, zm_State *s, int sub)
+/*
+ * Return true if a continue-exception raised by s cross a join caller
+ */
+static int zm_crossJoin(zm_State *s)
 {
-	zm_Yield y = zm_machineStep0(vm, worker, s);
-
-	if (ZM_B4(y.cmd) != ZM_TASK_INIT) {
-		zm_fatalInit(vm, NULL);
-		zm_fatalDo(ZM_FATAL_YCODE, "YDONE.WY",
-		           "task in constructor mode (ZM_INIT) can yield "
-		           "only to zmDONE");
-	}
-}
-
+	do {
+		s = zm_caller(s);
 
-zm_State* izm_addTask(zm_VM *vm, zm_Machine *machine, void *data, int sub,
-                                         int flag, const char *fn, int nl)
-{
-	zm_State* state = zm_alloc(zm_State);
-	zm_Worker *worker;
+		if (zm_ext(s, join))
+			return true;
 
-	ZM_D("zm_addTask %s: %s", sub ? "subtask" : "ptask", machine->name);
+	} while (zm_hasntFlag(s, ZM_STATE_CATCH));
 
-	state->pmode = ZM_PMODE_NORMAL;
-	state->flag = flag;
-	state->on.resume = ZM_FIRST;
-	state->on.iter = 0;
-	state->on.c4tch = 0;
-	state->rearg = NULL;
-	state->data = data;
-	state->subtasks = NULL;
-	state->exception = NULL;
-	state->codeframe.filename = "<not set>";
-	state->codeframe.nline = 0;
-	#ifdef ZM_DEBUG_MACHINENAME
-	state->debugmachinename = machine->name;
-	#endif
+	return false;
+}
 
-	worker = zm_getWorker(vm, machine);
 
-	if (sub) {
-		const char *fname = (flag & ZM_STATE_AUTOFREE) ?
-		                    "zmNewSubTasklet" : "zmNewSubTask";
-		zm_State *current = zm_getCurrentState(vm);;
+/* ----------------------------------------------------------------------------
+ *  TASK GROUP                                                   (SECTION CORE)
+ * --------------------------------------------------------------------------*/
 
-		ZM_ASSERT_VMLOCK("ADDTASK.VLCK", fname, fn, nl);
+zm_Group* zm_newGroup(void *data)
+{
+	zm_Group *g = zm_alloc(zm_Group);
 
-		zm_addParent(vm, state, fname, fn, nl);
+	g->count = 0;
+	g->first = NULL;
+	g->done = zm_newEvent(g);
+	g->data = data;
 
-		zm_addStateToSiblingsRing(&(current->subtasks), state);
-	} else {
-		state->parent = NULL;
+	return g;
+}
 
-		zm_addStateToSiblingsRing(&(vm->ptasks), state);
 
-		vm->nptask++;
+void zm_freeGroup(zm_VM *vm, zm_Group *g)
+{
+	if (g->count) {
+		zm_fatalInit(vm, "zm_freeGroup");
+		zm_fatalDo(ZM_FATAL_GCODE, "GROUP.FREE",
+		           "try to free a group with %zu alive tasks",
+		           g->count);
 	}
 
-	/* task and subtask are created suspended */
-	state->next = (zm_State*)worker;
-
-	zm_runInit(vm, worker, state, sub);
+	zm_freeEvent(vm, g->done);
+	zm_free(zm_Group, g);
+}
 
-	ZM_D("zm_addTask = %zx", state);
 
-	return state;
+/* group member node of s (in the state extension) or NULL */
+static zm_GroupLink* zm_groupLink(zm_State *s)
+{
+	return ((s->ext) && (s->ext->group.group)) ? &(s->ext->group) : NULL;
 }
 
 
-/**
- * If the task is ready to be free the request can be performed in a
- * sync way and the function return true otherwise the function return
- * false
+/*
+ * Add a ptask to a group. The task leave the group when it's closed
+ * (after ZM_TERM).
  */
-static int zm_requestFreeState(zm_VM *vm, zm_State *state, const char* refname)
+void zm_groupAdd(zm_VM *vm, zm_Group *g, zm_State *s)
 {
-	ZM_D("request free state by: %s state=%zx", refname, state);
+	zm_GroupLink *l;
 
-	if (zm_hasFlag(state, ZM_STATE_AUTOFREE)) {
-		zm_fatalInit(vm, refname);
-		zm_fatalDo(ZM_FATAL_GCODE, "RFREEST.AF",
-		           "cannot request to free a state "
-		           "that is just marked to be free");
+	if (zm_isSubTask(s)) {
+		zm_fatalInit(vm, "zm_groupAdd");
+		zm_fatalDo(ZM_FATAL_GCODE, "GROUP.SUB",
+		           "expected a task but found a subtask");
 	}
 
-	if (state->pmode == ZM_PMODE_OFF) {
-		/*** this pmode is set by ZM_PMODE_END */
-		/*** then is possible to free state in a sync way*/
-		zm_free(zm_State, state);
-		return true;
+	if (zm_groupLink(s)) {
+		zm_fatalInit(vm, "zm_groupAdd");
+		zm_fatalDo(ZM_FATAL_GCODE, "GROUP.DUP",
+		           "task is just in a group");
 	}
 
-	if (zm_hasntFlag(state, ZM_STATE_IMPLOSIONLOCK)) {
-		zm_fatalInit(vm, refname);
-		zm_fatalDo(ZM_FATAL_GCODE, "RFREEST.AT",
-		           "cannot free an active task");
+	if ((s->pmode == ZM_PMODE_OFF) ||
+	    (zm_hasFlag(s, ZM_STATE_IMPLOSIONLOCK))) {
+		zm_fatalInit(vm, "zm_groupAdd");
+		zm_fatalDo(ZM_FATAL_GCODE, "GROUP.CLS",
+		           "try to add a closed task");
 	}
 
-	/* if ZM_STATE_IMPLOSIONLOCK the state will be closed but
-	 * is not just closed because pmode != ZM_PMODE_OFF
-	 * ==> set autofree flag to perform an async free */
-	zm_enableFlag(state, ZM_STATE_AUTOFREE);
+	l = &(zm_stateExt(s)->group);
+	l->group = g;
+	l->state = s;
 
-	return false;
+	if (g->first) {
+		l->next = g->first;
+		l->prev = g->first->prev;
+		l->prev->next = l;
+		l->next->prev = l;
+	} else {
+		l->next = l;
+		l->prev = l;
+		g->first = l;
+	}
+
+	g->count++;
 }
 
 
-int zm_freeTask(zm_VM *vm, zm_State *state)
+static zm_Group* zm_groupUnlink(zm_State *s)
 {
-	/* #FREE_TASK_KIND */
-	if (zm_isSubTask(state)) {
-		zm_fatalInit(vm, "zm_freeTask");
-		zm_fatalDo(ZM_FATAL_GCODE, "FREET.S",
-		           "expected a ptask but found a subtask");
+	zm_GroupLink *l = &(s->ext->group);
+	zm_Group *g = l->group;
+
+	if (l->next == l) {
+		g->first = NULL;
+	} else {
+		l->prev->next = l->next;
+		l->next->prev = l->prev;
+
+		if (g->first == l)
+			g->first = l->next;
 	}
 
-	return zm_requestFreeState(vm, state, "zm_freeTask");
+	l->group = NULL;
+
+	g->count--;
+
+	return g;
 }
 
 
-int zm_freeSubTask(zm_VM *vm, zm_State *state)
+static void zm_groupRemove(zm_VM *vm, zm_State *s)
 {
-	/* #FREE_TASK_KIND */
-	if (zm_isTask(state)) {
-		zm_fatalInit(vm, "zm_freeSubTask");
-		zm_fatalDo(ZM_FATAL_GCODE, "FREES.T",
-		           "expected a subtask but found a ptask");
-	}
+	zm_Group *g;
 
-	return zm_requestFreeState(vm, state, "zm_freeSubTask");
+	ZM_D("group remove %zx (alive %zu)", s, s->ext->group.group->count);
+
+	g = zm_groupUnlink(s);
+
+	if (g->count == 0)
+		zm_trigger(vm, g->done, g);
 }
 
 
-int zm_freeState(zm_VM *vm, zm_State *state)
+size_t zm_groupAlive(zm_Group *g)
 {
-	return zm_requestFreeState(vm, state, "zm_freeState");
+	return g->count;
 }
 
 
 /*
- * yield to a subtask (inside-task yield-operator)
- * alias: zmSUB, zmSSUB
+ * Close all the tasks of the group in one pass over the group members
+ * (return the number of tasks closed)
  */
-zm_yield_t izmSUB(zm_VM* vm, zm_State *s, void* argument, int allowunraise,
-                                           const char *filename, int nline)
+size_t zm_groupCancel(zm_VM *vm, zm_Group *g)
 {
-	const char *rn = (allowunraise) ? "zmSSUB" : "zmSUB";
-
-	ZM_ASSERT_VMLOCK("ACTSUB.VLCK", rn, filename, nline);
-
-	ZM_D("yield SUB(state: [ref %zx])\n", s);
-
-	if (zm_isTask(s)) {
-		zm_fatalInitAt(vm, rn, filename, nline);
-		zm_fatalDo(ZM_FATAL_YCODE, "ACTSUB.NS",
-		           "expected a subtask but found a task "
-		           "(use instead: zm_resume)");
-
-	}
+	zm_State *current = (vm->plock) ? zm_getCurrentState(vm) : NULL;
+	zm_GroupLink *l = g->first;
+	size_t n = 0;
 
-	if (zm_hasFlag(s, ZM_STATE_IMPLOSIONLOCK)) {
-		zm_fatalInitAt(vm, rn, filename, nline);
-		zm_fatalDo(ZM_FATAL_YCODE, "ACTSUB.LI",
-		           "try to resume a closed subtask");
-	}
+	if (!l)
+		return 0;
 
-	zm_canBeContextStackPush(vm,  s, rn, filename, nline);
+	do {
+		zm_State *s = l->state;
 
-	if (zm_hasFlag(s, ZM_STATE_WAITING)) {
-		if (zm_hasException(s, ZM_EXCEPTION_CONTINUEHEAD)) {
-			if (!allowunraise) {
-				zm_fatalInitAt(vm, rn, filename, nline);
-				zm_fatalDo(ZM_FATAL_YCODE, "ACTSUB.C",
-						   "try to resume a subtask "
-						   "with a continue-exception "
-						   "(use instead zmUNRAISE or "
-						   "zmSSUB)");
-			}
+		l = l->next;
 
-			zm_unraise(vm, s, argument, "zmSSUB", filename, nline);
+		if (zm_hasFlag(s, ZM_STATE_IMPLOSIONLOCK))
+			continue;
 
-			return ZM_TASK_SUSPEND_WAITING_SUBTASK;
-		}
+		n++;
 
-		if (zm_getParent(zm_getCurrentState(vm)) == s) {
-			zm_fatalInitAt(vm, rn, filename, nline);
-			zm_fatalDo(ZM_FATAL_YCODE, "ACTSUB.WP",
-			                 "try to resume a subtask that is the "
-			                 "previous element in execution-stack; "
-			                 "use instead zmyield zmCALLER");
-		} else if (allowunraise) {
-			if (zm_hasException(s, ZM_EXCEPTION_CONTINUE)) {
-				zm_fatalInitAt(vm, rn, filename, nline);
-				zm_fatalDo(ZM_FATAL_YCODE, "ACTSUB.WT",
-					   "try to resume a waiting subtask or "
-					   "unraise the continue-exception "
-					   "tail");
-			} else {
-				zm_fatalInitAt(vm, rn, filename, nline);
-				zm_fatalDo(ZM_FATAL_YCODE, "ACTSUB.WR",
-					   "try to resume a waiting subtask "
-					   "or unraise a subtask without "
-					   "continue-exception");
-			}
+		if ((current) && (zm_hasSameContext(s, current))) {
+			/* the running task cannot be closed now: the close
+			   is done after the current step */
+			zm_cancelState(vm, s);
 		} else {
-			zm_fatalInitAt(vm, rn, filename, nline);
-			zm_fatalDo(ZM_FATAL_YCODE, "ACTSUB.WS",
-					   "try to resume a waiting subtask");
+			zm_abortTask(vm, s, "zm_groupCancel");
 		}
-	}
-
-	zm_setCaller(s, zm_getCurrentState(vm));
 
-	zm_resumeStateBy(vm, s, argument, rn, filename, nline);
+	} while (l != g->first);
 
-	return ZM_TASK_SUSPEND_WAITING_SUBTASK;
+	return n;
 }
 
 
 /*
- *
+ * wait until all the tasks of the group are closed
  */
-zm_yield_t izm_resume(const char *fname, zm_VM* vm, zm_State *s, void *argument,
-                                      int iter, const char *filename, int nline)
+zm_yield_t izmJOIN(zm_VM* vm, zm_Group *g, const char *filename, int nline)
 {
-	if (zm_hasFlag(s, ZM_STATE_RUN | ZM_STATE_WAITING)) {
-		if (zm_hasFlag(s, ZM_STATE_RUN)) {
-			zm_fatalInitAt(vm, fname, filename, nline);
-			zm_fatalDo(ZM_FATAL_GCODE, "ACTTASK.R",
-			           "try to active a just active task");
-		} else {
-			zm_fatalInitAt(vm, fname, filename, nline);
-			zm_fatalDo(ZM_FATAL_GCODE, "ACTTASK.WS",
-				   "try to resume a busy-waiting task");
-		}
-	}
+	zm_GroupLink *l;
 
-	if (zm_isSubTask(s)) {
-		zm_fatalInitAt(vm, fname, filename, nline);
-		zm_fatalDo(ZM_FATAL_GCODE, "ACTTASK.NP",
-		           "expected a task but found a subtask "
-		           "(use instead: zmSUB)");
-	}
+	ZM_ASSERT_VMLOCK("GJOIN.VLCK", "zmJOIN", filename, nline);
 
+	if (g->count == 0)
+		return ZM_TASK_CONTINUE;
 
-	/* FIXME not sure is still right after remove zmTO */
-	if (iter) {
-		/*  [ON_RESUME_SWITCH]*/
-		if (s->on.iter) {
-			s->on.resume = s->on.iter;
-		}
+	l = zm_groupLink(zm_root(zm_getCurrentState(vm)));
+
+	if ((l) && (l->group == g)) {
+		zm_fatalInitAt(vm, "zmJOIN", filename, nline);
+		zm_fatalDo(ZM_FATAL_YCODE, "GJOIN.SELF",
+		           "a task cannot wait its own group");
 	}
 
-	ZM_D("activeTask (%s): iter = %d", fname, iter);
+	return izmEVENT(vm, g->done, filename, nline);
+}
 
-	zm_resumeStateBy(vm, s, argument, fname, filename, nline);
 
-	if (iter)
-		return ZM_TASK_SUSPEND;
+/* ----------------------------------------------------------------------------
+ *  FUTURE                                                       (SECTION CORE)
+ * --------------------------------------------------------------------------*/
 
-	return ZM_TASK_TERM;
-}
+zm_Future* zm_newFuture(void *data)
+{
+	zm_Future *f = zm_alloc(zm_Future);
 
+	f->done = false;
+	f->value = NULL;
+	f->ready = zm_newEvent(f);
+	f->data = data;
 
+	return f;
+}
+
+
+void zm_freeFuture(zm_VM *vm, zm_Future *f)
+{
+	if (f->ready->count) {
+		zm_fatalInit(vm, "zm_freeFuture");
+		zm_fatalDo(ZM_FATAL_GCODE, "FUTURE.FREE",
+		           "try to free a future with %d awaiting tasks",
+		           f->ready->count);
+	}
+
+	zm_freeEvent(vm, f->ready);
+	zm_free(zm_Future, f);
+}
+
+
+/*
+ * Complete a future: all the awaiting tasks are resumed with value as
+ * zmarg (return the number of resumed tasks). A future can be completed
+ * only once.
+ */
+size_t zm_complete(zm_VM *vm, zm_Future *f, void *value)
+{
+	if (f->done) {
+		zm_fatalInit(vm, "zm_complete");
+		zm_fatalDo(ZM_FATAL_GCODE, "FUTURE.DUP",
+		           "future just completed");
+	}
+
+	f->done = true;
+	f->value = value;
+
+	return zm_trigger(vm, f->ready, value);
+}
 
 
+int zm_isComplete(zm_Future *f)
+{
+	return f->done;
+}
+
+
+void* zm_futureValue(zm_Future *f)
+{
+	return f->value;
+}
+
+
+/*
+ * wait until the future is completed: if it's just completed the task
+ * continue (without suspend) with the future value as zmarg
+ */
+zm_yield_t izmAWAIT(zm_VM* vm, zm_Future *f, const char *filename, int nline)
+{
+	ZM_ASSERT_VMLOCK("AWAIT.VLCK", "zmAWAIT", filename, nline);
+
+	if (f->done) {
+		vm->session.readyarg = f->value;
+		return ZM_TASK_FUTURE_READY;
+	}
+
+	return izmEVENT(vm, f->ready, filename, nline);
+}
 
 
 /* ----------------------------------------------------------------------------
- *  VIRTUAL MAPPER                                               (SECTION CORE)
+ *  MACHINE & WORKER                                             (SECTION CORE)
  * --------------------------------------------------------------------------*/
 
-zm_VM* zm_newVM(const char *name)
+#ifdef ZM_BYTE_ORDER_RUNTIME
+static zm_Yield zm_r2Y(zm_yield_t n)
 {
-	zm_VM* vm;
+	zm_Yield y;
 
-	vm = zm_alloc(zm_VM);
+	y.resume = n & 0xFF;
+	y.c4tch = (n >> 8) & 0xFF;
+	y.iter = (n >> 16) & 0xFF;
+	y.cmd = (n >> 24) & 0xFF;
 
-	vm->data = NULL;
+	return y;
+}
+#else
+static zm_Yield zm_r2Y(zm_yield_t n)
+{
+	return (zm_Yield)n;
+}
+#endif
 
-	vm->plock = false;
-	vm->pause = false;
 
-	vm->prepost = NULL;
-	/** ptasks contain a pointer to a ptask of the vm or NULL when empty */
-	/** all ptask are connected througth siblings so this pointer allow*/
-	/** to access all the task (and relative subtask) of the vm*/
-	vm->ptasks = NULL;
+static void zm_machineInit(zm_Machine *machine)
+{
+	zm_lockOn(NULL);
+	if (machine->id == -1)
+		machine->id = zmg_mcounter++;
+	zm_lockOff(NULL);
+}
 
-	vm->nptask = 0;
-	vm->nworker = 0;
 
-	zm_mwhInit(vm);
+static zm_Yield zm_machineStep(zm_VM *vm, zm_Worker *worker, zm_State *s)
+{
+	zm_yield_t n;
 
-	vm->workercursor = NULL;
-	vm->session.state = NULL;
-	vm->session.worker = NULL;
-	vm->session.fixedworker = false;
-	vm->session.suspendop = 0;
+	vm->plock = true;
 
-	vm->name = name;
-	vm->uncaught = NULL;
+	n = (worker->machine->fun)(vm, s->on.resume, s->rearg);
 
-	return vm;
-}
+	vm->plock = false;
 
+	s->rearg = NULL;
 
+	return zm_r2Y(n);
+}
 
-int zm_closeVM(zm_VM* vm)
+
+#ifdef ZM_ENABLE_STATS
+static zm_Yield zm_machineStepStats(zm_VM *vm, zm_Worker *worker,
+                                                  zm_State *s)
 {
-	zm_State *state = vm->ptasks;
-	#ifdef ZM_CHECK_CONSISTENCY
-	size_t n = vm->nptask;
+	zm_WorkerStats *st = &(worker->stats);
+	zm_Yield y;
+	#ifdef ZM_ENABLE_STATS_TIME
+	uint64_t t = zm_nanotime();
 	#endif
 
-	if (!state)
-		return true;
+	y = zm_machineStep(vm, worker, s);
 
-	if (vm->plock) {
-		/* can be replaced with ZM_ASSERT_VMUNLOCK TODO */
-		zm_fatalInit(vm, "zm_closeVM");
-		zm_fatalDo(ZM_FATAL_TCODE, "CLSVM.LCK",
-		           "cannot invoke a closeVM during task execution");
-	}
+	#ifdef ZM_ENABLE_STATS_TIME
+	t = zm_nanotime() - t;
+	st->steptime += t;
 
-	do {
-		#ifdef ZM_CHECK_CONSISTENCY
-		if (!state->siblings.next) {
-			zm_fatalInit(vm, "zm_closeVM");
-			zm_fatalDo(ZM_FATAL_U1, "CLSVM.SN",
-			           "null ref in siblings ring");
-		}
-		n--;
-		#endif
+	if (t > st->maxsteptime)
+		st->maxsteptime = t;
+	#endif
 
-		zm_abortTask(vm, state, "zm_closeVM");
-		state = state->siblings.next;
-	} while (state != vm->ptasks);
+	st->steps++;
 
-	#ifdef ZM_CHECK_CONSISTENCY
-	if (n != 0) {
-		zm_fatalInit(vm, "zm_closeVM");
-		zm_fatalDo(ZM_FATAL_U1, "CLSVM.SC",
-		           "siblings count doesn't match");
-	}
-	#endif
+	if (y.cmd < ZM_STATS_NCMD)
+		st->yields[y.cmd]++;
 
+	return y;
+}
 
-	return false;
+
+static void zm_statsCreated(zm_Worker *worker, size_t n)
+{
+	zm_WorkerStats *st = &(worker->stats);
+
+	st->created += n;
+	st->live += n;
+
+	if (st->live > st->peak)
+		st->peak = st->live;
 }
 
 
+static void zm_statsFreed(zm_Worker *worker)
+{
+	worker->stats.freed++;
+	worker->stats.live--;
+}
+#endif
 
-void zm_freeVM(zm_VM* vm)
+
+static zm_Yield zm_machineStep0(zm_VM *vm, zm_Worker *worker, zm_State *s)
 {
-	int i;
-	if (vm->ptasks) {
-		zm_fatalInit(vm, "zm_freeVM");
-		zm_fatalDo(ZM_FATAL_GCODE, "FREEVM.TP",
-		           "cannot free vm if all task hasn't been "
-		           "free (use zm_closeVM and wait until "
-		           "zm_go return ZM_RUN_IDLE)");
-	}
+	zm_State *savestate = vm->session.state;
+	zm_Worker *saveworker = vm->session.worker;
+	int savelock = vm->plock;
+	zm_yield_t n;
 
+	/*if (sub) not sure about this FIXME
+		zm_setCaller(s, zm_getCurrentState(vm)); */
 
-	for (i = 0; i < vm->mwh.len; i++) {
-		zm_Worker *worker = vm->mwh.hlist[i];
-		if (worker) {
-			#if ZM_CHECK_CONSISTENCY
-			if (worker->nstate) {
-				zm_fatalInit(vm, NULL);
-				zm_fatalDo(ZM_FATAL_U1, "FREEVM.NS",
-					   "worker '%s' is not empty",
-					   zm_workerName(worker));
-			}
-			#endif
+	vm->plock = true;
+	vm->session.worker = worker;
+	vm->session.state = s;
 
-			zm_freeWorker(vm, worker);
-		}
-	}
+	n = (worker->machine->fun)(vm, ZM_INIT, NULL);
 
-	zm_mwhFree(vm);
+	vm->session.state = savestate;
+	vm->session.worker = saveworker;
+	vm->plock = savelock;
 
-	zm_free(zm_VM, vm);
+	/* if (sub)
+		zm_setCaller(s, NULL); */
+
+	return zm_r2Y(n);
 }
 
 
-void zm_break(zm_VM* vm)
+/*
+ * MWH: Machine Worker Hashtable
+ */
+static void zm_mwhInit(zm_VM *vm)
 {
-	vm->pause = true;
+	/* hlist in MT can be initalized too small (if others threads perform
+	   many counter increments) anyway mwhAdd will resize it in a MT-safe
+	   way */
+	size_t len = zmg_mcounter + ZM_MACHINE_HLIST_INC;
+
+	vm->mwh.len = len;
+
+	vm->mwh.hlist = zm_nalloc(zm_Worker*, len);
+
+	memset(vm->mwh.hlist, 0, len * sizeof(zm_Worker*));
+
 }
 
 
-void zm_setProcessCallback(zm_VM *vm, zm_process_cb p)
+static void zm_mwhFree(zm_VM *vm)
 {
-	vm->prepost = p;
+	zm_nfree(zm_Worker *, vm->mwh.len, vm->mwh.hlist);
 }
 
 
-/* ----------------------------------------------------------------------------
- *  PROCESS                                                      (SECTION CORE)
- * --------------------------------------------------------------------------*/
+static zm_Worker* zm_mwhGet(zm_VM *vm, zm_Machine *machine)
+{
+	/* uninitialized machine*/
+	if (machine->id == -1)
+		return NULL;
 
+	/* chek if associative array must grow */
+	if (machine->id >= vm->mwh.len)
+		return NULL;
 
-static void zm_checkInnerYield(zm_VM *vm, zm_State *state, zm_Yield result)
+	return vm->mwh.hlist[machine->id];
+}
+
+
+static void zm_mwhGrow(zm_VM *vm, size_t len)
 {
-	if (result.resume == 0) {
-		zm_fatalInit(vm, NULL);
-		zm_fatalDo(ZM_FATAL_YCODE, "YINN.0",
-		           "yield to zmstate 0");
-	}
+	size_t growed = (len - vm->mwh.len) * sizeof(zm_Worker*);
+	zm_Worker **hlist = zm_nalloc(zm_Worker*, len);
 
-	if (result.c4tch != 0) {
-		zm_fatalInit(vm, NULL);
-		zm_fatalDo(ZM_FATAL_YCODE, "YINN.C",
-		           "catch in yield can be set only with "
-		           "zmSUB(state)");
-	}
+	/* alloc + free (not realloc): block sizes are known (memstats) */
+	memcpy(hlist, vm->mwh.hlist, vm->mwh.len * sizeof(zm_Worker*));
+	memset(hlist + vm->mwh.len, 0, growed);
 
-	if (result.iter != 0) {
-		zm_fatalInit(vm, NULL);
-		zm_fatalDo(ZM_FATAL_YCODE, "YINN.I",
-		           "iter in yield can be set only with "
-		           "zmSUB(state)");
-	}
+	zm_nfree(zm_Worker*, vm->mwh.len, vm->mwh.hlist);
 
-	if (result.resume == ZM_TERM) {
-		zm_fatalInit(vm, NULL);
-		zm_fatalDo(ZM_FATAL_YCODE, "YINN.TRM",
-		           "task cannot yield directly to ZM_TERM "
-		           "use instead: zmTERM");
-	}
+	vm->mwh.hlist = hlist;
+	vm->mwh.len = len;
 }
 
 
-static void zm_resumeSubtaskCaller(zm_VM *vm, zm_State *sub, zm_Yield result,
-                                                             const char *ref)
+static void zm_mwhSet(zm_VM *vm, zm_Machine *machine, zm_Worker *worker)
 {
+	if (machine->id == -1)
+		zm_machineInit(machine);
 
-	/* only resume can be set in yield parent */
+	if (machine->id >= vm->mwh.len)
+		zm_mwhGrow(vm, machine->id + ZM_MACHINE_HLIST_INC);
 
-	if (result.resume == 0) {
-		zm_fatalInit(vm, ref);
-		zm_fatalDo(ZM_FATAL_YCODE, "YRESCALL.R",
-		           "resume point must be set in "
-		           "yield %s", ref);
-	}
+	vm->mwh.hlist[machine->id] = worker;
+}
 
-	/* CHECK_OR_NOT check or reset ?? */
-	if (result.c4tch != 0) {
+
+static zm_Worker* zm_newWorker(zm_VM *vm, zm_Machine *machine)
+{
+	zm_Worker* w;
+
+	w = zm_alloc(zm_Worker);
+
+	w->cyclestep = 1;
+	w->machine = machine;
+
+	w->states.first = NULL;
+	w->states.current = NULL;
+	w->states.previous = NULL;
+	w->nstate = 0;
+
+	w->next = NULL;
+
+	#ifdef ZM_ENABLE_STATS
+	memset(&(w->stats), 0, sizeof(zm_WorkerStats));
+	#endif
+
+	#ifdef ZM_ENABLE_LATENCY
+	memset(&(w->latency), 0, sizeof(zm_Histogram));
+	#endif
+
+	#ifdef ZM_ENABLE_PROFILE
+	w->profile = NULL;
+	#endif
+
+	#ifdef ZM_ENABLE_CENSUS
+	memset(w->census, 0, sizeof(w->census));
+	#endif
+
+	return w;
+}
+
+
+static void zm_freeWorker(zm_VM* vm, zm_Worker *w)
+{
+	#ifdef ZM_ENABLE_PROFILE
+	if (w->profile)
+		zm_nfree(zm_StateProfile, ZM_PROFILE_NSTATE, w->profile);
+	#endif
+
+	zm_free(zm_Worker, w);
+}
+
+
+static zm_Worker* zm_getWorker(zm_VM *vm, zm_Machine *machine)
+{
+	zm_Worker *worker = zm_mwhGet(vm, machine);
+
+	if (worker)
+		return worker;
+
+	worker = zm_newWorker(vm, machine);
+
+	zm_mwhSet(vm, machine, worker);
+
+	return worker;
+}
+
+
+#ifdef ZM_ENABLE_STATS
+/*
+ * Return the statistics of machine tasks in vm (NULL if vm has never
+ * had a task of this machine).
+ */
+const zm_WorkerStats* zm_getWorkerStats(zm_VM *vm, zm_Machine *machine)
+{
+	zm_Worker *worker = zm_mwhGet(vm, machine);
+
+	return (worker) ? &(worker->stats) : NULL;
+}
+#endif
+
+
+#ifdef ZM_ENABLE_LATENCY
+static size_t zm_histogramIndex(uint64_t v)
+{
+	int m = ZM_LATENCY_SUBBITS;
+
+	if (v < ((uint64_t)1 << ZM_LATENCY_SUBBITS))
+		return (size_t)v;
+
+	if (v >= ((uint64_t)1 << ZM_LATENCY_MAXBITS))
+		return ZM_LATENCY_NBUCKET - 1;
+
+	/* m = most significant bit of v */
+	while ((v >> (m + 1)))
+		m++;
+
+	return ((size_t)(m - ZM_LATENCY_SUBBITS + 1) << ZM_LATENCY_SUBBITS) +
+	       (size_t)((v >> (m - ZM_LATENCY_SUBBITS)) -
+	                ((uint64_t)1 << ZM_LATENCY_SUBBITS));
+}
+
+
+/* highest value counted in bucket i */
+static uint64_t zm_histogramBucketMax(size_t i)
+{
+	uint64_t sub = (uint64_t)1 << ZM_LATENCY_SUBBITS;
+	int shift;
+
+	if (i < sub)
+		return (uint64_t)i;
+
+	shift = (int)(i >> ZM_LATENCY_SUBBITS) - 1;
+
+	return (((sub + (i & (sub - 1))) + 1) << shift) - 1;
+}
+
+
+static void zm_histogramAdd(zm_Histogram *h, uint64_t v)
+{
+	if ((!h->count) || (v < h->min))
+		h->min = v;
+
+	if (v > h->max)
+		h->max = v;
+
+	h->count++;
+	h->sum += v;
+	h->bucket[zm_histogramIndex(v)]++;
+}
+
+
+/* record the resume to step latency of a resumed state */
+static void zm_latencyRecord(zm_VM *vm, zm_Worker *worker, zm_State *s)
+{
+	uint64_t lat = zm_nanotime() - s->resumed;
+
+	s->resumed = 0;
+
+	zm_histogramAdd(&(worker->latency), lat);
+	zm_histogramAdd(&(vm->latency), lat);
+}
+
+
+/*
+ * Return the resume to step latency histogram of machine tasks in vm (NULL
+ * if vm has never had a task of this machine) or of all tasks if machine
+ * is NULL.
+ */
+const zm_Histogram* zm_getLatency(zm_VM *vm, zm_Machine *machine)
+{
+	zm_Worker *worker;
+
+	if (!machine)
+		return &(vm->latency);
+
+	worker = zm_mwhGet(vm, machine);
+
+	return (worker) ? &(worker->latency) : NULL;
+}
+
+
+/* clear all the latency histograms of vm */
+void zm_resetLatency(zm_VM *vm)
+{
+	size_t i;
+
+	memset(&(vm->latency), 0, sizeof(zm_Histogram));
+
+	for (i = 0; i < vm->mwh.len; i++) {
+		zm_Worker *worker = vm->mwh.hlist[i];
+
+		if (worker)
+			memset(&(worker->latency), 0, sizeof(zm_Histogram));
+	}
+}
+
+
+/*
+ * Return the value (ns) at percentile p (0-100): the highest value of the
+ * bucket that contains it (never more than the max recorded value).
+ */
+uint64_t zm_histogramPercentile(const zm_Histogram *h, double p)
+{
+	uint64_t rank, n = 0;
+	size_t i;
+
+	if (!h->count)
+		return 0;
+
+	if (p >= 100)
+		return h->max;
+
+	rank = (p <= 0) ? 1 : (uint64_t)(p * h->count / 100 + 0.5);
+
+	if (rank < 1)
+		rank = 1;
+
+	for (i = 0; i < ZM_LATENCY_NBUCKET; i++) {
+		n += h->bucket[i];
+
+		if (n >= rank) {
+			uint64_t v = zm_histogramBucketMax(i);
+			return (v < h->max) ? v : h->max;
+		}
+	}
+
+	return h->max;
+}
+#endif
+
+
+#ifdef ZM_ENABLE_PROFILE
+static void zm_profileStep(zm_VM *vm, zm_Worker *worker, int resume,
+                                                      uint64_t t)
+{
+	zm_StateProfile *p;
+
+	/* free by zm_freeWorker with the same zm_nfree size (memstats) */
+	if (!worker->profile) {
+		worker->profile = zm_nalloc(zm_StateProfile, ZM_PROFILE_NSTATE);
+		memset(worker->profile, 0,
+		       sizeof(zm_StateProfile) * ZM_PROFILE_NSTATE);
+	}
+
+	p = &(worker->profile[resume]);
+
+	p->count++;
+	p->time += t;
+
+	if (t > p->maxtime)
+		p->maxtime = t;
+}
+
+
+/*
+ * Return the profile of machine tasks in vm indexed by zmstate (NULL if
+ * no task of machine has done a step in vm)
+ */
+const zm_StateProfile* zm_getProfile(zm_VM *vm, zm_Machine *machine)
+{
+	zm_Worker *worker = zm_mwhGet(vm, machine);
+
+	return (worker) ? worker->profile : NULL;
+}
+
+
+typedef struct {
+	zm_Worker *worker;
+	int resume;
+} zm_ProfileItem;
+
+
+static int zm_profileCompare(const void *a, const void *b)
+{
+	const zm_ProfileItem *x = a, *y = b;
+	uint64_t tx = x->worker->profile[x->resume].time;
+	uint64_t ty = y->worker->profile[y->resume].time;
+
+	if (tx != ty)
+		return (tx < ty) ? 1 : -1;
+
+	/* same time: most invoked first */
+	tx = x->worker->profile[x->resume].count;
+	ty = y->worker->profile[y->resume].count;
+
+	return (tx < ty) ? 1 : (tx > ty) ? -1 : 0;
+}
+
+
+/* print the n hottest zmstates (max total step time) of all machines */
+void zm_printProfile(zm_Print *out, zm_VM *vm, size_t n)
+{
+	zm_ProfileItem *items;
+	size_t i, count = 0;
+	int k;
+
+	ZM_DEFAULT_STDOUT(out);
+
+	for (i = 0; i < vm->mwh.len; i++) {
+		zm_Worker *w = vm->mwh.hlist[i];
+
+		if ((!w) || (!w->profile))
+			continue;
+
+		for (k = 0; k < ZM_PROFILE_NSTATE; k++)
+			if (w->profile[k].count)
+				count++;
+	}
+
+	zm_print(out, "*** profile (top %zu of %zu zmstates):\n",
+	         (n < count) ? n : count, count);
+
+	if (!count) {
+		zm_print(out, "\n\n");
+		return;
+	}
+
+	items = zm_nalloc(zm_ProfileItem, count);
+
+	count = 0;
+
+	for (i = 0; i < vm->mwh.len; i++) {
+		zm_Worker *w = vm->mwh.hlist[i];
+
+		if ((!w) || (!w->profile))
+			continue;
+
+		for (k = 0; k < ZM_PROFILE_NSTATE; k++) {
+			if (w->profile[k].count) {
+				items[count].worker = w;
+				items[count++].resume = k;
+			}
+		}
+	}
+
+	qsort(items, count, sizeof(zm_ProfileItem), zm_profileCompare);
+
+	zm_print(out, "  %-20s %8s %12s %14s %10s %10s\n", "machine",
+	         "zmstate", "count", "total(ns)", "avg(ns)", "max(ns)");
+
+	for (i = 0; (i < count) && (i < n); i++) {
+		zm_StateProfile *p = &(items[i].worker->profile[
+		                                             items[i].resume]);
+
+		zm_print(out, "  %-20s %8d %12lu %14lu %10lu %10lu\n",
+		         items[i].worker->machine->name, items[i].resume,
+		         (unsigned long)p->count, (unsigned long)p->time,
+		         (unsigned long)(p->time / p->count),
+		         (unsigned long)p->maxtime);
+	}
+
+	zm_print(out, "\n\n");
+
+	zm_nfree(zm_ProfileItem, count, items);
+}
+#endif
+
+
+#ifdef ZM_ENABLE_CENSUS
+/* ----------------------------------------------------------------------------
+ *  TASK CENSUS                                                  (SECTION CORE)
+ * --------------------------------------------------------------------------*/
+
+/*
+ * Each live task is counted in a status of its worker (and in a depth of
+ * its vm) from zm_addTask to its end: zm_enableFlag and zm_disableFlag
+ * move it between the status, so zm_census never traverse the tasks.
+ */
+static int zm_censusStatus(int flag)
+{
+	if (flag & ZM_STATE_IMPLOSIONLOCK)
+		return ZM_CENSUS_IMPLOSIONLOCKED;
+
+	if (flag & ZM_STATE_EVENTLOCKED)
+		return ZM_CENSUS_EVENTLOCKED;
+
+	if (flag & ZM_STATE_WAITING)
+		return ZM_CENSUS_WAITING;
+
+	if (flag & ZM_STATE_RUN)
+		return ZM_CENSUS_RUNNING;
+
+	return ZM_CENSUS_SUSPENDED;
+}
+
+
+static void zm_censusFlag(zm_State *s, int flag)
+{
+	zm_Worker *w = s->census;
+
+	if (w) {
+		int from = zm_censusStatus(s->flag);
+		int to = zm_censusStatus(flag);
+
+		if (from != to) {
+			w->census[from]--;
+			w->census[to]++;
+		}
+
+		if ((s->flag ^ flag) & ZM_STATE_CATCH) {
+			if (flag & ZM_STATE_CATCH)
+				w->census[ZM_CENSUS_CATCH]++;
+			else
+				w->census[ZM_CENSUS_CATCH]--;
+		}
+	}
+
+	s->flag = flag;
+}
+
+
+static size_t zm_censusDepth(zm_State *s)
+{
+	size_t deep = zm_getDeep(s);
+
+	return (deep < ZM_CENSUS_NDEPTH) ? deep : ZM_CENSUS_NDEPTH - 1;
+}
+
+
+static void zm_censusAdd(zm_VM *vm, zm_Worker *worker, zm_State *s)
+{
+	s->census = worker;
+
+	worker->census[zm_censusStatus(s->flag)]++;
+
+	if (s->flag & ZM_STATE_CATCH)
+		worker->census[ZM_CENSUS_CATCH]++;
+
+	vm->censusdepth[zm_censusDepth(s)]++;
+}
+
+
+static void zm_censusRemove(zm_VM *vm, zm_State *s)
+{
+	zm_Worker *w = s->census;
+
+	if (!w)
+		return;
+
+	w->census[zm_censusStatus(s->flag)]--;
+
+	if (s->flag & ZM_STATE_CATCH)
+		w->census[ZM_CENSUS_CATCH]--;
+
+	vm->censusdepth[zm_censusDepth(s)]--;
+
+	s->census = NULL;
+}
+
+
+/*
+ * Fill out with the live tasks of vm by status and depth and, if
+ * out->rows is not NULL, by machine (at most out->maxrow rows; out->nrow
+ * is the number of machines with live tasks). The cost depend on the
+ * number of machines, not of tasks.
+ */
+void zm_census(zm_VM *vm, zm_Census *out)
+{
+	size_t i;
+	int k;
+
+	out->tasks = 0;
+	out->nrow = 0;
+	memset(out->status, 0, sizeof(out->status));
+	memcpy(out->depth, vm->censusdepth, sizeof(out->depth));
+
+	for (i = 0; i < vm->mwh.len; i++) {
+		zm_Worker *w = vm->mwh.hlist[i];
+		size_t tasks = 0;
+
+		if (!w)
+			continue;
+
+		for (k = 0; k < ZM_CENSUS_NSTATUS; k++) {
+			out->status[k] += w->census[k];
+
+			if (k != ZM_CENSUS_CATCH)
+				tasks += w->census[k];
+		}
+
+		if (!tasks)
+			continue;
+
+		out->tasks += tasks;
+
+		if ((out->rows) && (out->nrow < out->maxrow)) {
+			zm_CensusRow *row = &(out->rows[out->nrow]);
+
+			row->machine = w->machine;
+			row->tasks = tasks;
+			memcpy(row->status, w->census, sizeof(row->status));
+		}
+
+		out->nrow++;
+	}
+}
+
+
+void zm_printCensus(zm_Print *out, zm_VM *vm)
+{
+	zm_Census c;
+	size_t i;
+	int last = 0;
+
+	ZM_DEFAULT_STDOUT(out);
+
+	c.rows = NULL;
+	c.maxrow = 0;
+	zm_census(vm, &c);
+
+	zm_print(out, "*** census (%zu tasks, %zu machines):\n", c.tasks,
+	         c.nrow);
+
+	zm_print(out, "  %-20s %10s %10s %10s %10s %10s %10s %10s\n",
+	         "machine", "tasks", "running", "suspended", "waiting",
+	         "eventlock", "implosion", "catch");
+
+	for (i = 0; i < vm->mwh.len; i++) {
+		zm_Worker *w = vm->mwh.hlist[i];
+		size_t tasks;
+
+		if (!w)
+			continue;
+
+		tasks = w->census[ZM_CENSUS_RUNNING] +
+		        w->census[ZM_CENSUS_SUSPENDED] +
+		        w->census[ZM_CENSUS_WAITING] +
+		        w->census[ZM_CENSUS_EVENTLOCKED] +
+		        w->census[ZM_CENSUS_IMPLOSIONLOCKED];
+
+		if (!tasks)
+			continue;
+
+		zm_print(out, "  %-20s %10zu %10zu %10zu %10zu %10zu %10zu "
+		         "%10zu\n", w->machine->name, tasks,
+		         w->census[ZM_CENSUS_RUNNING],
+		         w->census[ZM_CENSUS_SUSPENDED],
+		         w->census[ZM_CENSUS_WAITING],
+		         w->census[ZM_CENSUS_EVENTLOCKED],
+		         w->census[ZM_CENSUS_IMPLOSIONLOCKED],
+		         w->census[ZM_CENSUS_CATCH]);
+	}
+
+	for (i = 0; i < ZM_CENSUS_NDEPTH; i++)
+		if (c.depth[i])
+			last = (int)i + 1;
+
+	zm_print(out, "  depth:");
+
+	for (i = 0; i < (size_t)last; i++)
+		zm_print(out, " %zu%s=%zu", i,
+		         (i == ZM_CENSUS_NDEPTH - 1) ? "+" : "", c.depth[i]);
+
+	zm_print(out, "\n\n\n");
+}
+#endif
+
+
+#ifdef ZM_ENABLE_TRACE
+/* ----------------------------------------------------------------------------
+ *  SCHEDULER TRACE                                              (SECTION CORE)
+ * --------------------------------------------------------------------------*/
+
+/*
+ * Start to record the scheduler activity in a buffer of nrecord records
+ * (allocated now by zm_nalloc, free by zm_nfree of vm->tracer.size
+ * records). Records after the buffer is full are dropped (and counted in
+ * vm->tracer.lost). A new start discard the old records.
+ */
+void zm_startTrace(zm_VM *vm, size_t nrecord)
+{
+	if (!nrecord) {
+		zm_fatalInit(vm, "zm_startTrace");
+		zm_fatalDo(ZM_FATAL_GCODE, "TRACE.0", "empty trace buffer");
+	}
+
+	if (vm->tracer.size != nrecord) {
+		if (vm->tracer.records)
+			zm_nfree(zm_TraceRecord, vm->tracer.size,
+			         vm->tracer.records);
+
+		vm->tracer.records = zm_nalloc(zm_TraceRecord, nrecord);
+		vm->tracer.size = nrecord;
+	}
+
+	vm->tracer.used = 0;
+	vm->tracer.lost = 0;
+	vm->tracer.t0 = zm_nanotime();
+	vm->tracer.step = vm->tracer.t0;
+	vm->tracer.on = true;
+}
+
+
+/* stop recording (records are kept until the next start or zm_freeVM) */
+void zm_stopTrace(zm_VM *vm)
+{
+	vm->tracer.on = false;
+}
+
+
+static void zm_freeTracer(zm_VM *vm)
+{
+	if (vm->tracer.records)
+		zm_nfree(zm_TraceRecord, vm->tracer.size, vm->tracer.records);
+
+	vm->tracer.records = NULL;
+	vm->tracer.size = 0;
+	vm->tracer.used = 0;
+	vm->tracer.on = false;
+}
+
+
+static zm_TraceRecord* zm_traceRecord(zm_VM *vm, int kind, uint64_t ts)
+{
+	zm_TraceRecord *r;
+
+	if (vm->tracer.used == vm->tracer.size) {
+		vm->tracer.lost++;
+		return NULL;
+	}
+
+	r = &(vm->tracer.records[vm->tracer.used++]);
+
+	r->ts = ts - vm->tracer.t0;
+	r->dur = 0;
+	r->from = 0;
+	r->to = 0;
+	r->event = NULL;
+	r->name = NULL;
+	r->count = 0;
+	r->kind = (uint8_t)kind;
+	r->resume = 0;
+	r->cmd = 0;
+
+	return r;
+}
+
+
+static void zm_traceStep(zm_VM *vm, zm_Worker *worker, zm_State *s,
+                         int resume, zm_Yield y)
+{
+	zm_TraceRecord *r = zm_traceRecord(vm, ZM_TRACE_STEP, vm->tracer.step);
+
+	if (!r)
+		return;
+
+	r->dur = zm_nanotime() - vm->tracer.step;
+	r->from = s->traceid;
+	r->name = worker->machine->name;
+	r->resume = (uint8_t)resume;
+	r->cmd = (uint8_t)y.cmd;
+}
+
+
+/*
+ * Call and return edges are stamped with the begin of the step that
+ * cause them (so the viewer bind the edge to that step).
+ */
+static void zm_traceEdge(zm_VM *vm, int kind, zm_State *from, zm_State *to)
+{
+	zm_TraceRecord *r;
+
+	if (!vm->tracer.on)
+		return;
+
+	r = zm_traceRecord(vm, kind, vm->tracer.step);
+
+	if (!r)
+		return;
+
+	r->from = from->traceid;
+	r->to = to->traceid;
+}
+
+
+static void zm_traceTrigger(zm_VM *vm, zm_Event *event, size_t count)
+{
+	zm_TraceRecord *r;
+
+	if (!vm->tracer.on)
+		return;
+
+	r = zm_traceRecord(vm, ZM_TRACE_TRIGGER, zm_nanotime());
+
+	if (!r)
+		return;
+
+	r->event = event;
+	r->count = (uint32_t)count;
+}
+
+
+/* ns to chrome trace us */
+static void zm_traceWriteTime(FILE *f, const char *key, uint64_t ns)
+{
+	fprintf(f, "\"%s\":%lu.%03u", key, (unsigned long)(ns / 1000),
+	        (unsigned int)(ns % 1000));
+}
+
+
+static void zm_traceWriteString(FILE *f, const char *str)
+{
+	fputc('"', f);
+
+	for (; (str) && (*str); str++) {
+		if ((*str == '"') || (*str == '\\'))
+			fputc('\\', f);
+
+		if ((unsigned char)*str < 0x20)
+			fputc('?', f);
+		else
+			fputc(*str, f);
+	}
+
+	fputc('"', f);
+}
+
+
+/*
+ * Write the records in Chrome trace-event JSON (chrome://tracing or
+ * ui.perfetto.dev). Each task is a thread (tid = task id, the address is
+ * reused by the arena) named by its machine, steps are complete events,
+ * call and return edges are flow events and triggers are instant events
+ * of the vm thread (tid 0).
+ * Return the number of written records.
+ */
+size_t zm_writeTrace(zm_VM *vm, FILE *f)
+{
+	uint64_t *named = NULL;
+	size_t nnamed = 0, i, j;
+	const char *sep = "";
+
+	/* tasks already named (open addressing, 2 * records slots) */
+	if (vm->tracer.used) {
+		nnamed = vm->tracer.used * 2;
+		named = zm_nalloc(uint64_t, nnamed);
+		memset(named, 0, nnamed * sizeof(uint64_t));
+	}
+
+	fprintf(f, "{\"traceEvents\":[\n");
+
+	fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+	           "\"tid\":0,\"args\":{\"name\":");
+	zm_traceWriteString(f, vm->name);
+	fprintf(f, "}}");
+
+	sep = ",\n";
+
+	for (i = 0; i < vm->tracer.used; i++) {
+		zm_TraceRecord *r = &(vm->tracer.records[i]);
+		unsigned long from = (unsigned long)r->from;
+		unsigned long to = (unsigned long)r->to;
+
+		switch (r->kind) {
+		case ZM_TRACE_STEP:
+			if (named) {
+				j = from % nnamed;
+
+				while ((named[j]) && (named[j] != r->from))
+					j = (j + 1) % nnamed;
+
+				if (!named[j]) {
+					named[j] = r->from;
+					fprintf(f, "%s{\"name\":\"thread_name\","
+					        "\"ph\":\"M\",\"pid\":1,"
+					        "\"tid\":%lu,\"args\":{\"name\":",
+					        sep, from);
+					zm_traceWriteString(f, r->name);
+					fprintf(f, "}}");
+				}
+			}
+
+			fprintf(f, "%s{\"name\":", sep);
+			zm_traceWriteString(f, r->name);
+			fprintf(f, ",\"cat\":\"step\",\"ph\":\"X\",");
+			zm_traceWriteTime(f, "ts", r->ts);
+			fputc(',', f);
+			zm_traceWriteTime(f, "dur", r->dur);
+			fprintf(f, ",\"pid\":1,\"tid\":%lu,\"args\":{"
+			           "\"zmstate\":%d,\"yield\":\"%s\"}}", from,
+			           r->resume, zm_yieldCmdName(r->cmd));
+			break;
+
+		case ZM_TRACE_CALL:
+		case ZM_TRACE_RETURN: {
+			const char *n = (r->kind == ZM_TRACE_CALL) ? "call" :
+			                                             "return";
+
+			fprintf(f, "%s{\"name\":\"%s\",\"cat\":\"sub\","
+			           "\"ph\":\"s\",\"id\":%zu,", sep, n, i);
+			zm_traceWriteTime(f, "ts", r->ts);
+			fprintf(f, ",\"pid\":1,\"tid\":%lu}", from);
+
+			fprintf(f, "%s{\"name\":\"%s\",\"cat\":\"sub\","
+			           "\"ph\":\"f\",\"id\":%zu,", sep, n, i);
+			zm_traceWriteTime(f, "ts", r->ts);
+			fprintf(f, ",\"pid\":1,\"tid\":%lu}", to);
+			break;
+		}
+
+		case ZM_TRACE_TRIGGER:
+			fprintf(f, "%s{\"name\":\"trigger\",\"cat\":\"event\","
+			           "\"ph\":\"i\",\"s\":\"p\",", sep);
+			zm_traceWriteTime(f, "ts", r->ts);
+			fprintf(f, ",\"pid\":1,\"tid\":0,\"args\":{"
+			           "\"event\":\"%p\",\"resumed\":%u}}",
+			           r->event, (unsigned int)r->count);
+			break;
+		}
+	}
+
+	fprintf(f, "\n],\"displayTimeUnit\":\"ns\",\"otherData\":{"
+	           "\"lost\":%zu}}\n", vm->tracer.lost);
+
+	if (named)
+		zm_nfree(uint64_t, nnamed, named);
+
+	return vm->tracer.used;
+}
+#endif
+
+
+/* ----------------------------------------------------------------------------
+ *  STATE ARENA                                                  (SECTION CORE)
+ * --------------------------------------------------------------------------*/
+
+static void zm_arenaLinkFree(zm_VM *vm, zm_Arena *a)
+{
+	a->prevfree = NULL;
+	a->nextfree = vm->arena.partial;
+
+	if (vm->arena.partial)
+		vm->arena.partial->prevfree = a;
+
+	vm->arena.partial = a;
+}
+
+
+static void zm_arenaUnlinkFree(zm_VM *vm, zm_Arena *a)
+{
+	if (a->prevfree)
+		a->prevfree->nextfree = a->nextfree;
+	else
+		vm->arena.partial = a->nextfree;
+
+	if (a->nextfree)
+		a->nextfree->prevfree = a->prevfree;
+}
+
+
+/* put a state (free or never used) in the free list of its chunk */
+static void zm_arenaPush(zm_VM *vm, zm_Arena *a, zm_State *s)
+{
+	if (!a->freelist)
+		zm_arenaLinkFree(vm, a);
+
+	s->next = a->freelist;
+	a->freelist = s;
+}
+
+
+/* free a chunk without live states */
+static void zm_arenaRelease(zm_VM *vm, zm_Arena *a)
+{
+	if (a->freelist)
+		zm_arenaUnlinkFree(vm, a);
+
+	if (a->prev)
+		a->prev->next = a->next;
+	else
+		vm->arena.chunks = a->next;
+
+	if (a->next)
+		a->next->prev = a->prev;
+
+	zm_mfree(sizeof(zm_Arena) + a->size * sizeof(zm_State), a);
+}
+
+
+/*
+ * Take n contiguous states from the arena. States are carved from per-vm
+ * chunks of ZM_ARENA_CHUNK states (or n if bigger) and recycled through
+ * the free list of their chunk: zm_destroyVM (and zm_freeVM) release the
+ * chunks still in use with a free per chunk.
+ */
+static zm_State* zm_arenaCarve(zm_VM *vm, size_t n)
+{
+	zm_Arena *a = vm->arena.chunks;
+	zm_State *s;
+	size_t i;
+
+	if ((!a) || (a->size - vm->arena.used < n)) {
+		size_t size = (n > ZM_ARENA_CHUNK) ? n : ZM_ARENA_CHUNK;
+
+		/* recycle the rest of the current chunk (or free it) */
+		if ((a) && (!a->live)) {
+			zm_arenaRelease(vm, a);
+		} else {
+			for (; (a) && (vm->arena.used < a->size); vm->arena.used++)
+				zm_arenaPush(vm, a, &(a->states[vm->arena.used]));
+		}
+
+		a = zm_malloc(sizeof(zm_Arena) + size * sizeof(zm_State));
+		a->prev = NULL;
+		a->next = vm->arena.chunks;
+		a->nextfree = NULL;
+		a->prevfree = NULL;
+		a->freelist = NULL;
+		a->size = size;
+		a->live = 0;
+
+		if (a->next)
+			a->next->prev = a;
+
+		vm->arena.chunks = a;
+		vm->arena.used = 0;
+	}
+
+	s = &(a->states[vm->arena.used]);
+	vm->arena.used += n;
+	a->live += n;
+
+	for (i = 0; i < n; i++)
+		s[i].arena = a;
+
+	return s;
+}
+
+
+static zm_State* zm_stateAlloc(zm_VM *vm)
+{
+	zm_Arena *a = vm->arena.partial;
+	zm_State *s;
+
+	if (!a)
+		return zm_arenaCarve(vm, 1);
+
+	s = a->freelist;
+	a->freelist = s->next;
+	a->live++;
+
+	if (!a->freelist)
+		zm_arenaUnlinkFree(vm, a);
+
+	return s;
+}
+
+
+/*
+ * The fields used by few tasks (subscription ...) are out of the state: the
+ * extension is allocated on the first use and free with the state.
+ */
+static zm_StateExt* zm_stateExt(zm_State *s)
+{
+	if (!s->ext) {
+		s->ext = zm_alloc(zm_StateExt);
+		s->ext->subscription = NULL;
+		s->ext->timer = NULL;
+		s->ext->join = NULL;
+		s->ext->group.group = NULL;
+	}
+
+	return s->ext;
+}
+
+
+static void zm_freeStateExt(zm_State *s)
+{
+	if (s->ext) {
+		zm_free(zm_StateExt, s->ext);
+		s->ext = NULL;
+	}
+}
+
+
+/*
+ * A chunk is free as soon as all its states are free (but the chunk in
+ * carving): the memory of a vm is bound to its live tasks and not to its
+ * peak (only a chunk partially used is retained).
+ */
+static void zm_stateFree(zm_VM *vm, zm_State *s)
+{
+	zm_Arena *a = s->arena;
+
+	zm_freeStateExt(s);
+
+	a->live--;
+
+	if ((!a->live) && (a != vm->arena.chunks))
+		zm_arenaRelease(vm, a);
+	else
+		zm_arenaPush(vm, a, s);
+}
+
+
+static void zm_arenaFree(zm_VM *vm)
+{
+	zm_Arena *a = vm->arena.chunks;
+
+	while (a) {
+		zm_Arena *next = a->next;
+		zm_mfree(sizeof(zm_Arena) + a->size * sizeof(zm_State), a);
+		a = next;
+	}
+
+	vm->arena.chunks = NULL;
+	vm->arena.used = 0;
+	vm->arena.partial = NULL;
+}
+
+
+/* ----------------------------------------------------------------------------
+ *  TASK & SUBTASK                                               (SECTION CORE)
+ * --------------------------------------------------------------------------*/
+
+
+static void zm_addStateToSiblingsRing(zm_State **first, zm_State *state)
+{
+	if ((*first) == NULL) {
+		(*first) = state;
+		state->siblings.next = state->siblings.prev = state;
+	} else {
+		/* put state as the second element
+		   (between child and child.next)*/
+		state->siblings.next = (*first)->siblings.next;
+		state->siblings.prev = (*first);
+
+		(*first)->siblings.next->siblings.prev = state;
+		(*first)->siblings.next = state;
+	}
+
+}
+
+
+static void zm_addParent(zm_VM *vm, zm_State* s, const char *ref,
+                                 const char *filename, int nline)
+{
+	zm_Parent *parent = zm_alloc(zm_Parent);
+	zm_State *current = zm_getCurrentState(vm);
+	size_t deep = zm_getDeep(current) + 1;
+
+	if (zm_hasFlag(current, ZM_STATE_IMPLOSIONLOCK)) {
+		zm_fatalInitAt(vm, ref, filename, nline);
+		zm_fatalDo(ZM_FATAL_TCODE, "ADDTASK.P",
+		           "cannot create task in ZM_TERM");
+	}
+
+	parent->stacksize = deep;
+	parent->stack = zm_nalloc(zm_State*, deep);
+
+	if (deep > 1) {
+		memcpy(parent->stack, current->parent->stack,
+		       (deep-1) * sizeof(zm_State*));
+	}
+
+	parent->stack[ deep - 1 ] = current;
+
+	parent->comeback = NULL;
+
+	s->parent = parent;
+}
+
+
+static void zm_runInit(zm_VM *vm, zm_Worker *worker, zm_State *s, int sub)
+{
+	zm_Yield y = zm_machineStep0(vm, worker, s);
+
+	if (ZM_B4(y.cmd) != ZM_TASK_INIT) {
+		zm_fatalInit(vm, NULL);
+		zm_fatalDo(ZM_FATAL_YCODE, "YDONE.WY",
+		           "task in constructor mode (ZM_INIT) can yield "
+		           "only to zmDONE");
+	}
+}
+
+
+static void zm_initState(zm_VM *vm, zm_State *state, zm_Machine *machine,
+                                                   void *data, int flag)
+{
+	state->pmode = ZM_PMODE_NORMAL;
+	state->flag = flag;
+
+	if (machine->noterm)
+		zm_enableFlag(state, ZM_STATE_NOTERM);
+
+	state->on.resume = ZM_FIRST;
+	state->on.iter = 0;
+	state->on.c4tch = 0;
+	state->rearg = NULL;
+	state->data = data;
+	state->subtasks = NULL;
+	state->exception = NULL;
+	state->ext = NULL;
+	#ifdef ZM_ENABLE_LATENCY
+	state->resumed = 0;
+	#endif
+	#ifdef ZM_ENABLE_CENSUS
+	state->census = NULL;
+	#endif
+	#ifdef ZM_ENABLE_TRACE
+	state->traceid = ++vm->tracer.lastid;
+	#endif
+	state->codeframe.filename = "<not set>";
+	state->codeframe.nline = 0;
+	#ifdef ZM_DEBUG_MACHINENAME
+	state->debugmachinename = machine->name;
+	#endif
+}
+
+
+zm_State* izm_addTask(zm_VM *vm, zm_Machine *machine, void *data, int sub,
+                                         int flag, const char *fn, int nl)
+{
+	zm_State* state = zm_stateAlloc(vm);
+	zm_Worker *worker;
+
+	ZM_D("zm_addTask %s: %s", sub ? "subtask" : "ptask", machine->name);
+
+	zm_initState(vm, state, machine, data, flag);
+
+	worker = zm_getWorker(vm, machine);
+
+	#ifdef ZM_ENABLE_STATS
+	zm_statsCreated(worker, 1);
+	#endif
+
+	if (sub) {
+		const char *fname = (flag & ZM_STATE_AUTOFREE) ?
+		                    "zmNewSubTasklet" : "zmNewSubTask";
+		zm_State *current = zm_getCurrentState(vm);;
+
+		ZM_ASSERT_VMLOCK("ADDTASK.VLCK", fname, fn, nl);
+
+		zm_addParent(vm, state, fname, fn, nl);
+
+		zm_addStateToSiblingsRing(&(current->subtasks), state);
+	} else {
+		state->parent = NULL;
+
+		zm_addStateToSiblingsRing(&(vm->ptasks), state);
+
+		vm->nptask++;
+	}
+
+	/* task and subtask are created suspended */
+	state->next = (zm_State*)worker;
+
+	#ifdef ZM_ENABLE_CENSUS
+	zm_censusAdd(vm, worker, state);
+	#endif
+
+	if (vm->deferinit)
+		zm_enableFlag(state, ZM_STATE_NOINIT);
+	else
+		zm_runInit(vm, worker, state, sub);
+
+	ZM_D("zm_addTask = %zx", state);
+
+	return state;
+}
+
+
+/*
+ * Create n ptasks of the same machine (data from datas, or NULL if
+ * datas is NULL) and store them in out. The states are contiguous in
+ * the arena, the worker is resolved once and the constructors (ZM_INIT)
+ * run in a single session switch.
+ */
+void izm_addTasks(zm_VM *vm, zm_Machine *machine, void **datas, size_t n,
+                  zm_State **out, int flag, const char *fn, int nl)
+{
+	zm_State *savestate = vm->session.state;
+	zm_Worker *saveworker = vm->session.worker;
+	int savelock = vm->plock;
+	zm_Worker *worker;
+	zm_State *states;
+	size_t i;
+
+	ZM_D("zm_addTasks %zu ptask: %s", n, machine->name);
+
+	if (!n)
+		return;
+
+	worker = zm_getWorker(vm, machine);
+	states = zm_arenaCarve(vm, n);
+
+	#ifdef ZM_ENABLE_STATS
+	zm_statsCreated(worker, n);
+	#endif
+
+	if (vm->deferinit)
+		flag |= ZM_STATE_NOINIT;
+
+	vm->plock = true;
+	vm->session.worker = worker;
+
+	for (i = 0; i < n; i++) {
+		zm_State *state = &states[i];
+		zm_yield_t y;
+
+		zm_initState(vm, state, machine, (datas) ? datas[i] : NULL,
+		             flag);
+
+		state->parent = NULL;
+		zm_addStateToSiblingsRing(&(vm->ptasks), state);
+
+		/* task are created suspended */
+		state->next = (zm_State*)worker;
+
+		#ifdef ZM_ENABLE_CENSUS
+		zm_censusAdd(vm, worker, state);
+		#endif
+
+		out[i] = state;
+
+		if (vm->deferinit)
+			continue;
+
+		vm->session.state = state;
+
+		y = (machine->fun)(vm, ZM_INIT, NULL);
+
+		if (ZM_B4(zm_r2Y(y).cmd) != ZM_TASK_INIT) {
+			zm_fatalInitAt(vm, "zm_newTasks", fn, nl);
+			zm_fatalDo(ZM_FATAL_YCODE, "YDONE.WY",
+			           "task in constructor mode (ZM_INIT) can "
+			           "yield only to zmDONE");
+		}
+	}
+
+	vm->nptask += n;
+
+	vm->session.state = savestate;
+	vm->session.worker = saveworker;
+	vm->plock = savelock;
+}
+
+
+/**
+ * If the task is ready to be free the request can be performed in a
+ * sync way and the function return true otherwise the function return
+ * false
+ */
+static int zm_requestFreeState(zm_VM *vm, zm_State *state, const char* refname)
+{
+	ZM_D("request free state by: %s state=%zx", refname, state);
+
+	if (zm_hasFlag(state, ZM_STATE_AUTOFREE)) {
+		zm_fatalInit(vm, refname);
+		zm_fatalDo(ZM_FATAL_GCODE, "RFREEST.AF",
+		           "cannot request to free a state "
+		           "that is just marked to be free");
+	}
+
+	if (state->pmode == ZM_PMODE_OFF) {
+		/*** this pmode is set by ZM_PMODE_END */
+		/*** then is possible to free state in a sync way*/
+		zm_stateFree(vm, state);
+		return true;
+	}
+
+	if (zm_hasntFlag(state, ZM_STATE_IMPLOSIONLOCK)) {
+		zm_fatalInit(vm, refname);
+		zm_fatalDo(ZM_FATAL_GCODE, "RFREEST.AT",
+		           "cannot free an active task");
+	}
+
+	/* if ZM_STATE_IMPLOSIONLOCK the state will be closed but
+	 * is not just closed because pmode != ZM_PMODE_OFF
+	 * ==> set autofree flag to perform an async free */
+	zm_enableFlag(state, ZM_STATE_AUTOFREE);
+
+	return false;
+}
+
+
+int zm_freeTask(zm_VM *vm, zm_State *state)
+{
+	/* #FREE_TASK_KIND */
+	if (zm_isSubTask(state)) {
+		zm_fatalInit(vm, "zm_freeTask");
+		zm_fatalDo(ZM_FATAL_GCODE, "FREET.S",
+		           "expected a ptask but found a subtask");
+	}
+
+	return zm_requestFreeState(vm, state, "zm_freeTask");
+}
+
+
+int zm_freeSubTask(zm_VM *vm, zm_State *state)
+{
+	/* #FREE_TASK_KIND */
+	if (zm_isTask(state)) {
+		zm_fatalInit(vm, "zm_freeSubTask");
+		zm_fatalDo(ZM_FATAL_GCODE, "FREES.T",
+		           "expected a subtask but found a ptask");
+	}
+
+	return zm_requestFreeState(vm, state, "zm_freeSubTask");
+}
+
+
+int zm_freeState(zm_VM *vm, zm_State *state)
+{
+	return zm_requestFreeState(vm, state, "zm_freeState");
+}
+
+
+/* ** bulk release (zm_destroyVM) ** */
+
+/* next state of a ptask data-tree visit (NULL at the end) */
+static zm_State* zm_treeNext(zm_State *root, zm_State *s)
+{
+	if (s->subtasks)
+		return s->subtasks;
+
+	while (s != root) {
+		zm_State *p = zm_getParent(s);
+
+		if (s->siblings.next != p->subtasks)
+			return s->siblings.next;
+
+		s = p;
+	}
+
+	return NULL;
+}
+
+
+/*
+ * A ptask can be released in bulk if all the states of its data-tree
+ * are no-term (see zm_setNoTerm) and quiet: not closing, not cancelled
+ * and without exception.
+ */
+static int zm_canRelease(zm_State *root)
+{
+	zm_State *s = root;
+
+	do {
+		if (zm_hasntFlag(s, ZM_STATE_NOTERM))
+			return false;
+
+		if (zm_hasFlag(s, ZM_STATE_IMPLOSIONLOCK | ZM_STATE_IMPLODING |
+		                  ZM_STATE_CANCEL))
+			return false;
+
+		if ((s->pmode != ZM_PMODE_NORMAL) || (s->exception))
+			return false;
+	} while ((s = zm_treeNext(root, s)));
+
+	return true;
+}
+
+
+/*
+ * Detach a state from events, timers and group. The state memory is
+ * left to the arena.
+ */
+static void zm_releaseState(zm_VM *vm, zm_State *s)
+{
+	#ifdef ZM_ENABLE_CENSUS
+	zm_censusRemove(vm, s);
+	#endif
+
+	if (zm_hasFlag(s, ZM_STATE_EVENTLOCKED)) {
+		zm_EventBinder *evb = (zm_EventBinder*)s->next;
+
+		if (zm_ext(s, timer))
+			zm_cancelTimer(vm, s->ext->timer);
+
+		if (!zm_subscriptionOf(evb)) {
+			zm_removeBinder(evb);
+			zm_free(zm_EventBinder, evb);
+		}
+	}
+
+	/* an unbound subscription is just out of the bindlist */
+	if (zm_ext(s, subscription))
+		zm_dropSubscription(vm, s, NULL, 0);
+
+	if (zm_ext(s, join))
+		zm_freeJoin(vm, s);
+
+	if (zm_groupLink(s))
+		zm_groupUnlink(s);
+
+	zm_freeStateExt(s);
+
+	if (zm_isSubTask(s)) {
+		zm_nfree(zm_State*, zm_deep(s), s->parent->stack);
+		zm_free(zm_Parent, s->parent);
+	}
+
+	/* mark for zm_releaseWorkers */
+	s->pmode = ZM_PMODE_OFF;
+}
+
+
+static void zm_releaseTask(zm_VM *vm, zm_State *root)
+{
+	zm_State *s = root;
+
+	ZM_D("release task %zx", root);
+
+	zm_removeStateFromSiblings(vm, root);
+
+	/* post-order: subtasks are released before their parent */
+	for (;;) {
+		zm_State *p, *next;
+
+		while (s->subtasks)
+			s = s->subtasks;
+
+		if (s == root)
+			break;
+
+		p = zm_getParent(s);
+		next = s->siblings.next;
+
+		zm_releaseState(vm, s);
+
+		if (next == p->subtasks) {
+			p->subtasks = NULL;
+			s = p;
+		} else {
+			s = next;
+		}
+	}
+
+	zm_releaseState(vm, root);
+}
+
+
+/* remove released (running) states from the worker lists */
+static void zm_releaseWorkers(zm_VM *vm)
+{
+	size_t i;
+
+	for (i = 0; i < vm->mwh.len; i++) {
+		zm_Worker *w = vm->mwh.hlist[i];
+		zm_State *s, *last = NULL;
+
+		if ((!w) || (!w->nstate))
+			continue;
+
+		s = w->states.first;
+		w->states.first = NULL;
+		w->nstate = 0;
+
+		while (s) {
+			zm_State *next = s->next;
+
+			if (s->pmode != ZM_PMODE_OFF) {
+				if (last)
+					last->next = s;
+				else
+					w->states.first = s;
+
+				last = s;
+				w->nstate++;
+			}
+
+			s = next;
+		}
+
+		if (last)
+			last->next = NULL;
+
+		w->states.current = w->states.first;
+		w->states.previous = NULL;
+
+		if (!w->nstate)
+			zm_unlinkWorker(vm, w);
+	}
+}
+
+
+/*
+ * yield to a subtask (inside-task yield-operator)
+ * alias: zmSUB, zmSSUB
+ */
+zm_yield_t izmSUB(zm_VM* vm, zm_State *s, void* argument, int allowunraise,
+                                           const char *filename, int nline)
+{
+	const char *rn = (allowunraise) ? "zmSSUB" : "zmSUB";
+
+	ZM_ASSERT_VMLOCK("ACTSUB.VLCK", rn, filename, nline);
+
+	ZM_D("yield SUB(state: [ref %zx])\n", s);
+
+	if (zm_isTask(s)) {
+		zm_fatalInitAt(vm, rn, filename, nline);
+		zm_fatalDo(ZM_FATAL_YCODE, "ACTSUB.NS",
+		           "expected a subtask but found a task "
+		           "(use instead: zm_resume)");
+
+	}
+
+	if (zm_hasFlag(s, ZM_STATE_IMPLOSIONLOCK)) {
+		zm_fatalInitAt(vm, rn, filename, nline);
+		zm_fatalDo(ZM_FATAL_YCODE, "ACTSUB.LI",
+		           "try to resume a closed subtask");
+	}
+
+	zm_canBeContextStackPush(vm,  s, rn, filename, nline);
+
+	if (zm_hasFlag(s, ZM_STATE_WAITING)) {
+		if (zm_hasException(s, ZM_EXCEPTION_CONTINUEHEAD)) {
+			if (!allowunraise) {
+				zm_fatalInitAt(vm, rn, filename, nline);
+				zm_fatalDo(ZM_FATAL_YCODE, "ACTSUB.C",
+						   "try to resume a subtask "
+						   "with a continue-exception "
+						   "(use instead zmUNRAISE or "
+						   "zmSSUB)");
+			}
+
+			zm_unraise(vm, s, argument, "zmSSUB", filename, nline);
+
+			return ZM_TASK_SUSPEND_WAITING_SUBTASK;
+		}
+
+		if (zm_getParent(zm_getCurrentState(vm)) == s) {
+			zm_fatalInitAt(vm, rn, filename, nline);
+			zm_fatalDo(ZM_FATAL_YCODE, "ACTSUB.WP",
+			                 "try to resume a subtask that is the "
+			                 "previous element in execution-stack; "
+			                 "use instead zmyield zmCALLER");
+		} else if (allowunraise) {
+			if (zm_hasException(s, ZM_EXCEPTION_CONTINUE)) {
+				zm_fatalInitAt(vm, rn, filename, nline);
+				zm_fatalDo(ZM_FATAL_YCODE, "ACTSUB.WT",
+					   "try to resume a waiting subtask or "
+					   "unraise the continue-exception "
+					   "tail");
+			} else {
+				zm_fatalInitAt(vm, rn, filename, nline);
+				zm_fatalDo(ZM_FATAL_YCODE, "ACTSUB.WR",
+					   "try to resume a waiting subtask "
+					   "or unraise a subtask without "
+					   "continue-exception");
+			}
+		} else {
+			zm_fatalInitAt(vm, rn, filename, nline);
+			zm_fatalDo(ZM_FATAL_YCODE, "ACTSUB.WS",
+					   "try to resume a waiting subtask");
+		}
+	}
+
+	zm_setCaller(s, zm_getCurrentState(vm));
+
+	#ifdef ZM_ENABLE_TRACE
+	zm_traceEdge(vm, ZM_TRACE_CALL, zm_getCurrentState(vm), s);
+	#endif
+
+	zm_checkResumeBy(vm, s, rn, filename, nline);
+	zm_setArgument(s, argument);
+	zm_resumeNext(vm, s);
+
+	return ZM_TASK_SUSPEND_WAITING_SUBTASK;
+}
+
+
+zm_yield_t izmSUBJOIN(zm_VM* vm, zm_State **subs, size_t n, int mode,
+                                  const char *filename, int nline)
+{
+	const char *rn = (mode == ZM_JOIN_ANY) ? "zmSUBANY" : "zmSUBALL";
+	zm_State *current;
+	zm_Join *join;
+	size_t i;
+
+	ZM_ASSERT_VMLOCK("SUBJOIN.VLCK", rn, filename, nline);
+
+	current = zm_getCurrentState(vm);
+
+	ZM_D("yield %s(%zu subtasks)\n", rn, n);
+
+	if (n == 0) {
+		zm_fatalInitAt(vm, rn, filename, nline);
+		zm_fatalDo(ZM_FATAL_YCODE, "SUBJOIN.0", "empty subtask list");
+	}
+
+	/* check all members before resume the first one */
+	for (i = 0; i < n; i++) {
+		zm_State *s = subs[i];
+
+		if (zm_isTask(s)) {
+			zm_fatalInitAt(vm, rn, filename, nline);
+			zm_fatalDo(ZM_FATAL_YCODE, "SUBJOIN.NS",
+			           "expected a subtask but found a task "
+			           "(subs[%zu])", i);
+		}
+
+		if (zm_getParent(s) != current) {
+			zm_fatalInitAt(vm, rn, filename, nline);
+			zm_fatalDo(ZM_FATAL_YCODE, "SUBJOIN.NC",
+			           "%s can resume only its child (subs[%zu])",
+			           rn, i);
+		}
+
+		if (zm_hasFlag(s, ZM_STATE_IMPLOSIONLOCK)) {
+			zm_fatalInitAt(vm, rn, filename, nline);
+			zm_fatalDo(ZM_FATAL_YCODE, "SUBJOIN.LI",
+			           "try to resume a closed subtask "
+			           "(subs[%zu])", i);
+		}
+
+		if (zm_hasFlag(s, ZM_STATE_RUN | ZM_STATE_WAITING)) {
+			zm_fatalInitAt(vm, rn, filename, nline);
+			zm_fatalDo(ZM_FATAL_YCODE, "SUBJOIN.WS",
+			           "try to resume a running or waiting "
+			           "subtask (subs[%zu])", i);
+		}
+
+		if (zm_getCaller(s) == current) {
+			zm_fatalInitAt(vm, rn, filename, nline);
+			zm_fatalDo(ZM_FATAL_YCODE, "SUBJOIN.DUP",
+			           "subtask subs[%zu] found twice", i);
+		}
+
+		zm_setCaller(s, current);
+	}
+
+	join = zm_alloc(zm_Join);
+	join->mode = mode;
+	join->pending = n;
+	join->winner = NULL;
+	join->exception = NULL;
+	join->timer = NULL;
+
+	zm_stateExt(current)->join = join;
+
+	for (i = 0; i < n; i++) {
+		#ifdef ZM_ENABLE_TRACE
+		zm_traceEdge(vm, ZM_TRACE_CALL, current, subs[i]);
+		#endif
+
+		zm_resumeStateBy(vm, subs[i], NULL, rn, filename, nline);
+	}
+
+	return ZM_TASK_SUSPEND_WAITING_SUBTASK;
+}
+
+
+/*
+ * yield to a subtask with a deadline: when ms are elapsed the subtask
+ * is closed and a timeout exception (data = ZM_TIMEOUT) is raised in
+ * the caller
+ */
+zm_yield_t izmSUB_DEADLINE(zm_VM* vm, zm_State *s, void* argument,
+                           unsigned int ms, const char *filename, int nline)
+{
+	zm_State *current;
+	zm_Join *join;
+
+	ZM_ASSERT_VMLOCK("SUBDL.VLCK", "zmSUB_DEADLINE", filename, nline);
+
+	current = zm_getCurrentState(vm);
+
+	if ((zm_isSubTask(s)) && (zm_getParent(s) != current)) {
+		zm_fatalInitAt(vm, "zmSUB_DEADLINE", filename, nline);
+		zm_fatalDo(ZM_FATAL_YCODE, "SUBDL.NC",
+		           "zmSUB_DEADLINE can resume only its child");
+	}
+
+	izmSUB(vm, s, argument, false, filename, nline);
+
+	join = zm_alloc(zm_Join);
+	join->mode = ZM_JOIN_DEADLINE;
+	join->pending = 1;
+	join->winner = NULL;
+	join->exception = NULL;
+	join->timer = zm_addTimer(vm, ms);
+	join->timer->deadline = current;
+
+	zm_stateExt(current)->join = join;
+
+	return ZM_TASK_SUSPEND_WAITING_SUBTASK;
+}
+
+
+/*
+ *
+ */
+zm_yield_t izm_resume(const char *fname, zm_VM* vm, zm_State *s, void *argument,
+                                      int iter, const char *filename, int nline)
+{
+	if (zm_hasFlag(s, ZM_STATE_RUN | ZM_STATE_WAITING)) {
+		if (zm_hasFlag(s, ZM_STATE_RUN)) {
+			zm_fatalInitAt(vm, fname, filename, nline);
+			zm_fatalDo(ZM_FATAL_GCODE, "ACTTASK.R",
+			           "try to active a just active task");
+		} else {
+			zm_fatalInitAt(vm, fname, filename, nline);
+			zm_fatalDo(ZM_FATAL_GCODE, "ACTTASK.WS",
+				   "try to resume a busy-waiting task");
+		}
+	}
+
+	if (zm_isSubTask(s)) {
+		zm_fatalInitAt(vm, fname, filename, nline);
+		zm_fatalDo(ZM_FATAL_GCODE, "ACTTASK.NP",
+		           "expected a task but found a subtask "
+		           "(use instead: zmSUB)");
+	}
+
+
+	/* FIXME not sure is still right after remove zmTO */
+	if (iter) {
+		/*  [ON_RESUME_SWITCH]*/
+		if (s->on.iter) {
+			s->on.resume = s->on.iter;
+		}
+	}
+
+	ZM_D("activeTask (%s): iter = %d", fname, iter);
+
+	zm_resumeStateBy(vm, s, argument, fname, filename, nline);
+
+	if (iter)
+		return ZM_TASK_SUSPEND;
+
+	return ZM_TASK_TERM;
+}
+
+
+
+
+
+
+#ifdef ZM_ENABLE_AIO
+static void zm_aioFree(zm_VM *vm);
+#endif
+
+
+/* ----------------------------------------------------------------------------
+ *  VIRTUAL MAPPER                                               (SECTION CORE)
+ * --------------------------------------------------------------------------*/
+
+zm_VM* zm_newVM(const char *name)
+{
+	zm_VM* vm;
+
+	vm = zm_alloc(zm_VM);
+
+	vm->data = NULL;
+
+	vm->plock = false;
+	vm->pause = false;
+
+	vm->prepost = NULL;
+	vm->inlinesub = 0;
+	vm->deferinit = false;
+
+	#ifdef ZM_ENABLE_RECORDER
+	memset(vm->recorder.ring, 0, sizeof(vm->recorder.ring));
+	vm->recorder.seq = 0;
+	#endif
+
+	#ifdef ZM_ENABLE_TRACE
+	vm->tracer.records = NULL;
+	vm->tracer.size = 0;
+	vm->tracer.used = 0;
+	vm->tracer.lost = 0;
+	vm->tracer.on = false;
+	vm->tracer.t0 = 0;
+	vm->tracer.step = 0;
+	vm->tracer.lastid = 0;
+	#endif
+
+	#ifdef ZM_ENABLE_LATENCY
+	memset(&(vm->latency), 0, sizeof(zm_Histogram));
+	#endif
+
+	#ifdef ZM_ENABLE_CENSUS
+	memset(vm->censusdepth, 0, sizeof(vm->censusdepth));
+	#endif
+
+	/** ptasks contain a pointer to a ptask of the vm or NULL when empty */
+	/** all ptask are connected througth siblings so this pointer allow*/
+	/** to access all the task (and relative subtask) of the vm*/
+	vm->ptasks = NULL;
+
+	vm->nptask = 0;
+	vm->nworker = 0;
+
+	zm_mwhInit(vm);
+
+	vm->workercursor = NULL;
+	vm->session.state = NULL;
+	vm->session.worker = NULL;
+	vm->session.fixedworker = false;
+	vm->session.suspendop = 0;
+	vm->session.readyarg = NULL;
+	vm->session.handoff = NULL;
+	vm->session.nest = 0;
+	vm->session.stepping = false;
+
+	vm->name = name;
+	vm->uncaught = NULL;
+
+	vm->implosions.slice = 0;
+	vm->implosions.first = NULL;
+	vm->implosions.last = NULL;
+
+	vm->arena.chunks = NULL;
+	vm->arena.used = 0;
+	vm->arena.partial = NULL;
+
+	vm->epool.exceptions = NULL;
+	vm->epool.traces = NULL;
+
+	vm->timers.wheel = NULL;
+	vm->timers.freelist = NULL;
+	vm->timers.count = 0;
+	vm->timers.last = 0;
+	vm->timers.clock = NULL;
+
+	#ifdef ZM_ENABLE_EPOLL
+	vm->epoll.fd = -1;
+	vm->epoll.nfdevent = 0;
+	#endif
+
+	#ifdef ZM_ENABLE_AIO
+	vm->aio = NULL;
+	#endif
+
+	return vm;
+}
+
+
+
+int zm_closeVM(zm_VM* vm)
+{
+	zm_State *state = vm->ptasks;
+	#ifdef ZM_CHECK_CONSISTENCY
+	size_t n = vm->nptask;
+	#endif
+
+	if (!state)
+		return true;
+
+	if (vm->plock) {
+		/* can be replaced with ZM_ASSERT_VMUNLOCK TODO */
+		zm_fatalInit(vm, "zm_closeVM");
+		zm_fatalDo(ZM_FATAL_TCODE, "CLSVM.LCK",
+		           "cannot invoke a closeVM during task execution");
+	}
+
+	do {
+		#ifdef ZM_CHECK_CONSISTENCY
+		if (!state->siblings.next) {
+			zm_fatalInit(vm, "zm_closeVM");
+			zm_fatalDo(ZM_FATAL_U1, "CLSVM.SN",
+			           "null ref in siblings ring");
+		}
+		n--;
+		#endif
+
+		zm_abortTask(vm, state, "zm_closeVM");
+		state = state->siblings.next;
+	} while (state != vm->ptasks);
+
+	#ifdef ZM_CHECK_CONSISTENCY
+	if (n != 0) {
+		zm_fatalInit(vm, "zm_closeVM");
+		zm_fatalDo(ZM_FATAL_U1, "CLSVM.SC",
+		           "siblings count doesn't match");
+	}
+	#endif
+
+
+	return false;
+}
+
+
+
+void zm_freeVM(zm_VM* vm)
+{
+	int i;
+	#if defined(ZM_ENABLE_CENSUS) && ZM_CHECK_CONSISTENCY
+	int j;
+	#endif
+	if (vm->ptasks) {
+		zm_fatalInit(vm, "zm_freeVM");
+		zm_fatalDo(ZM_FATAL_GCODE, "FREEVM.TP",
+		           "cannot free vm if all task hasn't been "
+		           "free (use zm_closeVM and wait until "
+		           "zm_go return ZM_RUN_IDLE)");
+	}
+
+	#ifdef ZM_ENABLE_EPOLL
+	if (vm->epoll.nfdevent) {
+		zm_fatalInit(vm, "zm_freeVM");
+		zm_fatalDo(ZM_FATAL_GCODE, "FREEVM.FD",
+		           "cannot free vm with %zu fd-event not free "
+		           "(use zm_freeFdEvent)", vm->epoll.nfdevent);
+	}
+	#endif
+
+
+	for (i = 0; i < vm->mwh.len; i++) {
+		zm_Worker *worker = vm->mwh.hlist[i];
+		if (worker) {
+			#if ZM_CHECK_CONSISTENCY
+			if (worker->nstate) {
+				zm_fatalInit(vm, NULL);
+				zm_fatalDo(ZM_FATAL_U1, "FREEVM.NS",
+					   "worker '%s' is not empty",
+					   zm_workerName(worker));
+			}
+
+			#ifdef ZM_ENABLE_CENSUS
+			for (j = 0; j < ZM_CENSUS_NSTATUS; j++) {
+				if (worker->census[j]) {
+					zm_fatalInit(vm, NULL);
+					zm_fatalDo(ZM_FATAL_U1, "FREEVM.CN",
+					           "worker '%s' census %d is %zu",
+					           zm_workerName(worker), j,
+					           worker->census[j]);
+				}
+			}
+			#endif
+			#endif
+
+			zm_freeWorker(vm, worker);
+		}
+	}
+
+	zm_mwhFree(vm);
+
+	zm_freeTimers(vm);
+
+	zm_arenaFree(vm);
+
+	zm_freeExceptionPool(vm);
+
+	#ifdef ZM_ENABLE_TRACE
+	zm_freeTracer(vm);
+	#endif
+
+	#ifdef ZM_ENABLE_AIO
+	zm_aioFree(vm);
+	#endif
+
+	#ifdef ZM_ENABLE_EPOLL
+	if (vm->epoll.fd >= 0)
+		close(vm->epoll.fd);
+	#endif
+
+	zm_free(zm_VM, vm);
+}
+
+
+/*
+ * Free the vm and all its tasks. The ptasks made only of no-term
+ * states (see zm_setNoTerm) are released in bulk without lock and
+ * implode; the others are closed (as zm_closeVM) and processed until
+ * the vm is empty.
+ */
+void zm_destroyVM(zm_VM* vm)
+{
+	zm_State *state = vm->ptasks;
+	size_t n = vm->nptask;
+	size_t nrelease = 0;
+
+	if (vm->plock) {
+		zm_fatalInit(vm, "zm_destroyVM");
+		zm_fatalDo(ZM_FATAL_TCODE, "DESTROYVM.LCK",
+		           "cannot invoke a destroyVM during task execution");
+	}
+
+	while (n--) {
+		zm_State *next = state->siblings.next;
+
+		if (zm_canRelease(state)) {
+			zm_releaseTask(vm, state);
+			nrelease++;
+		}
+
+		state = next;
+	}
+
+	ZM_D("zm_destroyVM: %zu ptask released", nrelease);
+
+	if (nrelease)
+		zm_releaseWorkers(vm);
+
+	if (!zm_closeVM(vm)) {
+		while (zm_go(vm, 100, NULL))
+			;
+	}
+
+	zm_freeVM(vm);
+}
+
+
+/*
+ * Declare that the ZM_TERM of machine doesn't release anything (no
+ * external resources): zm_destroyVM can release its tasks in bulk.
+ * It's applied to the tasks created after the call.
+ */
+void zm_setNoTerm(zm_Machine *machine, int noterm)
+{
+	machine->noterm = noterm;
+}
+
+
+void zm_break(zm_VM* vm)
+{
+	vm->pause = true;
+}
+
+
+void zm_setProcessCallback(zm_VM *vm, zm_process_cb p)
+{
+	vm->prepost = p;
+}
+
+
+/*
+ * Run a resumed subtask (zmSUB) or a resumed caller (subtask return) in
+ * the same zm_go cycle of the yielding task, up to maxnest consecutive
+ * inline steps (0 disable).
+ */
+void zm_setInlineSub(zm_VM *vm, unsigned int maxnest)
+{
+	vm->inlinesub = maxnest;
+}
+
+
+/*
+ * Lock and serialize the tasks to close (zmTERM, zmCLOSE, zm_abort) in
+ * slices of n states per zm_go (0 disable).
+ */
+void zm_setImplodeSlice(zm_VM *vm, size_t n)
+{
+	vm->implosions.slice = n;
+}
+
+
+/*
+ * Don't run the constructor (ZM_INIT) at task creation but before the
+ * first step of the task (a task closed before its first step is never
+ * constructed and its ZM_TERM is skipped).
+ */
+void zm_setDeferInit(zm_VM *vm, int defer)
+{
+	vm->deferinit = defer;
+}
+
+
+/* ----------------------------------------------------------------------------
+ *  PROCESS                                                      (SECTION CORE)
+ * --------------------------------------------------------------------------*/
+
+
+static void zm_checkInnerYield(zm_VM *vm, zm_State *state, zm_Yield result)
+{
+	if (result.resume == 0) {
+		zm_fatalInit(vm, NULL);
+		zm_fatalDo(ZM_FATAL_YCODE, "YINN.0",
+		           "yield to zmstate 0");
+	}
+
+	if (result.c4tch != 0) {
+		zm_fatalInit(vm, NULL);
+		zm_fatalDo(ZM_FATAL_YCODE, "YINN.C",
+		           "catch in yield can be set only with "
+		           "zmSUB(state)");
+	}
+
+	if (result.iter != 0) {
+		zm_fatalInit(vm, NULL);
+		zm_fatalDo(ZM_FATAL_YCODE, "YINN.I",
+		           "iter in yield can be set only with "
+		           "zmSUB(state)");
+	}
+
+	if (result.resume == ZM_TERM) {
+		zm_fatalInit(vm, NULL);
+		zm_fatalDo(ZM_FATAL_YCODE, "YINN.TRM",
+		           "task cannot yield directly to ZM_TERM "
+		           "use instead: zmTERM");
+	}
+}
+
+
+static void zm_resumeSubtaskCaller(zm_VM *vm, zm_State *sub, zm_Yield result,
+                                                             const char *ref)
+{
+
+	/* only resume can be set in yield parent */
+
+	if (result.resume == 0) {
+		zm_fatalInit(vm, ref);
+		zm_fatalDo(ZM_FATAL_YCODE, "YRESCALL.R",
+		           "resume point must be set in "
+		           "yield %s", ref);
+	}
+
+	/* CHECK_OR_NOT check or reset ?? */
+	if (result.c4tch != 0) {
 		int c = zm_hasFlag(sub, ZM_STATE_CATCH);
 		zm_fatalInit(vm, ref);
 		zm_fatalDo(ZM_FATAL_YCODE, "YRESCALL.C",
@@ -4576,566 +8132,1881 @@ static void zm_resumeSubtaskCaller(zm_VM *vm, zm_State *sub, zm_Yield result,
 		           ((c) ? "zmCATCH" :"zmRESET"), ref);
 	}
 
-	if (result.iter != 0) {
-		zm_fatalInit(vm, ref);
-		zm_fatalDo(ZM_FATAL_YCODE, "YRESCALL.I",
-		           "zmNEXT and %s cannot be used together in a zmyield",
-		           ref);
+	if (result.iter != 0) {
+		zm_fatalInit(vm, ref);
+		zm_fatalDo(ZM_FATAL_YCODE, "YRESCALL.I",
+		           "zmNEXT and %s cannot be used together in a zmyield",
+		           ref);
+	}
+
+	/* running active subtasks should always have caller */
+	assert(zm_hasCaller(sub));
+
+	/* suspend current state (child)*/
+	zm_suspendByYield(vm, result, false);
+
+	/* resume caller: iter mode */
+	zm_resumeCaller(vm, sub, true);
+}
+
+
+static void zm_freeUnlockedException(zm_VM *vm, zm_Exception *e)
+{
+	ZM_D("runState - free exception... %zx", e);
+	if (e->elock == ZM_ELOCK_REUSE) {
+		e->elock = ZM_ELOCK_ON;
+		return;
+	}
+
+	if (e->elock == ZM_ELOCK_ON) {
+		zm_fatalInit(vm, NULL);
+		zm_fatalDo(ZM_FATAL_TCODE, "YNOCATHC.1",
+			   "exception not catched in the "
+			   "catch state (use zmCatch)");
+	}
+
+	if (e->kind == ZM_EXCEPTION_ABORT)
+		zm_freeTrace(vm, e);
+
+	zm_freeException(vm, e);
+
+	ZM_D("runState - free exception...free");
+}
+
+
+/*
+ * Run a deferred constructor (see zm_setDeferInit) before the first step.
+ * Return false if the first step is a ZM_TERM: the task has never been
+ * constructed so there is nothing to destroy.
+ */
+static int zm_runDeferredInit(zm_VM *vm, zm_Worker *worker, zm_State *state)
+{
+	zm_yield_t n;
+
+	zm_disableFlag(state, ZM_STATE_NOINIT);
+
+	if (state->on.resume == ZM_TERM)
+		return false;
+
+	vm->plock = true;
+
+	n = (worker->machine->fun)(vm, ZM_INIT, NULL);
+
+	vm->plock = false;
+
+	if (ZM_B4(zm_r2Y(n).cmd) != ZM_TASK_INIT) {
+		zm_fatalInit(vm, NULL);
+		zm_fatalDo(ZM_FATAL_YCODE, "YDONE.WY",
+		           "task in constructor mode (ZM_INIT) can yield "
+		           "only to zmDONE");
+	}
+
+	return true;
+}
+
+
+static zm_Yield zm_runTask(zm_VM *vm, zm_Worker *worker, zm_State *state)
+{
+	zm_Exception *checkexcept = NULL;
+	zm_Yield y;
+	#if defined(ZM_ENABLE_TRACE) || defined(ZM_ENABLE_PROFILE)
+	int resume = state->on.resume;
+	#endif
+	#ifdef ZM_ENABLE_PROFILE
+	uint64_t pt;
+	#endif
+	#ifdef ZM_ENABLE_RECORDER
+	uint64_t rseq;
+	#endif
+
+
+	ZM_D("runState - begin");
+
+	/* check for exception and catch */
+	if (zm_hasFlag(state, ZM_STATE_CATCH)) {
+		zm_disableFlag(state, ZM_STATE_CATCH);
+
+		if (state->exception) {
+			checkexcept = state->exception;
+
+			/* resume on catch #EXCEPT_WORKFLOW */
+			if (state->on.resume != ZM_TERM)
+				state->on.resume = state->on.c4tch;
+		}
+	}
+
+
+	/* in run mode a resume point must always have to been set */
+	if (state->on.resume == 0) {
+		zm_fatalInit(vm, NULL);
+		zm_fatalDo(ZM_FATAL_YCODE, "YRES.0",
+		           "resume zmstate is set to 0 (possible cause: "
+		           "last zmyield hasn't define the "
+		           "proper resume point)");
+	}
+
+	ZM_D("runState: (resume = %d) machine: %s", state->on.resume,
+	     zm_getCurrentMachineName(vm));
+
+	#ifdef ZM_ENABLE_LATENCY
+	if (state->resumed)
+		zm_latencyRecord(vm, worker, state);
+	#endif
+
+	#ifdef ZM_ENABLE_RECORDER
+	if (checkexcept)
+		zm_record(vm, ZM_RECORD_CATCH, state, worker->machine->name,
+		          (uint32_t)checkexcept->code, 0, 0);
+
+	/* yield command is set after the step (0xFF = running) */
+	rseq = zm_record(vm, ZM_RECORD_STEP, state, worker->machine->name, 0,
+	                 state->on.resume, 0xFF);
+	#endif
+
+	#if defined(ZM_ENABLE_TRACE) || defined(ZM_ENABLE_PROFILE)
+	resume = state->on.resume;
+	#endif
+
+	#ifdef ZM_ENABLE_PROFILE
+	pt = zm_nanotime();
+	#endif
+
+	#ifdef ZM_ENABLE_TRACE
+	if (vm->tracer.on)
+		vm->tracer.step = zm_nanotime();
+	#endif
+
+	if ((zm_hasFlag(state, ZM_STATE_NOINIT)) &&
+	    (!zm_runDeferredInit(vm, worker, state)))
+		y = zm_r2Y(ZM_TASK_END);
+	else
+		#ifdef ZM_ENABLE_STATS
+		y = zm_machineStepStats(vm, worker, state);
+		#else
+		y = zm_machineStep(vm, worker, state);
+		#endif
+
+	#ifdef ZM_ENABLE_PROFILE
+	zm_profileStep(vm, worker, resume, zm_nanotime() - pt);
+	#endif
+
+	#ifdef ZM_ENABLE_TRACE
+	if (vm->tracer.on)
+		zm_traceStep(vm, worker, state, resume, y);
+	#endif
+
+	#ifdef ZM_ENABLE_RECORDER
+	zm_recordStepEnd(vm, rseq, y);
+	#endif
+
+	ZM_D("runState: resume: %d iter: %d catch: %d cmd: %d",
+	     y.resume, y.iter, y.c4tch, y.cmd);
+
+	if (!checkexcept)
+		return y;
+
+	/* free exception if is unlock otherwise go fatal */
+	zm_freeUnlockedException(vm, checkexcept);
+
+	return y;
+}
+
+
+/*
+ * process normal mode yield
+ */
+static int zm_normalYield(zm_VM *vm, zm_Worker *worker, zm_State *state,
+                                                        zm_Yield result)
+{
+	int cmd =  ZM_B4(result.cmd);
+
+	switch( cmd ) {
+
+	case ZM_TASK_CONTINUE:
+		ZM_D("ZM_PMODE_NORMAL | ZM_TASK_CONTINUE");
+
+		zm_checkInnerYield(vm, state, result);
+
+		state->on.resume = result.resume;
+
+		return 0;
+
+	/** Subscribed event just triggered - e.g. yield zmSUBSCRIBE(...) */
+	case ZM_TASK_EVENT_READY: {
+		zm_Subscription *sub = state->ext->subscription;
+		void *arg = sub->arg;
+
+		ZM_D("ZM_PMODE_NORMAL | ZM_TASK_EVENT_READY");
+
+		/* as zmEVENT followed by an immediate trigger: the state
+		   continue without suspend and ring operations */
+		zm_setResumePoints(vm, state, result);
+
+		if (sub->flag & ZM_EVB_UNBOUND) {
+			/* unbind request arrived while running */
+			state->ext->subscription = NULL;
+			zm_free(zm_Subscription, sub);
+
+			if (state->on.iter)
+				state->on.resume = state->on.iter;
+		} else {
+			sub->flag &= ~ZM_EVB_PENDING;
+			sub->arg = NULL;
+		}
+
+		zm_setArgument(state, arg);
+
+		return 0;
+	}
+
+	/** Future just completed - e.g. yield zmAWAIT(...) */
+	case ZM_TASK_FUTURE_READY:
+		ZM_D("ZM_PMODE_NORMAL | ZM_TASK_FUTURE_READY");
+
+		zm_setResumePoints(vm, state, result);
+		zm_setArgument(state, vm->session.readyarg);
+		vm->session.readyarg = NULL;
+
+		return 0;
+
+	case ZM_TASK_RAISE_CONTINUE_EXCEPTION: {
+		zm_Exception *e = state->exception;
+		zm_State *head, *catcher;
+
+		/* #CONTINUE_EXCEPT*/
+
+		ZM_D("ZM_PMODE_NORMAL | ZM_TASK_RAISE_CONTINUE");
+
+		head = zm_getLastBeforeCatch(vm, state);
+
+		if (!head)
+			zm_fatalUncaughtContinue(vm, state, e);
+
+		if (zm_crossJoin(state)) {
+			zm_fatalInit(vm, NULL);
+			zm_fatalException(e);
+			zm_fatalDo(ZM_FATAL_YCODE, "JOIN.CONT",
+			           "continue exception cannot cross a "
+			           "zmSUBALL/zmSUBANY caller");
+		}
+
+		/* remove exception from raise state */
+		state->exception = NULL;
+
+		/* store head reference inside exception for user (zmContinueHead) */
+		e->beforecatch = head;
+
+		/** put exception in catch state */
+		catcher = zm_caller(head);
+		catcher->exception = e;
+
+		/** create an exception reference to allow unraise  */
+		head->exception = zm_newException(vm, ZM_EXCEPTION_CONTINUEHEAD);
+		head->exception->raisestate = state;
+		head->exception->beforecatch = head;
+
+		/** close the continue head-tail block (see zm_checkBusy) */
+		zm_setCaller(head, NULL);
+
+		/** suspend (busy) the raiser and resume the catcher */
+		zm_suspendByYield(vm, result, true);
+		zm_resumeState(vm, catcher);
+
+		return ZM_PROCESS_STATEUNLINKED;
+	}
+
+
+	case ZM_TASK_RAISE_ABORT_EXCEPTION: {
+		zm_Exception *e = state->exception;
+
+		ZM_D("ZM_PMODE_NORMAL | ZM_TASK_RAISE_ERROR");
+
+		/* remove reference from raise state */
+		state->exception = NULL;
+
+		/* zmRESET in implicit mode */
+		if ((!result.c4tch) && (result.resume)) {
+			/* transform implicit reset in explicit one
+			 * NOTE: raise and drop are allowed only in
+			 * subtask so currentstate is a subtask */
+			result.c4tch = result.resume;
+		}
+
+		zm_suspendByYield(vm, result, true);
+
+		zm_lockAndImplodeByAbortException(vm, state, e);
+
+		/* TODO is not necessary uncaught field in vm because uncaught
+		 * == current state (remove it?) */
+		if (vm->uncaught)
+			return ZM_PROCESS_EXCEPTION | ZM_PROCESS_STATEUNLINKED;
+
+		return ZM_PROCESS_STATEUNLINKED;
+	}
+
+
+	/** distructor of the task  */
+	case ZM_TASK_TERM:
+		ZM_D("ZM_PMODE_NORMAL | ZM_TASK_TERM");
+
+		zm_suspendByYield(vm, result, true);
+
+		zm_lockAndImplodeBy(vm, state, ZM_IMPLODEBY_CUR, "yield zmTERM",
+		                    state->codeframe.filename,
+		                    state->codeframe.nline);
+
+		return ZM_PROCESS_STATEUNLINKED;
+
+	case ZM_TASK_END:
+		zm_fatalInit(vm, NULL);
+		zm_fatalDo(ZM_FATAL_YCODE, "YNORM.YE",
+			   "yield zmEND is permitted only in closing mode "
+			   "inside ZM_TERM zmstate");
+		return 0;
+
+	/** Task Suspend - e.g. yield TO(foo) */
+	case ZM_TASK_SUSPEND:
+		ZM_D("ZM_PMODE_NORMAL | ZM_TASK_SUSPEND");
+
+		if (zm_isTask(state))
+			zm_suspendByYield(vm, result, false);
+		else
+			zm_resumeSubtaskCaller(vm, state, result, "zmSUSPEND");
+
+		return ZM_PROCESS_STATEUNLINKED;
+
+	/** Task suspend (iter) - e.g. yield zmCALLER */
+	case ZM_TASK_SUSPEND_AND_RESUME_CALLER:
+		ZM_D("ZM_PMODE_NORMAL | ZM_TASK_SUSPEND_AND_RESUME_CALLER");
+
+		if (zm_isTask(state)) {
+			zm_fatalInit(vm, NULL);
+			zm_fatalDo(ZM_FATAL_YCODE, "YSUSPEND.CALL",
+				   "yield zmCALLER can be invoked only in "
+				   "subtask (ptask never has a caller)");
+		} else {
+			zm_resumeSubtaskCaller(vm, state, result, "zmCALLER");
+		}
+
+		return ZM_PROCESS_STATEUNLINKED;
+
+	/** Task suspend waiting subtask - e.g. yield SUB(foo) */
+	case ZM_TASK_SUSPEND_WAITING_SUBTASK:
+		ZM_D("ZM_PMODE_NORMAL | ZM_TASK_SUSPEND_WAIT_SUB");
+		/* a join is resumed once for all its members */
+		if ((result.iter) && (zm_ext(state, join)) &&
+		    (state->ext->join->mode != ZM_JOIN_DEADLINE)) {
+			zm_fatalInit(vm, "zmSUBALL/zmSUBANY");
+			zm_fatalDo(ZM_FATAL_YCODE, "YSUBJ.I",
+			           "zmNEXT cannot be used in a join yield");
+		}
+
+		/* suspend with waiting = true (ZM_STATE_WAITING) */
+		zm_suspendByYield(vm, result, true);
+
+		return ZM_PROCESS_STATEUNLINKED;
+
+
+	/** Task suspend waiting event - e.g. yield EVENT(...)*/
+	case ZM_TASK_BUSY_WAITING_EVENT: {
+		/* zmEVENT has just:
+		 * - set flag ZM_STATE_EVENTLOCKED #EVB_FLAG
+		 * - set state->next to an eventbinder instance pointer
+		 *   #EVENT_BIND
+		 */
+		zm_EventBinder* evb = (zm_EventBinder*)state->next;
+
+		/* temporary recover state->next to perform
+		 * suspendCurrentState */
+		state->next = (zm_State*)evb->statenext;
+
+		ZM_D("ZM_PMODE_NORMAL | TASK_BUSY_WAITING_EVENT");
+
+		/* Temporary disable event flag to allow debug print in
+		   suspend current */
+		zm_disableFlag(state, ZM_STATE_EVENTLOCKED);
+
+		/* suspend with waiting = true (ZM_STATE_WAITING) */
+		zm_suspendByYield(vm, result, true);
+
+		zm_enableFlag(state, ZM_STATE_EVENTLOCKED);
+
+		/* save worker pointer in (suspend put worker in state->next */
+		/* to allow resume operation) to be recover after unbind */
+		evb->statenext = state->next;
+
+		/* replace again next state with evb */
+		state->next = (zm_State*)evb;
+
+		return ZM_PROCESS_STATEUNLINKED;
+	}
+
+	default:
+		zm_fatalInit(vm, NULL);
+		zm_fatalDo(ZM_FATAL_UP, "WCMOP.U", "unknow yield directive %d",
+		           result.cmd);
+		return 0;
+	}
+}
+
+
+/*
+ * cancel request (zm_cancelState): process as a yield zmTERM without
+ * run the step
+ */
+static int zm_cancelYield(zm_VM *vm, zm_Worker *worker, zm_State *state)
+{
+	zm_Yield y = zm_r2Y(ZM_TASK_TERM);
+
+	ZM_D("cancel state [ref %zx]", state);
+
+	zm_disableFlag(state, ZM_STATE_CANCEL);
+
+	if (zm_hasFlag(state, ZM_STATE_CATCH)) {
+		/* drop an exception not yet catched */
+		zm_disableFlag(state, ZM_STATE_CATCH);
+
+		if (state->exception) {
+			if (state->exception->kind == ZM_EXCEPTION_ABORT)
+				zm_freeTrace(vm, state->exception);
+
+			zm_freeException(vm, state->exception);
+			state->exception = NULL;
+		}
+	}
+
+	/* keep the current resume point for zmGetCloseOp */
+	y.resume = state->on.resume;
+
+	return zm_normalYield(vm, worker, state, y);
+}
+
+
+/*
+ * process close mode yield
+ */
+static int zm_closeYield(zm_VM *vm, zm_Worker *worker, zm_State *state,
+                                                       zm_Yield result)
+{
+	int cmd = ZM_B4(result.cmd);
+
+	switch( cmd ) {
+
+	case ZM_TASK_END:
+		ZM_D("ZM_PMODE_CLOSE | ZM_TASK_END");
+		/*  CHECK_OR_NOT */
+
+		if (zm_hasntFlag(state, ZM_STATE_IMPLOSIONLOCK)) {
+			zm_fatalInit(vm, NULL);
+			zm_fatalDo(ZM_FATAL_UP, "YEND.NLI",
+			           "task not implode-locked in close mode");
+		}
+
+		state->pmode = ZM_PMODE_END;
+
+		return 0;
+
+	default:
+		zm_fatalInit(vm, NULL);
+		zm_fatalDo(ZM_FATAL_YCODE, "YEND.WY",
+		           "in ZM_TERM only yield zmEND is permitted"
+		           );
+
+		return 0;
+	}
+}
+
+
+static int zm_processTask(zm_VM *vm, zm_Worker *worker, zm_State *state)
+{
+	ZM_D("process_state[0] - state = [ref %zx]  pmode = %d", state,
+	     state->pmode);
+
+	switch(state->pmode) {
+	case ZM_PMODE_NORMAL:
+	case ZM_PMODE_CLOSE: {
+		zm_Yield y;
+		int r;
+
+		if (zm_hasFlag(state, ZM_STATE_CANCEL))
+			return zm_cancelYield(vm, worker, state);
+
+		/* RUN: Excute a step of machine */
+		y = zm_runTask(vm, worker, state);
+
+		if (state->pmode == ZM_PMODE_CLOSE)
+			return zm_closeYield(vm, worker, state, y);
+
+		r = zm_normalYield(vm, worker, state, y);
+
+		/* cancelled during the step (zm_groupCancel ...) */
+		if (zm_hasFlag(state, ZM_STATE_CANCEL))
+			zm_cancelAfterYield(vm, state);
+
+		return r;
+	}
+
+	case ZM_PMODE_END: {
+		zm_State *joincaller = NULL;
+		zm_Exception *uncaught = vm->uncaught;
+
+		/* Remove the state from list (should be invoked in
+		 * ZM_TERM when all user-resource as been free) */
+
+		ZM_D("ZM_PMODE_END:");
+
+		if ((zm_isSubTask(state)) && (zm_hasCaller(state))) {
+			if (zm_ext(zm_caller(state), join)) {
+				/* join caller is processed when the state
+				 * is out of the data-tree (it can re-raise
+				 * an exception) */
+				joincaller = zm_caller(state);
+				zm_setCaller(state, NULL);
+			} else {
+				/* resume parent (end mode) done before
+				 * unlinkCurrentState to avoid unuseful
+				 * unlink/add worker when state and parent
+				 * have same worker */
+				zm_resumeCaller(vm, state, false);
+			}
+		}
+
+		zm_unlinkCurrentState(vm);
+
+		state->pmode = ZM_PMODE_OFF;
+
+		#ifdef ZM_ENABLE_RECORDER
+		zm_record(vm, ZM_RECORD_END, state, worker->machine->name, 0,
+		          0, 0);
+		#endif
+
+		#ifdef ZM_ENABLE_STATS
+		zm_statsFreed(worker);
+		#endif
+
+		#ifdef ZM_ENABLE_CENSUS
+		zm_censusRemove(vm, state);
+		#endif
+
+		ZM_D("CLOSE TASK: remove state from siblings ...");
+		zm_removeStateFromSiblings(vm, state);
+
+		if (zm_groupLink(state))
+			zm_groupRemove(vm, state);
+
+		if (joincaller)
+			zm_joinReturn(vm, joincaller, state);
+
+		if (zm_isSubTask(state)) {
+			zm_nfree(zm_State*, zm_deep(state),
+			         state->parent->stack);
+
+			state->parent->comeback = NULL;
+			state->parent->stack = NULL;
+
+			zm_free(zm_Parent, state->parent);
+
+			/* NOTE: state->parent don't have to be set = NULL
+			 * because this will change the nature of the task
+			 * (subtask become ptask) and this is a problem in
+			 * explicit free task operation (see #FREE_TASK_KIND)
+			 */
+		}
+
+		if (zm_hasException(state, ZM_EXCEPTION_CONTINUEHEAD)) {
+			zm_freeException(vm, state->exception);
+			state->exception = NULL;
+		} else if (state->exception) {
+			/* If there is alredy an exception with
+			 * kind != continueref ... something has going wrong */
+			zm_fatalInit(vm, NULL);
+			zm_fatalDo(ZM_FATAL_UP, "PPS.EEN",
+			           "exception still present in ZM_PMODE_END");
+		}
+
+		if (zm_hasFlag(state, ZM_STATE_AUTOFREE)) {
+			ZM_D("CLOSE TASK: free state");
+			zm_stateFree(vm, state);
+		}
+
+		/* a join caller has re-raised an uncaught exception */
+		if (vm->uncaught != uncaught)
+			return ZM_PROCESS_EXCEPTION | ZM_PROCESS_STATEUNLINKED;
+
+		/** remove state from vm (no more executed)*/
+		return ZM_PROCESS_STATEUNLINKED;
+	}
+
+
+	case ZM_PMODE_ASYNCIMPLODE: {
+		/* this is a special for lock and implode
+		   #ASYNC_SERIALIZATION [step 3]*/
+		zm_State *imstart;
+
+		ZM_D("ZM_PMODE_ASYNCIMPLODE");
+		imstart = zm_popAsyncImplosionStart(vm, state);
+
+		state->pmode = ZM_PMODE_CLOSE;
+
+		/* All implosion task, except the imstart, must be in
+		 * waiting subtask (see #IMPLODE_WAITING_CHAIN)
+		 * suspend with waiting = true (ZM_STATE_WAITING) */
+		zm_suspendCurrentState(vm, true);
+
+		ZM_D("star implosion from: %zx", imstart);
+
+		if (imstart)
+			zm_resumeState(vm, imstart);
+
+		return ZM_PROCESS_STATEUNLINKED;
+	}
+
+	case ZM_PMODE_OFF:
+		zm_fatalInit(vm, NULL);
+		zm_fatalDo(ZM_FATAL_UP, "PPS.NMTD",
+		           "pmode = ZM_PMODE_OFF in processState");
+		return 0;
+
+	default:
+		zm_fatalInit(vm, NULL);
+		zm_fatalDo(ZM_FATAL_UP, "PPS.UVMOP",
+		           "unknow pmode = %d in processState",
+		           state->pmode);
+		return 0;
+	}
+}
+
+
+static int zm_goStep(zm_VM* vm, zm_Worker *worker, zm_State *state)
+{
+	int r;
+
+	ZM_D("stateGo: process state with worker = %s", worker->machine->name);
+	ZM_D("stateGo: process state [ref %zx] ", state);
+
+	if ((vm->implosions.first) &&
+	    (zm_hasFlag(zm_root(state), ZM_STATE_IMPLODING))) {
+		/* frozen until the incremental implosion is serialized */
+		zm_implodePark(vm, worker, state);
+
+		if ((vm->session.fixedworker) && (worker->nstate == 0))
+			return ZM_RUN_IDLE;
+
+		return ZM_RUN_AGAIN;
+	}
+
+	vm->session.state = state;
+	vm->session.worker = worker;
+	vm->session.suspendop = 0;
+
+	if (vm->prepost)
+		vm->prepost(vm, worker->machine, state, 0);
+
+	vm->session.stepping = true;
+	r = zm_processTask(vm, worker, state);
+
+	if (vm->prepost)
+		vm->prepost(vm, worker->machine, state, 1);
+
+	ZM_D("stateGo - process state return %d", r);
+
+	/* state unlink cause an implicit cursor move */
+	if (!(r & ZM_PROCESS_STATEUNLINKED)) {
+		/* a closing subtask (ZM_TERM, end) return to its caller in
+		   the next inline steps: cursor is not moved and the state
+		   is the next handoff */
+		if ((zm_isTask(state)) ||
+		    ((state->pmode != ZM_PMODE_CLOSE) &&
+		     (state->pmode != ZM_PMODE_END)) ||
+		    (!zm_canInline(vm)))
+			zm_stateNext(worker);
+		else
+			vm->session.handoff = state;
+	}
+
+	vm->session.stepping = false;
+
+	r = (r & ZM_PROCESS_EXCEPTION) ? ZM_RUN_EXCEPTION : ZM_RUN_IDLE;
+
+	if (!vm->session.fixedworker)
+		/* in non fixedworker mode idle is returned only by zm_go
+		   when there are no more worker avaible */
+		r = r | ZM_RUN_AGAIN;
+	else if (worker->nstate > 0)
+		/* in fixedworker mode idle is returned when nstate == 0 */
+		r = r | ZM_RUN_AGAIN;
+
+	return r;
+}
+
+
+static zm_Worker* zm_goGetWorker(zm_VM* vm)
+{
+	zm_Worker *worker;
+
+	if (vm->session.fixedworker) {
+		worker = vm->session.worker;
+	} else {
+		/* get current cursor worker */
+		if (!vm->workercursor)
+			return NULL;
+
+		worker = vm->workercursor;
+	}
+
+
+	#ifdef ZM_CHECK_CONSISTENCY
+	if (worker->nstate < 0) {
+		zm_fatalInit(vm, NULL);
+		zm_fatalDo(ZM_FATAL_U1, "WGO.WNS", "worker->nstate = %d",
+		           worker->nstate);
+	}
+	#endif
+
+	/* check if there a least one state */
+	if (worker->nstate == 0) {
+		/* no more state in this worker */
+		ZM_D("zm_go: no more state in worker -> IDLE");
+		return NULL;
+	}
+
+	return worker;
+}
+
+
+static zm_State* zm_goGetState(zm_VM* vm, zm_Worker* worker)
+{
+	if (!worker->states.current) {
+		zm_rewindWorkerStates(vm, worker);
+
+		if ((!vm->session.fixedworker) && (vm->nworker > 1)) {
+			worker = zm_nextWorker(vm);
+			/* return null to check worker with goGetWorker */
+			return NULL;
+		}
+	}
+
+	return worker->states.current;
+}
+
+
+int zm_go(zm_VM* vm, unsigned int ncycle, zm_Machine* onemachine)
+{
+	zm_Worker* worker;
+	zm_State* state;
+	int r;
+
+	ZM_D("GO - init: vm = %d - machine = %zx", vm, onemachine);
+
+	if (vm->timers.count)
+		zm_processTimers(vm);
+
+	if (onemachine) {
+		vm->session.worker = zm_getWorker(vm, onemachine);
+		vm->session.fixedworker = true;
+	} else {
+		vm->session.fixedworker = false;
+	}
+
+
+	while(ncycle > 0) {
+		ZM_D("GO - ********** STEP #%d **********", ncycle);
+
+		if (vm->pause) {
+			vm->pause = false;
+			return ZM_RUN_AGAIN | ZM_RUN_BREAK;
+		}
+
+		/* incremental implosions run a slice for each cycle */
+		if (vm->implosions.first)
+			zm_implodeContinue(vm);
+
+		worker = zm_goGetWorker(vm);
+
+		if (!worker) {
+			if (!vm->implosions.first)
+				return ZM_RUN_IDLE;
+
+			/* nothing else to do */
+			ncycle--;
+			continue;
+		}
+
+		state = zm_goGetState(vm, worker);
+
+		if (!state)
+			continue;
+
+		r = zm_goStep(vm, worker, state);
+
+		/* subtask call/return chain (see zm_setInlineSub) */
+		while ((r == ZM_RUN_AGAIN) && (vm->session.handoff)) {
+			state = vm->session.handoff;
+			vm->session.handoff = NULL;
+
+			if (worker->states.current != state) {
+				/* suspended state: worker is stored in next */
+				worker = (zm_Worker*)state->next;
+				zm_linkHandoff(vm, worker, state);
+			}
+
+			vm->session.nest++;
+
+			r = zm_goStep(vm, worker, state);
+		}
+
+		if ((state = vm->session.handoff)) {
+			vm->session.handoff = NULL;
+			zm_linkHandoff(vm, (zm_Worker*)state->next, state);
+		}
+
+		vm->session.nest = 0;
+
+		if (r != ZM_RUN_AGAIN)
+			return r;
+
+		#if ZM_DEBUG_LEVEL >= 4
+		zm_printVM(NULL, vm);
+		#endif
+
+		ncycle -= worker->cyclestep;
+	}
+
+	ZM_D("GO - end (ncycle left %d)\n", ncycle);
+	return ZM_RUN_AGAIN;
+}
+
+
+
+
+#ifdef ZM_ENABLE_EPOLL
+/* ----------------------------------------------------------------------------
+ *  FD EVENT (EPOLL)                                               (SECTION IO)
+ * --------------------------------------------------------------------------*/
+
+/*
+ * An fd-event is a normal zm_Event whose data is a zm_FdEvent. Readiness
+ * is requested with EPOLLONESHOT only when a task wait the event
+ * (zmWAITFD or zmSUBSCRIBE) so an fd without waiting tasks never wake up
+ * zm_poll. The fd is added (disabled) to epoll by zm_newFdEvent: epoll
+ * accept one registration per fd, a second fd-event on the same fd is
+ * refused there (not at the first wait).
+ */
+
+static void zm_epollFatal(zm_VM *vm, const char *ref, const char *ecode)
+{
+	zm_fatalInit(vm, ref);
+	zm_fatalDo(ZM_FATAL_GCODE, ecode, "%s", strerror(errno));
+}
+
+
+static void zm_epollInit(zm_VM *vm, const char *ref)
+{
+	if (vm->epoll.fd >= 0)
+		return;
+
+	vm->epoll.fd = epoll_create(ZM_POLL_BATCH);
+
+	if (vm->epoll.fd < 0)
+		zm_epollFatal(vm, ref, "EPOLL.NEW");
+
+	fcntl(vm->epoll.fd, F_SETFD, FD_CLOEXEC);
+}
+
+
+zm_Event* zm_newFdEvent(zm_VM *vm, int fd, int events)
+{
+	zm_FdEvent *fe;
+
+	struct epoll_event ev;
+
+	zm_epollInit(vm, "zm_newFdEvent");
+
+	fe = zm_alloc(zm_FdEvent);
+
+	/* disabled: EPOLLERR/EPOLLHUP are reported at most once (oneshot) */
+	ev.events = EPOLLONESHOT;
+	ev.data.ptr = fe;
+
+	if (epoll_ctl(vm->epoll.fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+		int err = errno;
+
+		zm_free(zm_FdEvent, fe);
+		zm_fatalInit(vm, "zm_newFdEvent");
+
+		if (err == EEXIST)
+			zm_fatalDo(ZM_FATAL_GCODE, "NEWFDEV.DUP",
+			           "fd %d has just an fd-event in this vm "
+			           "(use one fd-event for all the events)", fd);
+
+		zm_fatalDo(ZM_FATAL_GCODE, "NEWFDEV.CTL",
+		           "epoll_ctl(fd = %d): %s", fd, strerror(err));
+	}
+
+	fe->fd = fd;
+	fe->events = events;
+	fe->revents = 0;
+	fe->armed = ZM_FDEVENT_IDLE;
+	fe->event = zm_newEvent(fe);
+	fe->event->flag |= ZM_EVENT_FD;
+
+	vm->epoll.nfdevent++;
+
+	return fe->event;
+}
+
+
+void zm_freeFdEvent(zm_VM *vm, zm_Event *event)
+{
+	zm_FdEvent *fe = (zm_FdEvent*)event->data;
+
+	if (!zm_hasFlag(event, ZM_EVENT_FD)) {
+		zm_fatalInit(vm, "zm_freeFdEvent");
+		zm_fatalDo(ZM_FATAL_GCODE, "FREEFDEV.NF",
+		           "event is not an fd-event");
+	}
+
+	zm_freeEvent(vm, event);
+
+	{
+		/* the fd can be just closed by user: ignore EBADF/ENOENT */
+		struct epoll_event ev;
+		epoll_ctl(vm->epoll.fd, EPOLL_CTL_DEL, fe->fd, &ev);
+	}
+
+	vm->epoll.nfdevent--;
+
+	zm_free(zm_FdEvent, fe);
+}
+
+
+static void zm_armFdEvent(zm_VM *vm, zm_FdEvent *fe, const char *ref,
+                          const char *fn, int nl)
+{
+	struct epoll_event ev;
+
+	if (fe->armed == ZM_FDEVENT_ARMED)
+		return;
+
+	ev.events = fe->events | EPOLLONESHOT;
+	ev.data.ptr = fe;
+
+	if (epoll_ctl(vm->epoll.fd, EPOLL_CTL_MOD, fe->fd, &ev) < 0) {
+		zm_fatalInitAt(vm, ref, fn, nl);
+		zm_fatalDo(ZM_FATAL_YCODE, "WAITFD.CTL",
+		           "epoll_ctl(fd = %d): %s", fe->fd, strerror(errno));
+	}
+
+	fe->armed = ZM_FDEVENT_ARMED;
+}
+
+
+/*
+ * yield to fd-event (wait fd readiness)
+ */
+zm_yield_t izmWAITFD(zm_VM* vm, zm_Event *e, const char *filename, int nline)
+{
+	zm_FdEvent *fe;
+
+	ZM_ASSERT_VMLOCK("WAITFD.VLCK", "zmWAITFD", filename, nline);
+
+	if (!zm_hasFlag(e, ZM_EVENT_FD)) {
+		zm_fatalInitAt(vm, "zmWAITFD", filename, nline);
+		zm_fatalDo(ZM_FATAL_YCODE, "WAITFD.NF",
+		           "event is not an fd-event (use zm_newFdEvent)");
+	}
+
+	fe = (zm_FdEvent*)e->data;
+
+	zm_armFdEvent(vm, fe, "zmWAITFD", filename, nline);
+
+	return izmEVENT(vm, e, filename, nline);
+}
+
+
+#ifdef ZM_ENABLE_AIO
+static size_t zm_aioReap(zm_VM *vm);
+#endif
+
+
+/*
+ * Wait (max timeout ms) fd readiness and trigger the relative fd-events.
+ */
+static size_t zm_epollWait(zm_VM *vm, int timeout)
+{
+	struct epoll_event evs[ZM_POLL_BATCH];
+	size_t count = 0;
+	int i, n;
+
+	if (vm->epoll.fd < 0)
+		return 0;
+
+	do {
+		n = epoll_wait(vm->epoll.fd, evs, ZM_POLL_BATCH, timeout);
+	} while ((n < 0) && (errno == EINTR));
+
+	if (n < 0)
+		zm_epollFatal(vm, "zm_poll", "POLL.WT");
+
+	for (i = 0; i < n; i++) {
+		zm_FdEvent *fe = (zm_FdEvent*)evs[i].data.ptr;
+
+		#ifdef ZM_ENABLE_AIO
+		if ((void*)fe == (void*)vm->aio) {
+			/* async i/o completion notify */
+			count += zm_aioReap(vm);
+			continue;
+		}
+		#endif
+
+		ZM_D("zm_poll: fd = %d events = %d", fe->fd, evs[i].events);
+
+		/* error/hang up of a not yet waited fd: nobody to resume */
+		if (fe->armed != ZM_FDEVENT_ARMED)
+			continue;
+
+		/* oneshot: fd is now disabled until next wait */
+		fe->armed = ZM_FDEVENT_IDLE;
+		fe->revents = evs[i].events;
+
+		count += zm_trigger(vm, fe->event, fe);
 	}
 
-	/* running active subtasks should always have caller */
-	assert(zm_hasCaller(sub));
+	return count;
+}
+#endif
+
+
+
+#ifdef ZM_ENABLE_AIO
+/* ----------------------------------------------------------------------------
+ *  ASYNC FILE I/O                                                 (SECTION IO)
+ * --------------------------------------------------------------------------*/
+
+/*
+ * zmREAD/zmWRITE create a request with an internal event, bind the
+ * current task to it and append the request to the pending list. Pending
+ * requests of all tasks are submitted together by zm_poll (one
+ * io_uring_enter or one thread-pool lock), completions are reaped by
+ * zm_poll and trigger the request event with the result as argument.
+ * A pending request whose task is unbound (closed) is never submitted;
+ * a submitted one is just reaped.
+ *
+ * An eventfd (notifyfd) is signaled at each completion: zm_poll wait it
+ * (throught epoll when ZM_ENABLE_EPOLL is set).
+ */
+
+typedef struct zm_AioRequest_ zm_AioRequest;
+
+struct zm_AioRequest_ {
+	int op;
+	int fd;
+	int64_t offset;
+	struct iovec iov;
+	long result;
+	int queued; /* in aio->pending */
+
+	zm_Event event;
+
+	zm_AioRequest *next;
+};
+
+
+typedef struct {
+	zm_AioRequest *first;
+	zm_AioRequest *last;
+} zm_AioList;
+
+
+struct zm_Aio_ {
+	int backend;
+	int notifyfd;
+
+	/* requests submitted and not yet reaped */
+	size_t inflight;
+
+	/* requests waiting the submission */
+	zm_AioList pending;
+	size_t npending;
+
+	/* pending requests unbound by their task (free at next submit) */
+	zm_AioList dropped;
+
+	#ifdef ZM_AIO_HAVE_URING
+	struct {
+		int fd;
+		unsigned entries;
+		unsigned cqentries;
+		unsigned *sqhead;
+		unsigned *sqtail;
+		unsigned *sqmask;
+		unsigned *sqarray;
+		unsigned *cqhead;
+		unsigned *cqtail;
+		unsigned *cqmask;
+		struct io_uring_sqe *sqes;
+		struct io_uring_cqe *cqes;
+		void *sqring;
+		void *cqring;
+		size_t sqringsize;
+		size_t cqringsize;
+		/* sqe just in the ring but not yet consumed by the kernel */
+		unsigned unsubmitted;
+	} uring;
+	#endif
+
+	struct {
+		int nthread;
+		pthread_t thread[ZM_AIO_NTHREAD];
+		pthread_mutex_t mutex;
+		pthread_cond_t cond;
+		zm_AioList queue;
+		zm_AioList done;
+		int quit;
+	} pool;
+};
 
-	/* suspend current state (child)*/
-	zm_suspendByYield(vm, result, false);
 
-	/* resume caller: iter mode */
-	zm_resumeCaller(vm, sub, true);
+static void zm_aioListAdd(zm_AioList *l, zm_AioRequest *req)
+{
+	req->next = NULL;
+
+	if (l->last)
+		l->last->next = req;
+	else
+		l->first = req;
+
+	l->last = req;
 }
 
 
-static void zm_freeUnlockedException(zm_VM *vm, zm_Exception *e)
+static zm_AioRequest* zm_aioListPop(zm_AioList *l)
 {
-	ZM_D("runState - free exception... %zx", e);
-	if (e->elock == ZM_ELOCK_REUSE) {
-		e->elock = ZM_ELOCK_ON;
-		return;
-	}
+	zm_AioRequest *req = l->first;
 
-	if (e->elock == ZM_ELOCK_ON) {
-		zm_fatalInit(vm, NULL);
-		zm_fatalDo(ZM_FATAL_TCODE, "YNOCATHC.1",
-			   "exception not catched in the "
-			   "catch state (use zmCatch)");
-	}
+	if (!req)
+		return NULL;
 
-	if (e->kind == ZM_EXCEPTION_ABORT)
-		zm_freeTrace(e);
+	l->first = req->next;
 
-	zm_free(zm_Exception, e);
+	if (!l->first)
+		l->last = NULL;
 
-	ZM_D("runState - free exception...free");
+	return req;
 }
 
 
-static zm_Yield zm_runTask(zm_VM *vm, zm_Worker *worker, zm_State *state)
+static void zm_aioListRemove(zm_AioList *l, zm_AioRequest *req)
 {
-	zm_Exception *checkexcept = NULL;
-	zm_Yield y;
+	zm_AioRequest *prev = NULL;
+	zm_AioRequest *r = l->first;
 
+	while (r != req) {
+		prev = r;
+		r = r->next;
+	}
 
-	ZM_D("runState - begin");
+	if (prev)
+		prev->next = req->next;
+	else
+		l->first = req->next;
 
-	/* check for exception and catch */
-	if (zm_hasFlag(state, ZM_STATE_CATCH)) {
-		zm_disableFlag(state, ZM_STATE_CATCH);
+	if (l->last == req)
+		l->last = prev;
 
-		if (state->exception) {
-			checkexcept = state->exception;
+	req->queued = false;
+}
 
-			/* resume on catch #EXCEPT_WORKFLOW */
-			if (state->on.resume != ZM_TERM)
-				state->on.resume = state->on.c4tch;
-		}
-	}
 
+static void zm_aioFatal(zm_VM *vm, const char *ecode, const char *what)
+{
+	zm_fatalInit(vm, NULL);
+	zm_fatalDo(ZM_FATAL_GCODE, ecode, "%s: %s", what, strerror(errno));
+}
 
-	/* in run mode a resume point must always have to been set */
-	if (state->on.resume == 0) {
-		zm_fatalInit(vm, NULL);
-		zm_fatalDo(ZM_FATAL_YCODE, "YRES.0",
-		           "resume zmstate is set to 0 (possible cause: "
-		           "last zmyield hasn't define the "
-		           "proper resume point)");
-	}
 
-	ZM_D("runState: (resume = %d) machine: %s", state->on.resume,
-	     zm_getCurrentMachineName(vm));
+static void zm_aioNotify(int fd)
+{
+	uint64_t one = 1;
+	ssize_t r;
 
-	y = zm_machineStep(vm, worker, state);
+	do {
+		r = write(fd, &one, sizeof(one));
+	} while ((r < 0) && (errno == EINTR));
+}
 
-	ZM_D("runState: resume: %d iter: %d catch: %d cmd: %d",
-	     y.resume, y.iter, y.c4tch, y.cmd);
 
-	if (!checkexcept)
-		return y;
+static void zm_aioClearNotify(int fd)
+{
+	uint64_t n;
+	ssize_t r;
 
-	/* free exception if is unlock otherwise go fatal */
-	zm_freeUnlockedException(vm, checkexcept);
+	do {
+		r = read(fd, &n, sizeof(n));
+	} while ((r < 0) && (errno == EINTR));
+}
 
-	return y;
+
+static long zm_aioExec(zm_AioRequest *req)
+{
+	ssize_t r;
+
+	if (req->op == ZM_AIO_READ) {
+		if (req->offset < 0)
+			r = read(req->fd, req->iov.iov_base, req->iov.iov_len);
+		else
+			r = pread(req->fd, req->iov.iov_base, req->iov.iov_len,
+			          (off_t)req->offset);
+	} else {
+		if (req->offset < 0)
+			r = write(req->fd, req->iov.iov_base, req->iov.iov_len);
+		else
+			r = pwrite(req->fd, req->iov.iov_base, req->iov.iov_len,
+			           (off_t)req->offset);
+	}
+
+	return (r < 0) ? -errno : (long)r;
 }
 
 
-/*
- * process normal mode yield
- */
-static int zm_normalYield(zm_VM *vm, zm_Worker *worker, zm_State *state,
-                                                        zm_Yield result)
+
+/* ** thread-pool backend ** */
+
+static void* zm_aioThread(void *arg)
 {
-	int cmd =  ZM_B4(result.cmd);
+	zm_Aio *aio = (zm_Aio*)arg;
 
-	switch( cmd ) {
+	pthread_mutex_lock(&aio->pool.mutex);
 
-	case ZM_TASK_CONTINUE:
-		ZM_D("ZM_PMODE_NORMAL | ZM_TASK_CONTINUE");
+	while (1) {
+		zm_AioRequest *req = zm_aioListPop(&aio->pool.queue);
 
-		zm_checkInnerYield(vm, state, result);
+		if (!req) {
+			if (aio->pool.quit)
+				break;
 
-		state->on.resume = result.resume;
+			pthread_cond_wait(&aio->pool.cond, &aio->pool.mutex);
+			continue;
+		}
 
-		return 0;
+		pthread_mutex_unlock(&aio->pool.mutex);
 
-	case ZM_TASK_RAISE_CONTINUE_EXCEPTION: {
-		zm_Exception *e = state->exception;
-		zm_State *head, *catcher;
+		req->result = zm_aioExec(req);
 
-		/* #CONTINUE_EXCEPT*/
+		pthread_mutex_lock(&aio->pool.mutex);
 
-		ZM_D("ZM_PMODE_NORMAL | ZM_TASK_RAISE_CONTINUE");
+		zm_aioListAdd(&aio->pool.done, req);
 
-		head = zm_getLastBeforeCatch(vm, state);
+		zm_aioNotify(aio->notifyfd);
+	}
 
-		if (!head)
-			zm_fatalUncaughtContinue(vm, state, e);
+	pthread_mutex_unlock(&aio->pool.mutex);
 
-		/* remove exception from raise state */
-		state->exception = NULL;
+	return NULL;
+}
 
-		/* store head reference inside exception for user (zmContinueHead) */
-		e->beforecatch = head;
 
-		/** put exception in catch state */
-		catcher = zm_caller(head);
-		catcher->exception = e;
+static int zm_aioPoolInit(zm_VM *vm, zm_Aio *aio)
+{
+	int i;
 
-		/** create an exception reference to allow unraise  */
-		head->exception = zm_newException( ZM_EXCEPTION_CONTINUEHEAD );
-		head->exception->raisestate = state;
-		head->exception->beforecatch = head;
+	pthread_mutex_init(&aio->pool.mutex, NULL);
+	pthread_cond_init(&aio->pool.cond, NULL);
 
-		/** close the continue head-tail block (see zm_checkBusy) */
-		zm_setCaller(head, NULL);
+	aio->pool.queue.first = aio->pool.queue.last = NULL;
+	aio->pool.done.first = aio->pool.done.last = NULL;
+	aio->pool.quit = false;
+	aio->pool.nthread = 0;
 
-		/** suspend (busy) the raiser and resume the catcher */
-		zm_suspendByYield(vm, result, true);
-		zm_resumeState(vm, catcher);
+	for (i = 0; i < ZM_AIO_NTHREAD; i++) {
+		if (pthread_create(&aio->pool.thread[i], NULL, zm_aioThread, aio))
+			break;
 
-		return ZM_PROCESS_STATEUNLINKED;
+		aio->pool.nthread++;
 	}
 
+	if (!aio->pool.nthread) {
+		zm_fatalInit(vm, "zm_aioInit");
+		zm_fatalDo(ZM_FATAL_GCODE, "AIO.THRD",
+		           "cannot create async i/o threads");
+	}
 
-	case ZM_TASK_RAISE_ABORT_EXCEPTION: {
-		zm_Exception *e = state->exception;
+	return ZM_AIO_THREADS;
+}
 
-		ZM_D("ZM_PMODE_NORMAL | ZM_TASK_RAISE_ERROR");
 
-		/* remove reference from raise state */
-		state->exception = NULL;
+static void zm_aioPoolSubmit(zm_Aio *aio)
+{
+	zm_AioRequest *req;
+	size_t n = 0;
 
-		/* zmRESET in implicit mode */
-		if ((!result.c4tch) && (result.resume)) {
-			/* transform implicit reset in explicit one
-			 * NOTE: raise and drop are allowed only in
-			 * subtask so currentstate is a subtask */
-			result.c4tch = result.resume;
-		}
+	pthread_mutex_lock(&aio->pool.mutex);
 
-		zm_suspendByYield(vm, result, true);
+	while ((req = zm_aioListPop(&aio->pending))) {
+		req->queued = false;
+		zm_aioListAdd(&aio->pool.queue, req);
+		n++;
+	}
 
-		zm_lockAndImplodeByAbortException(vm, state, e);
+	aio->npending -= n;
 
-		/* TODO is not necessary uncaught field in vm because uncaught
-		 * == current state (remove it?) */
-		if (vm->uncaught)
-			return ZM_PROCESS_EXCEPTION | ZM_PROCESS_STATEUNLINKED;
+	if (n > 1)
+		pthread_cond_broadcast(&aio->pool.cond);
+	else
+		pthread_cond_signal(&aio->pool.cond);
 
-		return ZM_PROCESS_STATEUNLINKED;
-	}
+	pthread_mutex_unlock(&aio->pool.mutex);
 
+	aio->inflight += n;
+}
 
-	/** distructor of the task  */
-	case ZM_TASK_TERM:
-		ZM_D("ZM_PMODE_NORMAL | ZM_TASK_TERM");
 
-		zm_suspendByYield(vm, result, true);
+static zm_AioRequest* zm_aioPoolReap(zm_Aio *aio)
+{
+	zm_AioRequest *done;
 
-		zm_lockAndImplodeBy(vm, state, ZM_IMPLODEBY_CUR, "yield zmTERM",
-		                    state->codeframe.filename,
-		                    state->codeframe.nline);
+	pthread_mutex_lock(&aio->pool.mutex);
+	done = aio->pool.done.first;
+	aio->pool.done.first = aio->pool.done.last = NULL;
+	pthread_mutex_unlock(&aio->pool.mutex);
 
-		return ZM_PROCESS_STATEUNLINKED;
+	return done;
+}
 
-	case ZM_TASK_END:
-		zm_fatalInit(vm, NULL);
-		zm_fatalDo(ZM_FATAL_YCODE, "YNORM.YE",
-			   "yield zmEND is permitted only in closing mode "
-			   "inside ZM_TERM zmstate");
-		return 0;
 
-	/** Task Suspend - e.g. yield TO(foo) */
-	case ZM_TASK_SUSPEND:
-		ZM_D("ZM_PMODE_NORMAL | ZM_TASK_SUSPEND");
+static void zm_aioPoolFree(zm_Aio *aio)
+{
+	int i;
 
-		if (zm_isTask(state))
-			zm_suspendByYield(vm, result, false);
-		else
-			zm_resumeSubtaskCaller(vm, state, result, "zmSUSPEND");
+	pthread_mutex_lock(&aio->pool.mutex);
+	aio->pool.quit = true;
+	pthread_cond_broadcast(&aio->pool.cond);
+	pthread_mutex_unlock(&aio->pool.mutex);
 
-		return ZM_PROCESS_STATEUNLINKED;
+	/* threads exit when the queue is empty */
+	for (i = 0; i < aio->pool.nthread; i++)
+		pthread_join(aio->pool.thread[i], NULL);
 
-	/** Task suspend (iter) - e.g. yield zmCALLER */
-	case ZM_TASK_SUSPEND_AND_RESUME_CALLER:
-		ZM_D("ZM_PMODE_NORMAL | ZM_TASK_SUSPEND_AND_RESUME_CALLER");
+	pthread_mutex_destroy(&aio->pool.mutex);
+	pthread_cond_destroy(&aio->pool.cond);
+}
 
-		if (zm_isTask(state)) {
-			zm_fatalInit(vm, NULL);
-			zm_fatalDo(ZM_FATAL_YCODE, "YSUSPEND.CALL",
-				   "yield zmCALLER can be invoked only in "
-				   "subtask (ptask never has a caller)");
-		} else {
-			zm_resumeSubtaskCaller(vm, state, result, "zmCALLER");
-		}
 
-		return ZM_PROCESS_STATEUNLINKED;
 
-	/** Task suspend waiting subtask - e.g. yield SUB(foo) */
-	case ZM_TASK_SUSPEND_WAITING_SUBTASK:
-		ZM_D("ZM_PMODE_NORMAL | ZM_TASK_SUSPEND_WAIT_SUB");
-		/* suspend with waiting = true (ZM_STATE_WAITING) */
-		zm_suspendByYield(vm, result, true);
+/* ** io_uring backend ** */
 
-		return ZM_PROCESS_STATEUNLINKED;
+#ifdef ZM_AIO_HAVE_URING
 
+#define zm_uringLoad(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define zm_uringStore(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
 
-	/** Task suspend waiting event - e.g. yield EVENT(...)*/
-	case ZM_TASK_BUSY_WAITING_EVENT: {
-		/* zmEVENT has just:
-		 * - set flag ZM_STATE_EVENTLOCKED #EVB_FLAG
-		 * - set state->next to an eventbinder instance pointer
-		 *   #EVENT_BIND
-		 */
-		zm_EventBinder* evb = (zm_EventBinder*)state->next;
+static int zm_uringInit(zm_Aio *aio)
+{
+	struct io_uring_params p;
+	char *sq, *cq;
+	int fd;
 
-		/* temporary recover state->next to perform
-		 * suspendCurrentState */
-		state->next = (zm_State*)evb->statenext;
+	memset(&p, 0, sizeof(p));
 
-		ZM_D("ZM_PMODE_NORMAL | TASK_BUSY_WAITING_EVENT");
+	fd = (int)syscall(__NR_io_uring_setup, ZM_AIO_QUEUE, &p);
 
-		/* Temporary disable event flag to allow debug print in
-		   suspend current */
-		zm_disableFlag(state, ZM_STATE_EVENTLOCKED);
+	if (fd < 0)
+		return false;
 
-		/* suspend with waiting = true (ZM_STATE_WAITING) */
-		zm_suspendByYield(vm, result, true);
+	aio->uring.fd = fd;
+	aio->uring.entries = p.sq_entries;
+	aio->uring.cqentries = p.cq_entries;
+	aio->uring.sqringsize = p.sq_off.array +
+	                        p.sq_entries * sizeof(unsigned);
+	aio->uring.cqringsize = p.cq_off.cqes +
+	                        p.cq_entries * sizeof(struct io_uring_cqe);
 
-		zm_enableFlag(state, ZM_STATE_EVENTLOCKED);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (aio->uring.cqringsize > aio->uring.sqringsize)
+			aio->uring.sqringsize = aio->uring.cqringsize;
+		aio->uring.cqringsize = aio->uring.sqringsize;
+	}
 
-		/* save worker pointer in (suspend put worker in state->next */
-		/* to allow resume operation) to be recover after unbind */
-		evb->statenext = state->next;
+	sq = mmap(NULL, aio->uring.sqringsize, PROT_READ | PROT_WRITE,
+	          MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
 
-		/* replace again next state with evb */
-		state->next = (zm_State*)evb;
+	if (sq == MAP_FAILED) {
+		close(fd);
+		return false;
+	}
 
-		return ZM_PROCESS_STATEUNLINKED;
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		cq = sq;
+	} else {
+		cq = mmap(NULL, aio->uring.cqringsize, PROT_READ | PROT_WRITE,
+		          MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+
+		if (cq == MAP_FAILED) {
+			munmap(sq, aio->uring.sqringsize);
+			close(fd);
+			return false;
+		}
 	}
 
-	default:
-		zm_fatalInit(vm, NULL);
-		zm_fatalDo(ZM_FATAL_UP, "WCMOP.U", "unknow yield directive %d",
-		           result.cmd);
-		return 0;
+	aio->uring.sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+	                       PROT_READ | PROT_WRITE,
+	                       MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+
+	if (aio->uring.sqes == MAP_FAILED) {
+		if (cq != sq)
+			munmap(cq, aio->uring.cqringsize);
+		munmap(sq, aio->uring.sqringsize);
+		close(fd);
+		return false;
+	}
+
+	aio->uring.sqring = sq;
+	aio->uring.cqring = cq;
+
+	aio->uring.sqhead = (unsigned*)(sq + p.sq_off.head);
+	aio->uring.sqtail = (unsigned*)(sq + p.sq_off.tail);
+	aio->uring.sqmask = (unsigned*)(sq + p.sq_off.ring_mask);
+	aio->uring.sqarray = (unsigned*)(sq + p.sq_off.array);
+
+	aio->uring.cqhead = (unsigned*)(cq + p.cq_off.head);
+	aio->uring.cqtail = (unsigned*)(cq + p.cq_off.tail);
+	aio->uring.cqmask = (unsigned*)(cq + p.cq_off.ring_mask);
+	aio->uring.cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+
+	aio->uring.unsubmitted = 0;
+
+	/* completion notify throught eventfd */
+	if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_EVENTFD,
+	            &aio->notifyfd, 1) < 0) {
+		munmap(aio->uring.sqes, p.sq_entries *
+		       sizeof(struct io_uring_sqe));
+		if (cq != sq)
+			munmap(cq, aio->uring.cqringsize);
+		munmap(sq, aio->uring.sqringsize);
+		close(fd);
+		return false;
 	}
+
+	return true;
 }
 
 
-/*
- * process close mode yield
- */
-static int zm_closeYield(zm_VM *vm, zm_Worker *worker, zm_State *state,
-                                                       zm_Yield result)
+static void zm_uringEnter(zm_VM *vm, zm_Aio *aio, unsigned wait)
+{
+	int r;
+
+	do {
+		r = (int)syscall(__NR_io_uring_enter, aio->uring.fd,
+		                 aio->uring.unsubmitted, wait,
+		                 (wait) ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+	} while ((r < 0) && (errno == EINTR));
+
+	if (r < 0) {
+		/* EAGAIN/EBUSY: kernel busy, sqe still in the ring (retry
+		   in next submit) */
+		if ((errno == EAGAIN) || (errno == EBUSY))
+			return;
+
+		zm_aioFatal(vm, "AIO.ENTER", "io_uring_enter");
+	}
+
+	aio->uring.unsubmitted -= r;
+}
+
+
+static void zm_uringSubmit(zm_VM *vm, zm_Aio *aio)
 {
-	int cmd = ZM_B4(result.cmd);
+	unsigned tail = *aio->uring.sqtail;
+	unsigned mask = *aio->uring.sqmask;
+	unsigned n = 0;
 
-	switch( cmd ) {
+	while (aio->pending.first) {
+		zm_AioRequest *req;
+		struct io_uring_sqe *sqe;
+		unsigned idx;
 
-	case ZM_TASK_END:
-		ZM_D("ZM_PMODE_CLOSE | ZM_TASK_END");
-		/*  CHECK_OR_NOT */
+		if (tail - zm_uringLoad(aio->uring.sqhead) >= aio->uring.entries)
+			break; /* ring full: keep the rest in pending */
 
-		if (zm_hasntFlag(state, ZM_STATE_IMPLOSIONLOCK)) {
-			zm_fatalInit(vm, NULL);
-			zm_fatalDo(ZM_FATAL_UP, "YEND.NLI",
-			           "task not implode-locked in close mode");
-		}
+		if (aio->inflight + n >= aio->uring.cqentries)
+			break; /* no room for the completions */
 
-		state->pmode = ZM_PMODE_END;
+		req = zm_aioListPop(&aio->pending);
+		req->queued = false;
 
-		return 0;
+		idx = tail & mask;
+		sqe = &aio->uring.sqes[idx];
 
-	default:
-		zm_fatalInit(vm, NULL);
-		zm_fatalDo(ZM_FATAL_YCODE, "YEND.WY",
-		           "in ZM_TERM only yield zmEND is permitted"
-		           );
+		memset(sqe, 0, sizeof(*sqe));
+		sqe->opcode = (req->op == ZM_AIO_READ) ? IORING_OP_READV :
+		                                         IORING_OP_WRITEV;
+		sqe->fd = req->fd;
+		sqe->addr = (uint64_t)(uintptr_t)&req->iov;
+		sqe->len = 1;
+		sqe->off = (uint64_t)req->offset;
+		sqe->user_data = (uint64_t)(uintptr_t)req;
 
-		return 0;
+		aio->uring.sqarray[idx] = idx;
+		tail++;
+		n++;
 	}
+
+	if (!n && !aio->uring.unsubmitted)
+		return;
+
+	zm_uringStore(aio->uring.sqtail, tail);
+
+	aio->uring.unsubmitted += n;
+	aio->inflight += n;
+	aio->npending -= n;
+
+	/* one syscall for all the tasks requests */
+	zm_uringEnter(vm, aio, 0);
 }
 
 
-static int zm_processTask(zm_VM *vm, zm_Worker *worker, zm_State *state)
+static zm_AioRequest* zm_uringReap(zm_Aio *aio)
 {
-	ZM_D("process_state[0] - state = [ref %zx]  pmode = %d", state,
-	     state->pmode);
+	zm_AioList done = {NULL, NULL};
+	unsigned head = *aio->uring.cqhead;
+	unsigned tail = zm_uringLoad(aio->uring.cqtail);
+	unsigned mask = *aio->uring.cqmask;
 
-	switch(state->pmode) {
-	case ZM_PMODE_NORMAL:
-	case ZM_PMODE_CLOSE: {
-		/* RUN: Excute a step of machine */
-		zm_Yield y = zm_runTask(vm, worker, state);
+	while (head != tail) {
+		struct io_uring_cqe *cqe = &aio->uring.cqes[head & mask];
+		zm_AioRequest *req = (zm_AioRequest*)(uintptr_t)cqe->user_data;
 
-		if (state->pmode == ZM_PMODE_CLOSE)
-			return zm_closeYield(vm, worker, state, y);
-		else
-			return zm_normalYield(vm, worker, state, y);
+		req->result = cqe->res;
+		zm_aioListAdd(&done, req);
+		head++;
 	}
 
-	case ZM_PMODE_END:
-		/* Remove the state from list (should be invoked in
-		 * ZM_TERM when all user-resource as been free) */
+	zm_uringStore(aio->uring.cqhead, head);
 
-		ZM_D("ZM_PMODE_END:");
+	return done.first;
+}
 
-		if (zm_isSubTask(state)) {
-			/* resume parent (end mode) done before
-			 * unlinkCurrentState to avoid unuseful
-			 * unlink/add worker when state and parent
-			 * have same worker */
-			if (zm_hasCaller(state)) {
-				zm_resumeCaller(vm, state, false);
-			}
-		}
 
-		zm_unlinkCurrentState(vm);
+static void zm_uringFree(zm_VM *vm, zm_Aio *aio)
+{
+	/* wait all the submitted requests before unmap the rings */
+	while (aio->inflight) {
+		zm_AioRequest *req;
 
-		state->pmode = ZM_PMODE_OFF;
+		if (aio->uring.unsubmitted)
+			zm_uringEnter(vm, aio, 0);
 
-		ZM_D("CLOSE TASK: remove state from siblings ...");
-		zm_removeStateFromSiblings(vm, state);
+		zm_uringEnter(vm, aio, 1);
 
-		if (zm_isSubTask(state)) {
-			zm_nfree(zm_State*, zm_deep(state),
-			         state->parent->stack);
+		req = zm_uringReap(aio);
 
-			state->parent->comeback = NULL;
-			state->parent->stack = NULL;
+		while (req) {
+			zm_AioRequest *next = req->next;
+			aio->inflight--;
+			zm_free(zm_AioRequest, req);
+			req = next;
+		}
+	}
 
-			zm_free(zm_Parent, state->parent);
+	munmap(aio->uring.sqes, aio->uring.entries *
+	       sizeof(struct io_uring_sqe));
 
-			/* NOTE: state->parent don't have to be set = NULL
-			 * because this will change the nature of the task
-			 * (subtask become ptask) and this is a problem in
-			 * explicit free task operation (see #FREE_TASK_KIND)
-			 */
-		}
+	if (aio->uring.cqring != aio->uring.sqring)
+		munmap(aio->uring.cqring, aio->uring.cqringsize);
 
-		if (zm_hasException(state, ZM_EXCEPTION_CONTINUEHEAD)) {
-			zm_free(zm_Exception, state->exception);
-			state->exception = NULL;
-		} else if (state->exception) {
-			/* If there is alredy an exception with
-			 * kind != continueref ... something has going wrong */
-			zm_fatalInit(vm, NULL);
-			zm_fatalDo(ZM_FATAL_UP, "PPS.EEN",
-			           "exception still present in ZM_PMODE_END");
-		}
+	munmap(aio->uring.sqring, aio->uring.sqringsize);
 
-		if (zm_hasFlag(state, ZM_STATE_AUTOFREE)) {
-			ZM_D("CLOSE TASK: free state");
-			zm_free(zm_State, state);
-		}
+	close(aio->uring.fd);
+}
+#endif
 
-		/** remove state from vm (no more executed)*/
-		return ZM_PROCESS_STATEUNLINKED;
 
 
-	case ZM_PMODE_ASYNCIMPLODE: {
-		/* this is a special for lock and implode
-		   #ASYNC_SERIALIZATION [step 3]*/
-		zm_State *imstart;
+/* ** common ** */
 
-		ZM_D("ZM_PMODE_ASYNCIMPLODE");
-		imstart = zm_popAsyncImplosionStart(state);
+int zm_aioInit(zm_VM *vm, int backend)
+{
+	zm_Aio *aio;
 
-		state->pmode = ZM_PMODE_CLOSE;
+	if (vm->aio)
+		return vm->aio->backend;
 
-		/* All implosion task, except the imstart, must be in
-		 * waiting subtask (see #IMPLODE_WAITING_CHAIN)
-		 * suspend with waiting = true (ZM_STATE_WAITING) */
-		zm_suspendCurrentState(vm, true);
+	aio = zm_alloc(zm_Aio);
+	aio->pending.first = aio->pending.last = NULL;
+	aio->dropped.first = aio->dropped.last = NULL;
+	aio->npending = 0;
+	aio->inflight = 0;
 
-		ZM_D("star implosion from: %zx", imstart);
+	aio->notifyfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
 
-		zm_resumeState(vm, imstart);
+	if (aio->notifyfd < 0)
+		zm_aioFatal(vm, "AIO.EVFD", "eventfd");
 
-		return ZM_PROCESS_STATEUNLINKED;
+	aio->backend = 0;
+
+	#ifdef ZM_AIO_HAVE_URING
+	if ((backend != ZM_AIO_THREADS) && zm_uringInit(aio))
+		aio->backend = ZM_AIO_URING;
+	#endif
+
+	if (!aio->backend) {
+		if (backend == ZM_AIO_URING) {
+			zm_fatalInit(vm, "zm_aioInit");
+			zm_fatalDo(ZM_FATAL_GCODE, "AIO.URING",
+			           "io_uring not avaible");
+		}
+
+		aio->backend = zm_aioPoolInit(vm, aio);
 	}
 
-	case ZM_PMODE_OFF:
-		zm_fatalInit(vm, NULL);
-		zm_fatalDo(ZM_FATAL_UP, "PPS.NMTD",
-		           "pmode = ZM_PMODE_OFF in processState");
-		return 0;
+	vm->aio = aio;
 
-	default:
-		zm_fatalInit(vm, NULL);
-		zm_fatalDo(ZM_FATAL_UP, "PPS.UVMOP",
-		           "unknow pmode = %d in processState",
-		           state->pmode);
-		return 0;
+	#ifdef ZM_ENABLE_EPOLL
+	{
+		/* zm_poll wait completion together with fd readiness */
+		struct epoll_event ev;
+
+		zm_epollInit(vm, "zm_aioInit");
+
+		ev.events = EPOLLIN;
+		ev.data.ptr = aio;
+
+		if (epoll_ctl(vm->epoll.fd, EPOLL_CTL_ADD, aio->notifyfd, &ev))
+			zm_aioFatal(vm, "AIO.EPOLL", "epoll_ctl");
 	}
+	#endif
+
+	ZM_D("zm_aioInit: backend = %d", aio->backend);
+
+	return aio->backend;
 }
 
 
-static int zm_goStep(zm_VM* vm, zm_Worker *worker, zm_State *state)
+size_t zm_aioInflight(zm_VM *vm)
 {
-	int r;
+	zm_Aio *aio = vm->aio;
 
-	ZM_D("stateGo: process state with worker = %s", worker->machine->name);
-	ZM_D("stateGo: process state [ref %zx] ", state);
+	if (!aio)
+		return 0;
 
-	vm->session.state = state;
-	vm->session.worker = worker;
-	vm->session.suspendop = 0;
+	return aio->inflight + aio->npending;
+}
 
-	if (vm->prepost)
-		vm->prepost(vm, worker->machine, state, 0);
 
-	r = zm_processTask(vm, worker, state);
+static void zm_aioFree(zm_VM *vm)
+{
+	zm_Aio *aio = vm->aio;
+	zm_AioRequest *req;
 
-	if (vm->prepost)
-		vm->prepost(vm, worker->machine, state, 1);
+	if (!aio)
+		return;
 
-	ZM_D("stateGo - process state return %d", r);
+	#ifdef ZM_AIO_HAVE_URING
+	if (aio->backend == ZM_AIO_URING)
+		zm_uringFree(vm, aio);
+	#endif
 
-	/* state unlink cause an implicit cursor move */
-	if (!(r & ZM_PROCESS_STATEUNLINKED))
-		zm_stateNext(worker);
+	if (aio->backend == ZM_AIO_THREADS) {
+		zm_aioPoolFree(aio);
+		req = aio->pool.done.first;
 
-	r = (r & ZM_PROCESS_EXCEPTION) ? ZM_RUN_EXCEPTION : ZM_RUN_IDLE;
+		while (req) {
+			zm_AioRequest *next = req->next;
+			zm_free(zm_AioRequest, req);
+			req = next;
+		}
+	}
 
-	if (!vm->session.fixedworker)
-		/* in non fixedworker mode idle is returned only by zm_go
-		   when there are no more worker avaible */
-		r = r | ZM_RUN_AGAIN;
-	else if (worker->nstate > 0)
-		/* in fixedworker mode idle is returned when nstate == 0 */
-		r = r | ZM_RUN_AGAIN;
+	/* never submitted */
+	while ((req = zm_aioListPop(&aio->pending)))
+		zm_free(zm_AioRequest, req);
 
-	return r;
+	while ((req = zm_aioListPop(&aio->dropped)))
+		zm_free(zm_AioRequest, req);
+
+	close(aio->notifyfd);
+
+	zm_free(zm_Aio, aio);
+
+	vm->aio = NULL;
 }
 
 
-static zm_Worker* zm_goGetWorker(zm_VM* vm)
+static void zm_aioSubmit(zm_VM *vm)
 {
-	zm_Worker *worker;
+	zm_Aio *aio = vm->aio;
+	zm_AioRequest *req;
 
-	if (vm->session.fixedworker) {
-		worker = vm->session.worker;
-	} else {
-		/* get current cursor worker */
-		if (!vm->workercursor)
-			return NULL;
+	while ((req = zm_aioListPop(&aio->dropped)))
+		zm_free(zm_AioRequest, req);
 
-		worker = vm->workercursor;
+	#ifdef ZM_AIO_HAVE_URING
+	if (aio->backend == ZM_AIO_URING) {
+		zm_uringSubmit(vm, aio);
+		return;
 	}
+	#endif
+
+	if (aio->pending.first)
+		zm_aioPoolSubmit(aio);
+}
 
 
-	#ifdef ZM_CHECK_CONSISTENCY
-	if (worker->nstate < 0) {
-		zm_fatalInit(vm, NULL);
-		zm_fatalDo(ZM_FATAL_U1, "WGO.WNS", "worker->nstate = %d",
-		           worker->nstate);
-	}
+/*
+ * trigger the completed requests, return the number of resumed tasks
+ */
+static size_t zm_aioReap(zm_VM *vm)
+{
+	zm_Aio *aio = vm->aio;
+	zm_AioRequest *req;
+	size_t count = 0;
+
+	zm_aioClearNotify(aio->notifyfd);
+
+	#ifdef ZM_AIO_HAVE_URING
+	if (aio->backend == ZM_AIO_URING)
+		req = zm_uringReap(aio);
+	else
 	#endif
+		req = zm_aioPoolReap(aio);
 
-	/* check if there a least one state */
-	if (worker->nstate == 0) {
-		/* no more state in this worker */
-		ZM_D("zm_go: no more state in worker -> IDLE");
-		return NULL;
+	while (req) {
+		zm_AioRequest *next = req->next;
+
+		aio->inflight--;
+
+		/* the task can be just unbinded (closed) */
+		count += zm_trigger(vm, &req->event,
+		                    (void*)(intptr_t)req->result);
+
+		zm_free(zm_AioRequest, req);
+
+		req = next;
 	}
 
-	return worker;
+	return count;
 }
 
 
-static zm_State* zm_goGetState(zm_VM* vm, zm_Worker* worker)
+/*
+ * unbind callback of the request event: a request not yet submitted is
+ * dropped (the request is still used by the unbind so it's free later)
+ */
+static int zm_aioUnbind(zm_VM *vm, int scope, zm_Event *event,
+                        zm_State *state, void *argument)
 {
-	if (!worker->states.current) {
-		zm_rewindWorkerStates(vm, worker);
+	zm_AioRequest *req = (zm_AioRequest*)event->data;
 
-		if ((!vm->session.fixedworker) && (vm->nworker > 1)) {
-			worker = zm_nextWorker(vm);
-			/* return null to check worker with goGetWorker */
-			return NULL;
-		}
+	if (req->queued) {
+		zm_aioListRemove(&vm->aio->pending, req);
+		vm->aio->npending--;
+
+		zm_aioListAdd(&vm->aio->dropped, req);
 	}
 
-	return worker->states.current;
+	return ZM_EVENT_ACCEPTED;
 }
 
 
-int zm_go(zm_VM* vm, unsigned int ncycle, zm_Machine* onemachine)
+/*
+ * yield to async read/write (alias: zmREAD, zmWRITE)
+ */
+zm_yield_t izmAIO(zm_VM* vm, int op, int fd, void *buf, size_t len,
+                  int64_t offset, const char *filename, int nline)
 {
-	zm_Worker* worker;
-	zm_State* state;
-	int r;
+	const char *ref = (op == ZM_AIO_READ) ? "zmREAD" : "zmWRITE";
+	zm_AioRequest *req;
 
-	ZM_D("GO - init: vm = %d - machine = %zx", vm, onemachine);
+	ZM_ASSERT_VMLOCK("AIO.VLCK", ref, filename, nline);
 
-	if (onemachine) {
-		vm->session.worker = zm_getWorker(vm, onemachine);
-		vm->session.fixedworker = true;
-	} else {
-		vm->session.fixedworker = false;
-	}
+	if (!vm->aio)
+		zm_aioInit(vm, ZM_AIO_AUTO);
 
+	req = zm_alloc(zm_AioRequest);
+	req->op = op;
+	req->fd = fd;
+	req->offset = offset;
+	req->iov.iov_base = buf;
+	req->iov.iov_len = len;
+	req->result = 0;
 
-	while(ncycle > 0) {
-		ZM_D("GO - ********** STEP #%d **********", ncycle);
+	zm_initEvent(&req->event, req);
+	zm_setEventCB(vm, &req->event, zm_aioUnbind, ZM_EVENT_UNBIND);
 
-		if (vm->pause) {
-			vm->pause = false;
-			return ZM_RUN_AGAIN | ZM_RUN_BREAK;
-		}
+	zm_aioListAdd(&vm->aio->pending, req);
+	req->queued = true;
+	vm->aio->npending++;
 
-		worker = zm_goGetWorker(vm);
+	return izmEVENT(vm, &req->event, filename, nline);
+}
+#endif
 
-		if (!worker)
-			return ZM_RUN_IDLE;
 
-		state = zm_goGetState(vm, worker);
 
-		if (!state)
-			continue;
+#ifdef ZM_ENABLE_POLL
+/* ----------------------------------------------------------------------------
+ *  POLL                                                           (SECTION IO)
+ * --------------------------------------------------------------------------*/
 
-		r = zm_goStep(vm, worker, state);
+/*
+ * Submit the pending async i/o, wait (max timeout ms, -1 = infinite,
+ * 0 = no wait) fd readiness or i/o completions and resume the relative
+ * tasks. Return the number of resumed task.
+ */
+size_t zm_poll(zm_VM *vm, int timeout)
+{
+	size_t count = 0;
 
-		if (r != ZM_RUN_AGAIN)
-			return r;
+	if (vm->plock) {
+		zm_fatalInit(vm, "zm_poll");
+		zm_fatalDo(ZM_FATAL_TCODE, "POLL.LCK",
+		           "cannot invoke zm_poll during task execution");
+	}
 
-		#if ZM_DEBUG_LEVEL >= 4
-		zm_printVM(NULL, vm);
-		#endif
+	if (vm->timers.count) {
+		/* don't sleep over the next timeout */
+		int next = zm_nextTimeout(vm);
 
-		ncycle -= worker->cyclestep;
+		if ((timeout < 0) || (next < timeout))
+			timeout = next;
 	}
 
-	ZM_D("GO - end (ncycle left %d)\n", ncycle);
-	return ZM_RUN_AGAIN;
-}
+	if (vm->implosions.first)
+		timeout = 0;
 
+	#ifdef ZM_ENABLE_AIO
+	if (vm->aio) {
+		/* all the requests of the last zm_go cycles together */
+		zm_aioSubmit(vm);
+
+		count += zm_aioReap(vm);
+
+		if (count)
+			timeout = 0;
+
+		#ifndef ZM_ENABLE_EPOLL
+		if ((timeout != 0) &&
+		    ((vm->aio->inflight) || (vm->timers.count))) {
+			struct pollfd pfd;
+
+			pfd.fd = vm->aio->notifyfd;
+			pfd.events = POLLIN;
+
+			/* without inflight request just wait the timeout */
+			if (poll(&pfd, (vm->aio->inflight) ? 1 : 0, timeout) > 0)
+				count += zm_aioReap(vm);
+		}
+		#endif
+	}
+	#endif
+
+	#ifdef ZM_ENABLE_EPOLL
+	count += zm_epollWait(vm, timeout);
+	#endif
+
+	if (vm->timers.count)
+		count += zm_processTimers(vm);
+
+	return count;
+}
+#endif
@@ -41,6 +41,10 @@
 	#include <stdint.h>
 #endif
 
+#ifdef ZM_ENABLE_EPOLL
+	#include <sys/epoll.h>
+#endif
+
 #ifndef false
 	#define false 0
 #endif
@@ -61,6 +65,59 @@
 	#define ZM_CALLERSTACK_MAXDEEP 200000
 #endif
 
+/* number of slots of the timer wheel (power of 2) */
+#ifndef ZM_TIMER_WHEEL
+	#define ZM_TIMER_WHEEL 256
+#endif
+
+/* number of states of a vm arena chunk */
+#ifndef ZM_ARENA_CHUNK
+	#define ZM_ARENA_CHUNK 256
+#endif
+
+/* max number of fd readiness harvested by a single epoll_wait in zm_poll */
+#ifndef ZM_POLL_BATCH
+	#define ZM_POLL_BATCH 64
+#endif
+
+/* number of threads of the async i/o thread-pool backend */
+#ifndef ZM_AIO_NTHREAD
+	#define ZM_AIO_NTHREAD 4
+#endif
+
+/* size of the async i/o io_uring submission queue */
+#ifndef ZM_AIO_QUEUE
+	#define ZM_AIO_QUEUE 256
+#endif
+
+#if defined(ZM_ENABLE_EPOLL) || defined(ZM_ENABLE_AIO)
+	#define ZM_ENABLE_POLL 1
+#endif
+
+/* per-worker statistics (ZM_ENABLE_STATS_TIME add the step time) */
+#if defined(ZM_ENABLE_STATS_TIME) && !defined(ZM_ENABLE_STATS)
+	#define ZM_ENABLE_STATS 1
+#endif
+
+/* flight recorder ring size (ZM_ENABLE_RECORDER) must be a power of 2 */
+#ifndef ZM_RECORDER_SIZE
+	#define ZM_RECORDER_SIZE 256
+#endif
+
+/* resume to step latency histograms (see ZM_ENABLE_LATENCY) */
+#ifndef ZM_LATENCY_SUBBITS
+	#define ZM_LATENCY_SUBBITS 4
+#endif
+
+#ifndef ZM_LATENCY_MAXBITS
+	#define ZM_LATENCY_MAXBITS 40
+#endif
+
+/* task census depth buckets (see ZM_ENABLE_CENSUS) */
+#ifndef ZM_CENSUS_NDEPTH
+	#define ZM_CENSUS_NDEPTH 16
+#endif
+
 
 #ifndef ZM_DEBUG_LEVEL
 	#define ZM_DEBUG_LEVEL 0
@@ -125,7 +182,13 @@ enum { /* * yield-command * */
 	/* implicit macro zmABORT */
 	ZM_TASK_RAISE_ABORT_EXCEPTION = ZM_B4(8),
 
-	ZM_TASK_INIT = ZM_B4(9)
+	ZM_TASK_INIT = ZM_B4(9),
+
+	/* implicit macro zmSUBSCRIBE (a trigger is just arrived) */
+	ZM_TASK_EVENT_READY = ZM_B4(10),
+
+	/* implicit macro zmAWAIT (the future is just completed) */
+	ZM_TASK_FUTURE_READY = ZM_B4(11)
 };
 
 
@@ -175,8 +238,17 @@ enum {
 /* bit: 7 - continue exception mark */
 #define ZM_STATE_CONTINUEMARK 64
 
-/* bit: 8 - unused */
-#define ZM_STATE_UNUSED 128
+/* bit: 8 - cancel request (forced zmTERM at next step) */
+#define ZM_STATE_CANCEL 128
+
+/* bit: 9 - ptask with an incremental implosion in progress */
+#define ZM_STATE_IMPLODING 256
+
+/* bit: 10 - machine without external resources (see zm_setNoTerm) */
+#define ZM_STATE_NOTERM 512
+
+/* bit: 11 - constructor (ZM_INIT) deferred to first step */
+#define ZM_STATE_NOINIT 1024
 
 
 
@@ -191,6 +263,8 @@ enum {
 #define ZM_EVENT_UNBIND_ABORT    1024
 #define ZM_EVENT_UNBIND   (ZM_EVENT_UNBIND_REQUEST | ZM_EVENT_UNBIND_ABORT)
 
+#define ZM_EVENT_FD             2048 /* event->flag: created by zm_newFdEvent */
+
 #define ZM_TRIGGER                 ZM_EVENT_TRIGGER
 #define ZM_UNBIND_REQUEST          ZM_EVENT_UNBIND_REQUEST
 #define ZM_UNBIND_ABORT            ZM_EVENT_UNBIND_ABORT
@@ -222,6 +296,9 @@ enum {
 
 
 typedef struct zm_VM_ zm_VM;
+typedef struct zm_Implosion_ zm_Implosion;
+typedef struct zm_Arena_ zm_Arena;
+typedef struct zm_StateExt_ zm_StateExt;
 
 typedef struct zm_Exception_ zm_Exception;
 
@@ -229,6 +306,12 @@ typedef struct zm_Trace_ zm_Trace;
 
 typedef struct zm_State_ zm_State;
 
+typedef struct zm_EventBinder_ zm_EventBinder;
+
+typedef struct zm_Timer_ zm_Timer;
+
+typedef struct zm_GroupLink_ zm_GroupLink;
+
 
 typedef struct {
 #if ZM_BYTEORDER_LE
@@ -252,6 +335,13 @@ typedef struct {
 } zm_Parent;
 
 
+/* * Join mode (zmSUBALL, zmSUBANY, zmSUB_DEADLINE) * */
+
+#define ZM_JOIN_ALL 0
+#define ZM_JOIN_ANY 1
+#define ZM_JOIN_DEADLINE 2
+
+
 /* * State * */
 
 struct zm_State_ {
@@ -280,6 +370,22 @@ struct zm_State_ {
 	zm_Exception *exception;
 	zm_State *next;
 
+	zm_StateExt *ext; /* fields used by few tasks (allocated on use) */
+
+	zm_Arena *arena; /* arena chunk of the state memory */
+
+	#ifdef ZM_ENABLE_LATENCY
+	uint64_t resumed; /* resume time in ns (0 = not stamped) */
+	#endif
+
+	#ifdef ZM_ENABLE_CENSUS
+	struct zm_Worker_ *census; /* census row (NULL when not counted) */
+	#endif
+
+	#ifdef ZM_ENABLE_TRACE
+	uint64_t traceid; /* per-vm sequence (the state memory is reused) */
+	#endif
+
 	#ifdef ZM_DEBUG_MACHINENAME
 		const char* debugmachinename;
 	#endif
@@ -317,7 +423,6 @@ struct zm_StateQueue_ {
 /* * Events * */
 
 typedef struct zm_Event_ zm_Event;
-typedef struct zm_EventBinder_ zm_EventBinder;
 
 /* event callback (trigger and unbind) */
 typedef int (*zm_event_cb)(zm_VM *vm,
@@ -339,6 +444,69 @@ struct zm_Event_ {
 };
 
 
+/* * Task Groups * */
+
+typedef struct {
+	size_t count;          /* alive ptasks */
+	zm_GroupLink *first;   /* members ring */
+	zm_Event *done;        /* triggered when count reach 0 */
+	void *data;
+} zm_Group;
+
+struct zm_GroupLink_ {
+	zm_Group *group;
+	zm_State *state;
+	zm_GroupLink *next;
+	zm_GroupLink *prev;
+};
+
+
+/* * Futures * */
+
+typedef struct {
+	int done;              /* true after zm_complete */
+	void *value;           /* completion value */
+	zm_Event *ready;       /* awaiting tasks */
+	void *data;
+} zm_Future;
+
+
+#ifdef ZM_ENABLE_EPOLL
+/* * Fd Events (ZM_ENABLE_EPOLL) * */
+
+/* fd-event: a zm_Event (stored in event->data) bound to a file descriptor
+ * readiness. It's passed as resume argument to the tasks resumed by
+ * zm_poll. */
+typedef struct {
+	int fd;
+	int events;    /* requested readiness (EPOLLIN, EPOLLOUT ...) */
+	int revents;   /* readiness reported by last zm_poll */
+	int armed;     /* ZM_FDEVENT_IDLE, ZM_FDEVENT_ARMED */
+	zm_Event *event;
+} zm_FdEvent;
+
+#define ZM_FDEVENT_ARMED 1 /* waiting a readiness (EPOLLONESHOT) */
+#define ZM_FDEVENT_IDLE  2 /* added but disabled (new or oneshot fired) */
+#endif
+
+
+#ifdef ZM_ENABLE_AIO
+/* * Async file i/o (ZM_ENABLE_AIO) * */
+
+typedef struct zm_Aio_ zm_Aio;
+
+#define ZM_AIO_AUTO    0 /* io_uring if avaible otherwise thread-pool */
+#define ZM_AIO_URING   1
+#define ZM_AIO_THREADS 2
+
+#define ZM_AIO_READ    1
+#define ZM_AIO_WRITE   2
+
+/* resume argument of zmREAD/zmWRITE: bytes transferred or -errno */
+#define zm_aioResult(arg) ((long)(intptr_t)(arg))
+#endif
+
+
 struct zm_EventBinder_ {
 	zm_EventBinder *next; /* ring linked-list */
 	zm_EventBinder *prev;
@@ -349,6 +517,33 @@ struct zm_EventBinder_ {
 };
 
 
+/* * Timer * */
+
+/* timer of a timed event wait in the timing wheel slot list */
+struct zm_Timer_ {
+	zm_Timer *next;
+	zm_Timer *prev;
+	uint64_t expire; /* ms */
+	zm_State *waiting;       /* zmEVENT_TIMEOUT (bound task) */
+	zm_State *deadline;      /* zmSUB_DEADLINE (caller) */
+};
+
+
+/* millisecond monotonic clock */
+typedef uint64_t (*zm_clock_cb)(zm_VM *vm);
+
+/* resume argument of a task resumed by a wait timeout */
+extern int zmg_timeout;
+#define ZM_TIMEOUT ((void*)&zmg_timeout)
+
+
+/* persistent subscription flag */
+#define ZM_EVB_SUBSCRIPTION 1 /* stay in bindlist after trigger */
+#define ZM_EVB_WAITING      2 /* owner is suspended on it */
+#define ZM_EVB_PENDING      4 /* trigger arrived while owner was running */
+#define ZM_EVB_UNBOUND      8 /* removed from bindlist by an unbind request */
+
+
 
 /* * Exception * */
 
@@ -381,6 +576,10 @@ struct zm_Exception_ {
 	/*used in continue #CONTINUE_EXCEPT */
 	zm_State *raisestate;
 
+	/* used in async implosion with more running states
+	 * #ASYNC_SERIALIZATION */
+	zm_Exception *link;
+
 	zm_Trace *etrace;
 };
 
@@ -416,8 +615,146 @@ typedef struct {
 	int id;
 	zm_yield_t (*fun)(zm_VM* zm, int zmop, void *zmarg);
 	const char* name;
+	int noterm; /* ZM_TERM is a no-op (see zm_setNoTerm) */
 } zm_Machine;
 
+#ifdef ZM_ENABLE_STATS
+/* * Worker statistics (ZM_ENABLE_STATS) * */
+
+/* number of yield command counters */
+#define ZM_STATS_NCMD 16
+
+/* yield command counter index: yields[ZM_STATS_CMD(ZM_TASK_TERM)] */
+#define ZM_STATS_CMD(cmd) ((cmd) >> 24)
+
+typedef struct {
+	uint64_t steps;                  /* machine steps */
+	uint64_t yields[ZM_STATS_NCMD];  /* steps by yield command */
+	uint64_t created;                /* tasks created */
+	uint64_t freed;                  /* tasks closed (removed from vm) */
+	uint64_t live;                   /* created - freed */
+	uint64_t peak;                   /* max live */
+	uint64_t steptime;               /* ns (ZM_ENABLE_STATS_TIME) */
+	uint64_t maxsteptime;            /* ns (ZM_ENABLE_STATS_TIME) */
+} zm_WorkerStats;
+#endif
+
+
+#ifdef ZM_ENABLE_PROFILE
+/* * zmstate profile (ZM_ENABLE_PROFILE) * */
+
+/* one counter for each zmstate (0-255) */
+#define ZM_PROFILE_NSTATE 256
+
+typedef struct {
+	uint64_t count;    /* steps */
+	uint64_t time;     /* ns */
+	uint64_t maxtime;  /* ns */
+} zm_StateProfile;
+#endif
+
+
+#ifdef ZM_ENABLE_CENSUS
+/* * Task census (ZM_ENABLE_CENSUS) * */
+
+/* task status (the first 5 are exclusive, CATCH count the armed catch) */
+#define ZM_CENSUS_RUNNING 0      /* ready or in step (ZM_STATE_RUN) */
+#define ZM_CENSUS_SUSPENDED 1
+#define ZM_CENSUS_WAITING 2      /* waiting a subtask */
+#define ZM_CENSUS_EVENTLOCKED 3
+#define ZM_CENSUS_IMPLOSIONLOCKED 4
+#define ZM_CENSUS_CATCH 5
+#define ZM_CENSUS_NSTATUS 6
+
+typedef struct {
+	zm_Machine *machine;
+	size_t tasks;
+	size_t status[ZM_CENSUS_NSTATUS];
+} zm_CensusRow;
+
+typedef struct {
+	size_t tasks;
+	size_t status[ZM_CENSUS_NSTATUS];
+	size_t depth[ZM_CENSUS_NDEPTH];  /* 0 = ptasks, last = deeper */
+
+	/* by machine: set rows and maxrow (or NULL and 0) before the call */
+	zm_CensusRow *rows;
+	size_t maxrow;
+	size_t nrow;   /* machines with live tasks (can be > maxrow) */
+} zm_Census;
+#endif
+
+
+#ifdef ZM_ENABLE_LATENCY
+/* * Latency histogram (ZM_ENABLE_LATENCY) * */
+
+/*
+ * Log-linear buckets: values below 2^SUBBITS have their own bucket, then
+ * each power of two is split in 2^SUBBITS buckets (max relative error
+ * 1/2^SUBBITS). Values from 2^MAXBITS are counted in the last bucket.
+ */
+#define ZM_LATENCY_NBUCKET \
+	((ZM_LATENCY_MAXBITS - ZM_LATENCY_SUBBITS + 1) << ZM_LATENCY_SUBBITS)
+
+typedef struct {
+	uint64_t count;
+	uint64_t min;   /* ns */
+	uint64_t max;   /* ns */
+	uint64_t sum;   /* ns */
+	uint64_t bucket[ZM_LATENCY_NBUCKET];
+} zm_Histogram;
+#endif
+
+
+#ifdef ZM_ENABLE_TRACE
+/* * Scheduler trace (ZM_ENABLE_TRACE) * */
+
+enum {
+	ZM_TRACE_STEP = 1,  /* a machine step */
+	ZM_TRACE_CALL,      /* caller -> subtask (zmSUB, zmSUBALL ...) */
+	ZM_TRACE_RETURN,    /* subtask -> caller */
+	ZM_TRACE_TRIGGER    /* zm_trigger */
+};
+
+typedef struct {
+	uint64_t ts;       /* ns from zm_startTrace */
+	uint64_t dur;      /* ns (step) */
+	uint64_t from;     /* task id (step, caller or returning subtask) */
+	uint64_t to;       /* called or returned task id */
+	const void *event; /* triggered event */
+	const char *name;  /* machine name (step) */
+	uint32_t count;    /* resumed tasks (trigger) */
+	uint8_t kind;
+	uint8_t resume;    /* zmstate (step) */
+	uint8_t cmd;       /* yield command index (step) */
+} zm_TraceRecord;
+#endif
+
+
+#ifdef ZM_ENABLE_RECORDER
+/* * Flight recorder (ZM_ENABLE_RECORDER) * */
+
+enum {
+	ZM_RECORD_STEP = 1,  /* step (a = zmstate, b = yield command) */
+	ZM_RECORD_RESUME,    /* task added to its worker */
+	ZM_RECORD_TRIGGER,   /* event trigger (arg = resumed tasks) */
+	ZM_RECORD_RAISE,     /* exception raised (a = kind, arg = code) */
+	ZM_RECORD_CATCH,     /* exception catched (arg = code) */
+	ZM_RECORD_CLOSE,     /* task closed (lock and implode) */
+	ZM_RECORD_END        /* task removed from vm */
+};
+
+typedef struct {
+	const void *ref;   /* state (event for trigger) */
+	const char *name;  /* machine name */
+	uint32_t arg;
+	uint8_t kind;
+	uint8_t a;
+	uint8_t b;
+} zm_Record;
+#endif
+
+
 /* * Worker * */
 
 typedef struct zm_Worker_ zm_Worker;
@@ -440,6 +777,22 @@ struct zm_Worker_ {
 
 	zm_Worker *next;
 	zm_Worker *prev;
+
+	#ifdef ZM_ENABLE_STATS
+	zm_WorkerStats stats;
+	#endif
+
+	#ifdef ZM_ENABLE_LATENCY
+	zm_Histogram latency;
+	#endif
+
+	#ifdef ZM_ENABLE_PROFILE
+	zm_StateProfile *profile; /* ZM_PROFILE_NSTATE (first step) */
+	#endif
+
+	#ifdef ZM_ENABLE_CENSUS
+	size_t census[ZM_CENSUS_NSTATUS];
+	#endif
 };
 
 
@@ -460,6 +813,40 @@ struct zm_VM_ {
 	/* pre/post process state: vm, machine, state, ispost*/
 	zm_process_cb prepost;
 
+	/* max inline subtask call/return steps (see zm_setInlineSub) */
+	unsigned int inlinesub;
+
+	/* run ZM_INIT at the first step (see zm_setDeferInit) */
+	int deferinit;
+
+	#ifdef ZM_ENABLE_LATENCY
+	zm_Histogram latency; /* all machines */
+	#endif
+
+	#ifdef ZM_ENABLE_CENSUS
+	size_t censusdepth[ZM_CENSUS_NDEPTH]; /* live tasks by depth */
+	#endif
+
+	#ifdef ZM_ENABLE_RECORDER
+	struct {
+		zm_Record ring[ZM_RECORDER_SIZE];
+		uint64_t seq; /* records written (next = seq % size) */
+	} recorder;
+	#endif
+
+	#ifdef ZM_ENABLE_TRACE
+	struct {
+		zm_TraceRecord *records;
+		size_t size;
+		size_t used;
+		size_t lost;      /* records dropped (buffer full) */
+		int on;
+		uint64_t t0;
+		uint64_t step;    /* begin of the last step */
+		uint64_t lastid;  /* last task id (zm_State traceid) */
+	} tracer;
+	#endif
+
 	zm_State *ptasks;
 	size_t nptask;
 
@@ -476,11 +863,55 @@ struct zm_VM_ {
 
 	zm_Exception* uncaught;
 
+	/* incremental implosions (see zm_setImplodeSlice) */
+	struct {
+		size_t slice;
+		zm_Implosion *first;
+		zm_Implosion *last;
+	} implosions;
+
+	/* state arena: states are carved from chunks (see zm_stateFree) */
+	struct {
+		zm_Arena *chunks;
+		size_t used;       /* states carved from the first chunk */
+		zm_Arena *partial; /* chunks with free states */
+	} arena;
+
+	/* exception and trace free lists (see zm_reserveExceptions) */
+	struct {
+		zm_Exception *exceptions;
+		zm_Trace *traces;
+	} epool;
+
+	/* hashed timing wheel (1 slot = 1 ms) */
+	struct {
+		zm_Timer **wheel;
+		zm_Timer *freelist;
+		size_t count;
+		uint64_t last; /* last processed ms */
+		zm_clock_cb clock;
+	} timers;
+
+	#ifdef ZM_ENABLE_EPOLL
+	struct {
+		int fd;
+		size_t nfdevent;
+	} epoll;
+	#endif
+
+	#ifdef ZM_ENABLE_AIO
+	zm_Aio *aio;
+	#endif
+
 	struct {
 		zm_State *state;
 		zm_Worker *worker;
 		int fixedworker;
 		int suspendop;
+		void *readyarg; /* zmAWAIT of a completed future */
+		zm_State *handoff; /* next inline state */
+		unsigned int nest; /* inline steps done */
+		int stepping; /* inside a zm_go step */
 	} session;
 };
 
@@ -531,6 +962,13 @@ typedef void (*zm_tlock_cb)(FILE *f, void *data, int lock);
         izm_addTask((vm), (m), (data), false, ZM_STATE_AUTOFREE,              \
                                              __FILE__, __LINE__)
 
+#define zm_newTasks(vm, m, datas, n, out)                                     \
+        izm_addTasks((vm), (m), (datas), (n), (out), 0, __FILE__, __LINE__)
+
+#define zm_newTasklets(vm, m, datas, n, out)                                  \
+        izm_addTasks((vm), (m), (datas), (n), (out), ZM_STATE_AUTOFREE,       \
+                                                       __FILE__, __LINE__)
+
 #define zm_resume(vm, x, arg) izm_resume("zm_resume", (vm), (x), (arg),       \
                                               true, __FILE__, __LINE__)
 
@@ -596,6 +1034,17 @@ typedef void (*zm_tlock_cb)(FILE *f, void *data, int lock);
 #define zmCALLER              ZM_TASK_SUSPEND_AND_RESUME_CALLER
 #define zmSU(machine, data, arg) zmSUB(zmNewSu((machine), (data)), (arg))
 
+/* fan-out/join: resume the caller when all (or the first) subtasks return */
+#define zmSUBALL(subs, n)                                                     \
+        izmSUBJOIN(vm, (subs), (n), ZM_JOIN_ALL, __FILE__, __LINE__)
+
+#define zmSUBANY(subs, n)                                                     \
+        izmSUBJOIN(vm, (subs), (n), ZM_JOIN_ANY, __FILE__, __LINE__)
+
+/* yield to a subtask and close it if it doesn't return within ms */
+#define zmSUB_DEADLINE(x, arg, ms)                                            \
+        izmSUB_DEADLINE(vm, (x), (arg), (ms), __FILE__, __LINE__)
+
 
 /* ** task ** */
 #define zmSUSPEND    ZM_TASK_SUSPEND
@@ -603,6 +1052,30 @@ typedef void (*zm_tlock_cb)(FILE *f, void *data, int lock);
 /* ** event ** */
 #define zmEVENT(e) (izmEVENT(vm,  (e), __FILE__, __LINE__))
 
+#define zmEVENT_TIMEOUT(e, ms)                                                \
+        (izmEVENT_TIMEOUT(vm,  (e), (ms), __FILE__, __LINE__))
+
+/* persistent event binding */
+#define zmSUBSCRIBE(e) (izmSUBSCRIBE(vm,  (e), __FILE__, __LINE__))
+#define zmUNSUBSCRIBE() (zm_unsubscribe(vm, zm_getCurrent(vm), NULL))
+
+/* ** task group ** */
+#define zmJOIN(g) (izmJOIN(vm,  (g), __FILE__, __LINE__))
+
+/* ** future ** */
+#define zmAWAIT(f) (izmAWAIT(vm,  (f), __FILE__, __LINE__))
+
+/* ** fd event (ZM_ENABLE_EPOLL) ** */
+#define zmWAITFD(e) (izmWAITFD(vm,  (e), __FILE__, __LINE__))
+
+/* ** async file i/o (ZM_ENABLE_AIO) ** */
+#define zmREAD(fd, buf, len, off)                                             \
+        izmAIO(vm, ZM_AIO_READ, (fd), (buf), (len), (off), __FILE__, __LINE__)
+
+#define zmWRITE(fd, buf, len, off)                                            \
+        izmAIO(vm, ZM_AIO_WRITE, (fd), (void*)(buf), (len), (off),            \
+                                                    __FILE__, __LINE__)
+
 /* ** close ** */
 #define zmCLOSE(sub) izmCLOSE(vm, (sub), __FILE__, __LINE__)
 
@@ -628,7 +1101,7 @@ typedef void (*zm_tlock_cb)(FILE *f, void *data, int lock);
 /* Task def API*/
 #define ZMTASKDEF(x)                                                          \
     zm_yield_t (x ## __function__)(zm_VM*, int zmop, void* zmarg);            \
-    zm_Machine (x ## __byval__) = {-1, (x ## __function__), #x};              \
+    zm_Machine (x ## __byval__) = {-1, (x ## __function__), #x, 0};           \
     zm_Machine* x = &(x ## __byval__);                                        \
     zm_yield_t (x ## __function__)(zm_VM* vm, int zmop, void *zmarg)          \
     {
@@ -636,7 +1109,7 @@ typedef void (*zm_tlock_cb)(FILE *f, void *data, int lock);
 
 #define ZMTASKDEFCOPY(dest, src)                                              \
     zm_yield_t (src ## __function__)(zm_VM*, int zmop, void* zmarg);          \
-    zm_Machine (dest ## __byval__) = {-1, (src ## __function__), #dest};      \
+    zm_Machine (dest ## __byval__) = {-1, (src ## __function__), #dest, 0};   \
     zm_Machine* dest = &(dest ## __byval__)                                   \
 
 
@@ -686,6 +1159,18 @@ void *zm_malloc(size_t size);
 void *zm_mrealloc(void *ptr, size_t size);
 void zm_mfree(size_t size, void *ptr);
 
+#ifdef ZM_ENABLE_MEMSTATS
+/* zm_malloc, zm_mrealloc and zm_mfree counters (ZM_ENABLE_MEMSTATS) */
+typedef struct {
+	uint64_t allocs;
+	uint64_t frees;
+	uint64_t reallocs;
+	int64_t bytes;     /* allocated - freed (zm_mrealloc not counted) */
+} zm_MemStats;
+
+void zm_getMemStats(zm_MemStats *out);
+#endif
+
 
 /* indent and buffer print utilty */
 void zm_initPrint(zm_Print *p, FILE *stream, int indent);
@@ -733,8 +1218,23 @@ zm_yield_t izmUNRAISE(zm_VM *vm, zm_State* state, void *argument,
 zm_yield_t izmSUB(zm_VM* vm, zm_State *s, void* argument, int allowunraise,
                                                    const char *fn, int nl);
 
+zm_yield_t izmSUBJOIN(zm_VM* vm, zm_State **subs, size_t n, int mode,
+                                          const char *fn, int nl);
+
+zm_yield_t izmSUB_DEADLINE(zm_VM* vm, zm_State *s, void* argument,
+                           unsigned int ms, const char *fn, int nl);
+
 zm_yield_t izmEVENT(zm_VM* vm, zm_Event *e, const char *fn, int nl);
 
+zm_yield_t izmEVENT_TIMEOUT(zm_VM* vm, zm_Event *e, unsigned int ms,
+                            const char *fn, int nl);
+
+zm_yield_t izmSUBSCRIBE(zm_VM* vm, zm_Event *e, const char *fn, int nl);
+
+zm_yield_t izmJOIN(zm_VM* vm, zm_Group *g, const char *fn, int nl);
+
+zm_yield_t izmAWAIT(zm_VM* vm, zm_Future *f, const char *fn, int nl);
+
 int izmYieldTrace(zm_VM* vm, const char *fn, int nl);
 
 /* inside task functions */
@@ -776,10 +1276,99 @@ void zm_freeEvent(zm_VM *vm, zm_Event *event);
 
 size_t zm_trigger(zm_VM *vm, zm_Event *event, void *argument);
 
+size_t zm_triggerN(zm_VM *vm, zm_Event *event, void *argument, size_t k);
+
+size_t zm_triggerBatch(zm_VM *vm, zm_Event **events, void **arguments,
+                       size_t n);
+
 size_t zm_unbind(zm_VM *vm, zm_Event *event, zm_State* s, void *argument);
 
 size_t zm_unbindAll(zm_VM *vm, zm_Event *event, void *argument);
 
+size_t zm_unsubscribe(zm_VM *vm, zm_State* s, void *argument);
+
+/* timer */
+void zm_setClock(zm_VM *vm, zm_clock_cb clock);
+
+uint64_t zm_now(zm_VM *vm);
+
+int zm_nextTimeout(zm_VM *vm);
+
+/* task group */
+zm_Group* zm_newGroup(void *data);
+
+void zm_freeGroup(zm_VM *vm, zm_Group *g);
+
+void zm_groupAdd(zm_VM *vm, zm_Group *g, zm_State *s);
+
+size_t zm_groupAlive(zm_Group *g);
+
+size_t zm_groupCancel(zm_VM *vm, zm_Group *g);
+
+/* future */
+zm_Future* zm_newFuture(void *data);
+
+void zm_freeFuture(zm_VM *vm, zm_Future *f);
+
+size_t zm_complete(zm_VM *vm, zm_Future *f, void *value);
+
+int zm_isComplete(zm_Future *f);
+
+void* zm_futureValue(zm_Future *f);
+
+#ifdef ZM_ENABLE_EPOLL
+/* fd event */
+zm_Event* zm_newFdEvent(zm_VM *vm, int fd, int events);
+
+void zm_freeFdEvent(zm_VM *vm, zm_Event *event);
+
+zm_yield_t izmWAITFD(zm_VM* vm, zm_Event *e, const char *fn, int nl);
+#endif
+
+#ifdef ZM_ENABLE_AIO
+/* async file i/o */
+int zm_aioInit(zm_VM *vm, int backend);
+
+size_t zm_aioInflight(zm_VM *vm);
+
+zm_yield_t izmAIO(zm_VM* vm, int op, int fd, void *buf, size_t len,
+                      int64_t offset, const char *fn, int nl);
+#endif
+
+#ifdef ZM_ENABLE_POLL
+size_t zm_poll(zm_VM *vm, int timeout);
+#endif
+
+#ifdef ZM_ENABLE_STATS
+const zm_WorkerStats* zm_getWorkerStats(zm_VM *vm, zm_Machine *machine);
+#endif
+
+#ifdef ZM_ENABLE_RECORDER
+void zm_printRecorder(zm_Print *out, zm_VM *vm);
+#endif
+
+#ifdef ZM_ENABLE_TRACE
+void zm_startTrace(zm_VM *vm, size_t nrecord);
+void zm_stopTrace(zm_VM *vm);
+size_t zm_writeTrace(zm_VM *vm, FILE *file);
+#endif
+
+#ifdef ZM_ENABLE_PROFILE
+const zm_StateProfile* zm_getProfile(zm_VM *vm, zm_Machine *machine);
+void zm_printProfile(zm_Print *out, zm_VM *vm, size_t n);
+#endif
+
+#ifdef ZM_ENABLE_CENSUS
+void zm_census(zm_VM *vm, zm_Census *out);
+void zm_printCensus(zm_Print *out, zm_VM *vm);
+#endif
+
+#ifdef ZM_ENABLE_LATENCY
+const zm_Histogram* zm_getLatency(zm_VM *vm, zm_Machine *machine);
+void zm_resetLatency(zm_VM *vm);
+uint64_t zm_histogramPercentile(const zm_Histogram *h, double p);
+#endif
+
 /* functions */
 zm_yield_t izm_resume(const char *fname, zm_VM* vm, zm_State *s, void *argument,
                                      int iter, const char *filename, int nline);
@@ -787,6 +1376,9 @@ zm_yield_t izm_resume(const char *fname, zm_VM* vm, zm_State *s, void *argument,
 zm_State* izm_addTask(zm_VM *vm, zm_Machine *machine, void *data, int sub,
                                         int flag, const char *fn, int nl);
 
+void izm_addTasks(zm_VM *vm, zm_Machine *machine, void **datas, size_t n,
+                  zm_State **out, int flag, const char *fn, int nl);
+
 int zm_freeTask(zm_VM *vm, zm_State *state);
 
 #define zm_freeSub zm_freeSubTask
@@ -811,6 +1403,8 @@ void zm_uFree(zm_VM *vm, zm_Exception *e);
 
 void zm_printTrace(zm_Print *out, zm_Exception *e);
 
+void zm_reserveExceptions(zm_VM *vm, size_t n, size_t k);
+
 void zm_printException(zm_Print *out, zm_Exception *e, int trace);
 
 
@@ -818,7 +1412,12 @@ void zm_printException(zm_Print *out, zm_Exception *e, int trace);
 zm_VM* zm_newVM(const char *name);
 int zm_closeVM(zm_VM* vm);
 void zm_freeVM(zm_VM* vm);
+void zm_destroyVM(zm_VM* vm);
+void zm_setNoTerm(zm_Machine *machine, int noterm);
 void zm_setProcessCallback(zm_VM *vm, zm_process_cb p);
+void zm_setInlineSub(zm_VM *vm, unsigned int maxnest);
+void zm_setImplodeSlice(zm_VM *vm, size_t n);
+void zm_setDeferInit(zm_VM *vm, int defer);
 
 /* multi thread support */
 void zm_enableMT(zm_tlock_cb cb, void* data);